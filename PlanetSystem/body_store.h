@@ -0,0 +1,157 @@
+#pragma once
+#ifndef BODY_STORE_H
+#define BODY_STORE_H
+#include <vector>
+#include <glm/glm.hpp>
+
+// Structure-of-arrays storage for all simulated bodies. Simulation state is
+// kept in double precision so realistic (AU-scale) systems integrate without
+// jitter; the render path converts to camera-relative floats.
+struct BodyStore
+{
+	// Positions
+	std::vector<double> X, Y, Z;
+	// Velocities
+	std::vector<double> VX, VY, VZ;
+	// Accelerations from the last force evaluation
+	std::vector<double> AX, AY, AZ;
+	// Jerks (acceleration time derivatives), kept by the block-timestep and Hermite integrators
+	std::vector<double> JX, JY, JZ;
+	std::vector<double> Mass;
+	std::vector<double> Radius;
+	std::vector<glm::vec4> Color;
+	// Stable identifier of the body at each index; survives Remove and Permute
+	std::vector<unsigned int> Id;
+
+	static const size_t INVALID_INDEX = ~(size_t)0;
+
+	size_t Size() const { return this->X.size(); }
+	// Reserves room for n bodies in every array
+	void Reserve(size_t n)
+	{
+		this->X.reserve(n); this->Y.reserve(n); this->Z.reserve(n);
+		this->VX.reserve(n); this->VY.reserve(n); this->VZ.reserve(n);
+		this->AX.reserve(n); this->AY.reserve(n); this->AZ.reserve(n);
+		this->JX.reserve(n); this->JY.reserve(n); this->JZ.reserve(n);
+		this->Mass.reserve(n); this->Radius.reserve(n); this->Color.reserve(n);
+		this->Id.reserve(n);
+	}
+	// Appends a body and returns its index (its id is Id.back())
+	size_t Add(const glm::dvec3 &position, const glm::dvec3 &velocity, double mass, double radius, const glm::vec4 &color)
+	{
+		this->X.push_back(position.x); this->Y.push_back(position.y); this->Z.push_back(position.z);
+		this->VX.push_back(velocity.x); this->VY.push_back(velocity.y); this->VZ.push_back(velocity.z);
+		this->AX.push_back(0.0); this->AY.push_back(0.0); this->AZ.push_back(0.0);
+		this->JX.push_back(0.0); this->JY.push_back(0.0); this->JZ.push_back(0.0);
+		this->Mass.push_back(mass);
+		this->Radius.push_back(radius);
+		this->Color.push_back(color);
+		this->Id.push_back((unsigned int)this->indexOfId.size());
+		this->indexOfId.push_back(this->X.size() - 1);
+		return this->X.size() - 1;
+	}
+	// Appends count bodies with consecutive new ids in one resize of every
+	// array and returns the index of the first; the caller fills their state
+	size_t AddBulk(size_t count)
+	{
+		const size_t first = this->X.size();
+		this->Resize(first + count);
+		this->indexOfId.reserve(this->indexOfId.size() + count);
+		for (size_t i = first; i < first + count; ++i)
+		{
+			this->Id[i] = (unsigned int)this->indexOfId.size();
+			this->indexOfId.push_back(i);
+		}
+		return first;
+	}
+	// Removes body i by moving the last body into its slot (O(1), changes that body's index)
+	void Remove(size_t i)
+	{
+		this->indexOfId[this->Id[i]] = INVALID_INDEX;
+		swapRemove(this->X, i); swapRemove(this->Y, i); swapRemove(this->Z, i);
+		swapRemove(this->VX, i); swapRemove(this->VY, i); swapRemove(this->VZ, i);
+		swapRemove(this->AX, i); swapRemove(this->AY, i); swapRemove(this->AZ, i);
+		swapRemove(this->JX, i); swapRemove(this->JY, i); swapRemove(this->JZ, i);
+		swapRemove(this->Mass, i); swapRemove(this->Radius, i); swapRemove(this->Color, i);
+		swapRemove(this->Id, i);
+		if (i < this->Id.size())
+			this->indexOfId[this->Id[i]] = i;
+	}
+	// Reorders every array so that the body at index order[k] moves to index k
+	void Permute(const std::vector<unsigned int> &order)
+	{
+		gather(this->X, order); gather(this->Y, order); gather(this->Z, order);
+		gather(this->VX, order); gather(this->VY, order); gather(this->VZ, order);
+		gather(this->AX, order); gather(this->AY, order); gather(this->AZ, order);
+		gather(this->JX, order); gather(this->JY, order); gather(this->JZ, order);
+		gather(this->Mass, order); gather(this->Radius, order); gather(this->Color, order);
+		gather(this->Id, order);
+		for (size_t i = 0; i < this->Id.size(); ++i)
+			this->indexOfId[this->Id[i]] = i;
+	}
+	// Current index of the body with the given id, or INVALID_INDEX once it was removed
+	size_t IndexOf(unsigned int id) const
+	{
+		if (id < this->indexOfId.size())
+			return this->indexOfId[id];
+		return INVALID_INDEX;
+	}
+	// Number of ids handed out so far (the next Add gets this id)
+	size_t IdCount() const { return this->indexOfId.size(); }
+	// Rebuilds the id -> index map after Id was filled directly (e.g. from a checkpoint);
+	// false if an id appears twice, in which case the map is incomplete
+	bool RebuildIndex(size_t idCount)
+	{
+		this->indexOfId.assign(idCount, (size_t)INVALID_INDEX);
+		for (size_t i = 0; i < this->Id.size(); ++i)
+		{
+			if (this->indexOfId[this->Id[i]] != INVALID_INDEX)
+				return false;
+			this->indexOfId[this->Id[i]] = i;
+		}
+		return true;
+	}
+	// Resizes every array to n bodies without touching the id map; fill Id and call RebuildIndex afterwards
+	void Resize(size_t n)
+	{
+		this->X.resize(n); this->Y.resize(n); this->Z.resize(n);
+		this->VX.resize(n); this->VY.resize(n); this->VZ.resize(n);
+		this->AX.resize(n); this->AY.resize(n); this->AZ.resize(n);
+		this->JX.resize(n); this->JY.resize(n); this->JZ.resize(n);
+		this->Mass.resize(n); this->Radius.resize(n); this->Color.resize(n);
+		this->Id.resize(n);
+	}
+	// Removes every body; ids start again from 0
+	void Clear()
+	{
+		this->X.clear(); this->Y.clear(); this->Z.clear();
+		this->VX.clear(); this->VY.clear(); this->VZ.clear();
+		this->AX.clear(); this->AY.clear(); this->AZ.clear();
+		this->JX.clear(); this->JY.clear(); this->JZ.clear();
+		this->Mass.clear(); this->Radius.clear(); this->Color.clear();
+		this->Id.clear(); this->indexOfId.clear();
+	}
+	glm::dvec3 Position(size_t i) const { return glm::dvec3(this->X[i], this->Y[i], this->Z[i]); }
+	glm::dvec3 Velocity(size_t i) const { return glm::dvec3(this->VX[i], this->VY[i], this->VZ[i]); }
+	glm::dvec3 Acceleration(size_t i) const { return glm::dvec3(this->AX[i], this->AY[i], this->AZ[i]); }
+private:
+	// Index of every id ever handed out (INVALID_INDEX once removed)
+	std::vector<size_t> indexOfId;
+
+	template <typename T>
+	static void swapRemove(std::vector<T> &v, size_t i)
+	{
+		v[i] = v.back();
+		v.pop_back();
+	}
+	template <typename T>
+	static void gather(std::vector<T> &v, const std::vector<unsigned int> &order)
+	{
+		std::vector<T> sorted(v.size());
+		for (size_t k = 0; k < order.size(); ++k)
+			sorted[k] = v[order[k]];
+		v.swap(sorted);
+	}
+};
+
+#endif
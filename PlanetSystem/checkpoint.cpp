@@ -0,0 +1,218 @@
+#include <checkpoint.h>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+CheckpointWriter::CheckpointWriter()
+	:chunkCount(0), busy(false)
+{
+	this->Begin();
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	this->Wait();
+}
+
+void CheckpointWriter::Begin()
+{
+	this->buffer.assign(sizeof(CheckpointHeader), 0);
+	this->chunkCount = 0;
+}
+
+void CheckpointWriter::AddChunk(uint32_t tag, const void *data, size_t bytes)
+{
+	CheckpointChunkHeader chunk;
+	chunk.Tag = tag;
+	chunk.Reserved = 0;
+	chunk.Bytes = bytes;
+	const char *header = reinterpret_cast<const char *>(&chunk);
+	this->buffer.insert(this->buffer.end(), header, header + sizeof(chunk));
+	if (bytes > 0)
+	{
+		const char *payload = static_cast<const char *>(data);
+		this->buffer.insert(this->buffer.end(), payload, payload + bytes);
+	}
+	// keep every chunk 8-byte aligned in the file (and so in the mapping)
+	this->buffer.resize((this->buffer.size() + 7) & ~(size_t)7, 0);
+	this->chunkCount++;
+}
+
+bool CheckpointWriter::WriteAsync(const std::string &path)
+{
+	if (this->busy)
+	{
+		std::cout << "ERROR::CHECKPOINT: Previous checkpoint is still being written, skipping " << path << std::endl;
+		return false;
+	}
+	if (this->worker.joinable())
+		this->worker.join();
+	CheckpointHeader header;
+	header.Magic = CHECKPOINT_MAGIC;
+	header.Version = CHECKPOINT_VERSION;
+	header.ChunkCount = this->chunkCount;
+	std::memcpy(&this->buffer[0], &header, sizeof(header));
+	this->writing.swap(this->buffer);
+	this->Begin();
+	this->busy = true;
+	this->worker = std::thread([this, path]()
+	{
+		const std::string temporary = path + ".tmp";
+		bool written = false;
+		{
+			std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+			if (file)
+			{
+				file.write(&this->writing[0], this->writing.size());
+				written = file.good();
+			}
+		}
+#ifdef _WIN32
+		bool replaced = written && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		bool replaced = written && std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+		if (!replaced)
+			std::cout << "ERROR::CHECKPOINT: Failed to write " << path << std::endl;
+		this->busy = false;
+	});
+	return true;
+}
+
+void CheckpointWriter::Wait()
+{
+	if (this->worker.joinable())
+		this->worker.join();
+}
+
+CheckpointReader::CheckpointReader()
+	:version(0)
+{
+}
+
+CheckpointReader::~CheckpointReader()
+{
+	this->Close();
+}
+
+bool CheckpointReader::Open(const std::string &path)
+{
+	this->Close();
+	if (!this->file.Open(path))
+	{
+		std::cout << "ERROR::CHECKPOINT: Failed to open " << path << std::endl;
+		return false;
+	}
+	const char *data = this->file.Data();
+	const size_t size = this->file.Size();
+
+	CheckpointHeader header;
+	if (size < sizeof(header))
+	{
+		std::cout << "ERROR::CHECKPOINT: " << path << " is truncated" << std::endl;
+		this->Close();
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (header.Magic != CHECKPOINT_MAGIC || header.Version == 0 || header.Version > CHECKPOINT_VERSION)
+	{
+		std::cout << "ERROR::CHECKPOINT: " << path << " is not a checkpoint of a supported version" << std::endl;
+		this->Close();
+		return false;
+	}
+	this->version = header.Version;
+	size_t offset = sizeof(header);
+	for (uint64_t c = 0; c < header.ChunkCount; ++c)
+	{
+		CheckpointChunkHeader chunk;
+		if (size - offset < sizeof(chunk))
+			break;
+		std::memcpy(&chunk, data + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+		if (chunk.Bytes > size - offset)
+			break;
+		ChunkEntry entry;
+		entry.Tag = chunk.Tag;
+		entry.Offset = offset;
+		entry.Bytes = (size_t)chunk.Bytes;
+		this->chunks.push_back(entry);
+		offset += (entry.Bytes + 7) & ~(size_t)7;
+		if (offset > size)
+			offset = size;
+	}
+	if (this->chunks.size() != header.ChunkCount)
+	{
+		std::cout << "ERROR::CHECKPOINT: " << path << " is truncated" << std::endl;
+		this->Close();
+		return false;
+	}
+	return true;
+}
+
+void CheckpointReader::Close()
+{
+	this->file.Close();
+	this->version = 0;
+	this->chunks.clear();
+}
+
+const void *CheckpointReader::Chunk(uint32_t tag, size_t &bytes) const
+{
+	for (size_t c = 0; c < this->chunks.size(); ++c)
+	{
+		if (this->chunks[c].Tag == tag)
+		{
+			bytes = this->chunks[c].Bytes;
+			return this->file.Data() + this->chunks[c].Offset;
+		}
+	}
+	bytes = 0;
+	return nullptr;
+}
+
+void WriteBodyStore(CheckpointWriter &writer, uint32_t baseTag, const BodyStore &bodies)
+{
+	const std::vector<double> *arrays[] = {
+		&bodies.X, &bodies.Y, &bodies.Z, &bodies.VX, &bodies.VY, &bodies.VZ,
+		&bodies.AX, &bodies.AY, &bodies.AZ, &bodies.JX, &bodies.JY, &bodies.JZ,
+		&bodies.Mass, &bodies.Radius
+	};
+	const uint32_t count = sizeof(arrays) / sizeof(arrays[0]);
+	for (uint32_t a = 0; a < count; ++a)
+		writer.AddArray(baseTag + a, *arrays[a]);
+	writer.AddArray(baseTag + count, bodies.Color);
+	writer.AddArray(baseTag + count + 1, bodies.Id);
+}
+
+bool ReadBodyStore(const CheckpointReader &reader, uint32_t baseTag, size_t idCount, BodyStore &bodies)
+{
+	std::vector<double> *arrays[] = {
+		&bodies.X, &bodies.Y, &bodies.Z, &bodies.VX, &bodies.VY, &bodies.VZ,
+		&bodies.AX, &bodies.AY, &bodies.AZ, &bodies.JX, &bodies.JY, &bodies.JZ,
+		&bodies.Mass, &bodies.Radius
+	};
+	const uint32_t count = sizeof(arrays) / sizeof(arrays[0]);
+	bool complete = true;
+	for (uint32_t a = 0; a < count; ++a)
+		complete = complete && reader.ReadArray(baseTag + a, *arrays[a]);
+	complete = complete && reader.ReadArray(baseTag + count, bodies.Color);
+	complete = complete && reader.ReadArray(baseTag + count + 1, bodies.Id);
+	const size_t n = bodies.X.size();
+	for (uint32_t a = 0; a < count && complete; ++a)
+		complete = arrays[a]->size() == n;
+	complete = complete && bodies.Color.size() == n && bodies.Id.size() == n;
+	for (size_t i = 0; i < n && complete; ++i)
+		complete = bodies.Id[i] < idCount;
+	// a repeated id would leave one of its bodies unreachable through the map
+	if (!complete || !bodies.RebuildIndex(idCount))
+	{
+		bodies.Clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <body_store.h>
+#include <mapped_file.h>
+
+// Versioned binary snapshot of the simulation. A file is a CheckpointHeader
+// followed by chunks, each a CheckpointChunkHeader and its payload padded to
+// 8 bytes. Readers look chunks up by tag and skip tags they do not know, so
+// newer files stay readable as long as the version is not newer than ours.
+const uint32_t CHECKPOINT_MAGIC = 0x4B435350; // "PSCK"
+// Version 2: CHECKPOINT_RNG holds a RandomState instead of a rand() seed
+const uint32_t CHECKPOINT_VERSION = 2;
+
+struct CheckpointHeader {
+	uint32_t Magic, Version;
+	uint64_t ChunkCount;
+};
+
+struct CheckpointChunkHeader {
+	uint32_t Tag, Reserved;
+	uint64_t Bytes;
+};
+
+enum CheckpointTag {
+	CHECKPOINT_SETTINGS = 1,
+	CHECKPOINT_STEP_LEVELS,
+	CHECKPOINT_KEPLER_BODIES,
+	CHECKPOINT_RNG,
+	CHECKPOINT_PARTICLES,
+	CHECKPOINT_PARTICLE_RNG,
+	// BodyStore arrays take one chunk each at base + array number
+	CHECKPOINT_BODIES = 0x100,
+	CHECKPOINT_STEP_START = 0x200
+};
+
+// Assembles a snapshot in memory on the calling thread, then writes it from a
+// background thread: the simulation only pays for the copy. The file is
+// written next to the target and renamed over it when complete, so a crash
+// mid-write leaves the previous checkpoint intact.
+class CheckpointWriter
+{
+public:
+	CheckpointWriter();
+	// Waits for a pending write
+	~CheckpointWriter();
+	// Starts a new snapshot
+	void Begin();
+	void AddChunk(uint32_t tag, const void *data, size_t bytes);
+	template <typename T>
+	void AddArray(uint32_t tag, const std::vector<T> &values) { this->AddChunk(tag, values.empty() ? nullptr : &values[0], values.size() * sizeof(T)); }
+	template <typename T>
+	void AddValue(uint32_t tag, const T &value) { this->AddChunk(tag, &value, sizeof(T)); }
+	// Hands the snapshot to the writer thread; returns false (and drops the
+	// snapshot) while the previous one is still being written
+	bool WriteAsync(const std::string &path);
+	bool Busy() const { return this->busy; }
+	void Wait();
+private:
+	std::vector<char> buffer;
+	// Owned by the writer thread while busy
+	std::vector<char> writing;
+	uint64_t chunkCount;
+	std::thread worker;
+	std::atomic<bool> busy;
+};
+
+// Memory maps a checkpoint and indexes its chunks. Payloads point into the
+// mapping and stay valid until Close.
+class CheckpointReader
+{
+public:
+	CheckpointReader();
+	~CheckpointReader();
+	bool Open(const std::string &path);
+	void Close();
+	uint32_t Version() const { return this->version; }
+	// Payload of the chunk with the given tag, or nullptr if there is none
+	const void *Chunk(uint32_t tag, size_t &bytes) const;
+	template <typename T>
+	bool ReadArray(uint32_t tag, std::vector<T> &values) const
+	{
+		size_t bytes;
+		const void *data = this->Chunk(tag, bytes);
+		if (data == nullptr || bytes % sizeof(T) != 0)
+			return false;
+		values.resize(bytes / sizeof(T));
+		if (bytes > 0)
+			std::memcpy(&values[0], data, bytes);
+		return true;
+	}
+	template <typename T>
+	bool ReadValue(uint32_t tag, T &value) const
+	{
+		size_t bytes;
+		const void *data = this->Chunk(tag, bytes);
+		if (data == nullptr || bytes != sizeof(T))
+			return false;
+		std::memcpy(&value, data, sizeof(T));
+		return true;
+	}
+private:
+	struct ChunkEntry {
+		uint32_t Tag;
+		size_t Offset, Bytes;
+	};
+	MappedFile file;
+	uint32_t version;
+	std::vector<ChunkEntry> chunks;
+};
+
+// Every array of a BodyStore (ids included) under tags base + 0..15
+void WriteBodyStore(CheckpointWriter &writer, uint32_t baseTag, const BodyStore &bodies);
+// Restores a store written by WriteBodyStore; idCount is the number of ids handed out so far
+bool ReadBodyStore(const CheckpointReader &reader, uint32_t baseTag, size_t idCount, BodyStore &bodies);
+
+#endif
@@ -0,0 +1,110 @@
+#include <collision.h>
+#include <algorithm>
+
+void SpatialHash::Build(const double *x, const double *y, const double *z, size_t n, double cellSize)
+{
+	this->cellSize = cellSize;
+	size_t tableSize = 1;
+	while (tableSize < 2 * n)
+		tableSize <<= 1;
+	this->tableMask = tableSize - 1;
+	this->cellX.resize(n);
+	this->cellY.resize(n);
+	this->cellZ.resize(n);
+	this->bucketOf.resize(n);
+	this->sorted.resize(n);
+	this->bucketStart.assign(tableSize + 1, 0);
+	// counting sort: histogram, exclusive prefix sum, scatter
+	const double invCell = 1.0 / cellSize;
+	for (size_t i = 0; i < n; ++i)
+	{
+		this->cellX[i] = (long long)std::floor(x[i] * invCell);
+		this->cellY[i] = (long long)std::floor(y[i] * invCell);
+		this->cellZ[i] = (long long)std::floor(z[i] * invCell);
+		this->bucketOf[i] = this->hashCell(this->cellX[i], this->cellY[i], this->cellZ[i]);
+		this->bucketStart[this->bucketOf[i] + 1]++;
+	}
+	for (size_t b = 0; b < tableSize; ++b)
+		this->bucketStart[b + 1] += this->bucketStart[b];
+	std::vector<GLuint> next(this->bucketStart.begin(), this->bucketStart.end() - 1);
+	for (size_t i = 0; i < n; ++i)
+		this->sorted[next[this->bucketOf[i]]++] = i;
+}
+
+void FindContacts(const BodyStore &bodies, double dt, SpatialHash &hash, std::vector<Contact> &contacts)
+{
+	contacts.clear();
+	const size_t n = bodies.Size();
+	if (n < 2)
+		return;
+	// swept spheres: centered halfway along the step, grown by half the displacement
+	std::vector<double> cx(n), cy(n), cz(n), swept(n);
+	double maxSwept = 0.0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		cx[i] = bodies.X[i] - 0.5 * dt * bodies.VX[i];
+		cy[i] = bodies.Y[i] - 0.5 * dt * bodies.VY[i];
+		cz[i] = bodies.Z[i] - 0.5 * dt * bodies.VZ[i];
+		swept[i] = bodies.Radius[i] + 0.5 * dt * glm::length(bodies.Velocity(i));
+		maxSwept = std::max(maxSwept, swept[i]);
+	}
+	if (maxSwept <= 0.0)
+		return;
+	// cells twice the typical swept radius: two spheres that fit touch only
+	// within adjacent cells
+	std::vector<double> typical(swept);
+	std::vector<double>::iterator percentile = typical.begin() + (size_t)(COLLISION_CELL_PERCENTILE * (n - 1));
+	std::nth_element(typical.begin(), percentile, typical.end());
+	const double cellSize = *percentile > 0.0 ? 2.0 * *percentile : 2.0 * maxSwept;
+	std::vector<char> fits(n);
+	std::vector<GLuint> large;
+	for (size_t i = 0; i < n; ++i)
+	{
+		fits[i] = swept[i] <= 0.5 * cellSize;
+		if (!fits[i])
+			large.push_back(i);
+	}
+
+	auto test = [&](GLuint i, GLuint j)
+	{
+		if (j < i)
+			std::swap(i, j);
+		// relative motion from the start of the step: p(t) = p + u t
+		glm::dvec3 u = bodies.Velocity(j) - bodies.Velocity(i);
+		glm::dvec3 p = (bodies.Position(j) - bodies.Position(i)) - u * dt;
+		double reach = bodies.Radius[i] + bodies.Radius[j];
+		double c = glm::dot(p, p) - reach * reach;
+		if (c <= 0.0)
+		{
+			contacts.push_back(Contact(i, j, 0.0));
+			return;
+		}
+		double b = glm::dot(p, u);
+		double a = glm::dot(u, u);
+		if (b >= 0.0 || a <= 0.0)
+			return; // separating
+		double disc = b * b - a * c;
+		if (disc < 0.0)
+			return;
+		double t = c / (-b + std::sqrt(disc)); // stable form of (-b - sqrt(disc)) / a
+		if (t <= dt)
+			contacts.push_back(Contact(i, j, t));
+	};
+	hash.Build(&cx[0], &cy[0], &cz[0], n, cellSize);
+	hash.ForEachNeighbourPair([&](GLuint i, GLuint j)
+	{
+		if (fits[i] && fits[j])
+			test(i, j);
+	});
+	// Every pair with an oversized sphere is found by the larger of the two
+	// (ties by index): its partner's centre lies within twice its swept radius
+	for (GLuint i : large)
+	{
+		hash.ForEachNear(cx[i], cy[i], cz[i], 2.0 * swept[i], [&](GLuint j)
+		{
+			if (fits[j] || swept[j] < swept[i] || (swept[j] == swept[i] && j > i))
+				test(i, j);
+		});
+	}
+	std::sort(contacts.begin(), contacts.end());
+}
@@ -0,0 +1,120 @@
+#pragma once
+#ifndef COLLISION_H
+#define COLLISION_H
+#include <vector>
+#include <cmath>
+#include <glad/glad.h>
+#include <body_store.h>
+
+// How PlanetSystem resolves two bodies that touch during a step
+enum CollisionResponse {
+	// Collisions are ignored
+	COLLISION_NONE,
+	// Perfectly inelastic merge conserving mass, momentum and volume
+	COLLISION_MERGE,
+	// Bounce off each other with a configurable coefficient of restitution
+	COLLISION_BOUNCE,
+	// Merge into the heavier body and spray debris into a ParticleGenerator
+	COLLISION_FRAGMENT
+};
+
+// A pair of bodies whose swept spheres touch Time after the start of the step
+struct Contact {
+	GLuint First, Second;
+	double Time;
+	Contact(GLuint first, GLuint second, double time) : First(first), Second(second), Time(time) {}
+	bool operator<(const Contact &other) const { return this->Time < other.Time; }
+};
+
+// Uniform grid stored as a spatial hash: points are bucketed by the hash of
+// their integer cell coordinates with a counting sort, so a rebuild is O(N)
+// and each bucket's points are contiguous in memory. Pairs are found by
+// scanning the 27 cells around every point, or all the cells a larger
+// query sphere overlaps.
+class SpatialHash
+{
+public:
+	SpatialHash() : cellSize(1.0), tableMask(0) {}
+	// Rebuilds the grid over n points with the given cell size
+	void Build(const double *x, const double *y, const double *z, size_t n, double cellSize);
+	// Calls visit(i, j) once for every pair i < j of points in the same or adjacent cells
+	template <typename Visitor>
+	void ForEachNeighbourPair(Visitor visit) const
+	{
+		const size_t n = this->cellX.size();
+		for (size_t i = 0; i < n; ++i)
+		{
+			for (int dz = -1; dz <= 1; ++dz)
+			for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				long long nx = this->cellX[i] + dx, ny = this->cellY[i] + dy, nz = this->cellZ[i] + dz;
+				size_t bucket = this->hashCell(nx, ny, nz);
+				for (GLuint k = this->bucketStart[bucket]; k < this->bucketStart[bucket + 1]; ++k)
+				{
+					GLuint j = this->sorted[k];
+					// exact cell check filters hash collisions, so every pair is seen once
+					if (j > i && this->cellX[j] == nx && this->cellY[j] == ny && this->cellZ[j] == nz)
+						visit((GLuint)i, j);
+				}
+			}
+		}
+	}
+	// Calls visit(j) once for every point in the cells overlapped by the cube of
+	// half size reach around (x, y, z), or for every point when that cube
+	// covers more cells than there are points
+	template <typename Visitor>
+	void ForEachNear(double x, double y, double z, double reach, Visitor visit) const
+	{
+		const size_t n = this->cellX.size();
+		const double invCell = 1.0 / this->cellSize;
+		const long long x0 = (long long)std::floor((x - reach) * invCell), x1 = (long long)std::floor((x + reach) * invCell);
+		const long long y0 = (long long)std::floor((y - reach) * invCell), y1 = (long long)std::floor((y + reach) * invCell);
+		const long long z0 = (long long)std::floor((z - reach) * invCell), z1 = (long long)std::floor((z + reach) * invCell);
+		if ((double)(x1 - x0 + 1) * (double)(y1 - y0 + 1) * (double)(z1 - z0 + 1) > (double)n)
+		{
+			for (size_t j = 0; j < n; ++j)
+				visit((GLuint)j);
+			return;
+		}
+		for (long long nz = z0; nz <= z1; ++nz)
+		for (long long ny = y0; ny <= y1; ++ny)
+		for (long long nx = x0; nx <= x1; ++nx)
+		{
+			size_t bucket = this->hashCell(nx, ny, nz);
+			for (GLuint k = this->bucketStart[bucket]; k < this->bucketStart[bucket + 1]; ++k)
+			{
+				GLuint j = this->sorted[k];
+				if (this->cellX[j] == nx && this->cellY[j] == ny && this->cellZ[j] == nz)
+					visit(j);
+			}
+		}
+	}
+private:
+	double cellSize;
+	size_t tableMask;
+	std::vector<long long> cellX, cellY, cellZ;
+	std::vector<GLuint> bucketStart;
+	std::vector<GLuint> sorted;
+	std::vector<GLuint> bucketOf;
+	size_t hashCell(long long x, long long y, long long z) const
+	{
+		unsigned long long h = (unsigned long long)x * 73856093ull ^ (unsigned long long)y * 19349663ull ^ (unsigned long long)z * 83492791ull;
+		return (size_t)(h & this->tableMask);
+	}
+};
+
+// Fraction of the swept spheres that fit the hash cells. The cell size follows
+// this percentile of the swept radii rather than the largest one, so a star or
+// a fast impactor does not coarsen the grid for all the debris around it.
+const double COLLISION_CELL_PERCENTILE = 0.9;
+
+// Broad and narrow phase: bodies are treated as moving linearly over the last
+// step of length dt (ending at their current positions) and their swept
+// spheres are bucketed in the hash. Spheres up to the typical size are paired
+// through adjacent cells; the few larger ones query all the cells within
+// their reach. Candidate pairs get an exact swept-sphere test. Contacts are
+// returned sorted by time of impact.
+void FindContacts(const BodyStore &bodies, double dt, SpatialHash &hash, std::vector<Contact> &contacts);
+
+#endif
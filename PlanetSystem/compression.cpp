@@ -0,0 +1,135 @@
+#include <compression.h>
+#include <cstring>
+#include <cstdint>
+
+static const unsigned int HASH_BITS = 14;
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+// Matches may not start within the last bytes and always leave some
+// literals, so the block ends with a literal-only token
+static const size_t MATCH_START_LIMIT = 12;
+static const size_t LAST_LITERALS = 5;
+
+static inline uint32_t read32(const char *p)
+{
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t hash32(uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline void writeLength(std::vector<char> &out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		out.push_back((char)255);
+	out.push_back((char)length);
+}
+
+static void writeSequence(std::vector<char> &out, const char *literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+	const size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+	const unsigned char token = (unsigned char)(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+	out.push_back((char)token);
+	if (literalCount >= 15)
+		writeLength(out, literalCount - 15);
+	out.insert(out.end(), literals, literals + literalCount);
+	if (matchLength == 0)
+		return;
+	out.push_back((char)(offset & 0xFF));
+	out.push_back((char)(offset >> 8));
+	if (matchCode >= 15)
+		writeLength(out, matchCode - 15);
+}
+
+// Reads the extra bytes of a length whose nibble was 15
+static inline bool readLength(const unsigned char *src, size_t size, size_t &ip, size_t &length)
+{
+	unsigned char byte;
+	do
+	{
+		if (ip >= size)
+			return false;
+		byte = src[ip++];
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+void CompressLZ(const char *src, size_t size, std::vector<char> &out)
+{
+	out.clear();
+	out.reserve(size + size / 255 + 16);
+	size_t anchor = 0;
+	if (size > MATCH_START_LIMIT)
+	{
+		// positions + 1 of the last occurrence of each hash, 0 for none
+		std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0);
+		const size_t limit = size - MATCH_START_LIMIT;
+		size_t i = 0;
+		while (i < limit)
+		{
+			const uint32_t sequence = read32(src + i);
+			const uint32_t h = hash32(sequence);
+			const size_t candidate = table[h];
+			table[h] = (uint32_t)(i + 1);
+			if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != sequence)
+			{
+				// step faster through data that keeps missing
+				i += 1 + ((i - anchor) >> 6);
+				continue;
+			}
+			const size_t match = candidate - 1;
+			size_t length = MIN_MATCH;
+			while (i + length < size - LAST_LITERALS && src[match + length] == src[i + length])
+				length++;
+			writeSequence(out, src + anchor, i - anchor, i - match, length);
+			i += length;
+			anchor = i;
+		}
+	}
+	writeSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool DecompressLZ(const char *source, size_t size, char *out, size_t rawSize)
+{
+	const unsigned char *src = reinterpret_cast<const unsigned char *>(source);
+	size_t ip = 0, op = 0;
+	while (ip < size)
+	{
+		const unsigned char token = src[ip++];
+		size_t literals = token >> 4;
+		if (literals == 15 && !readLength(src, size, ip, literals))
+			return false;
+		if (literals > size - ip || literals > rawSize - op)
+			return false;
+		std::memcpy(out + op, src + ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == size)
+			break;
+
+		if (size - ip < 2)
+			return false;
+		const size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+		ip += 2;
+		size_t length = token & 15;
+		if (length == 15 && !readLength(src, size, ip, length))
+			return false;
+		length += MIN_MATCH;
+		if (offset == 0 || offset > op || length > rawSize - op)
+			return false;
+		// the match may overlap its own output (runs), so copy forwards
+		const char *match = out + op - offset;
+		if (offset >= length)
+			std::memcpy(out + op, match, length);
+		else
+			for (size_t k = 0; k < length; ++k)
+				out[op + k] = match[k];
+		op += length;
+	}
+	return op == rawSize;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+#include <vector>
+#include <cstddef>
+
+// Byte oriented LZ77 in the style of LZ4: greedy matches of at least 4 bytes
+// found through a hash of the next 4 bytes, a 64 KB window and no entropy
+// coding, so both directions run at memory speed. A block is a sequence of
+// tokens (literal length << 4 | match length - 4), each followed by extra
+// length bytes when a nibble is 15, the literals, a 16-bit little-endian
+// offset and extra match length bytes; the last token carries literals only.
+
+// Compresses size bytes from src into out (replacing its contents)
+void CompressLZ(const char *src, size_t size, std::vector<char> &out);
+// Decompresses a block produced by CompressLZ into exactly rawSize bytes;
+// returns false for corrupt input instead of reading or writing out of bounds
+bool DecompressLZ(const char *src, size_t size, char *out, size_t rawSize);
+
+#endif
@@ -0,0 +1,133 @@
+#include <diagnostics.h>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <parallel.h>
+
+// Bodies per block of the reductions; fixed so results do not depend on the thread count
+static const size_t DIAGNOSTICS_BLOCK = 4096;
+
+// Partial sums of one block of bodies
+struct DiagnosticsSums {
+	CompensatedSum Kinetic, Potential;
+	CompensatedSum Momentum[3], AngularMomentum[3];
+};
+
+Diagnostics ComputeDiagnostics(const BodyStore &bodies, const double *potential, double time)
+{
+	const size_t n = bodies.Size();
+	const size_t blocks = (n + DIAGNOSTICS_BLOCK - 1) / DIAGNOSTICS_BLOCK;
+	std::vector<DiagnosticsSums> partial(blocks);
+	ParallelFor(blocks, ParallelChunkCount(blocks, 1), [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t block = begin; block < end; ++block)
+		{
+			DiagnosticsSums &sums = partial[block];
+			const size_t last = std::min(n, (block + 1) * DIAGNOSTICS_BLOCK);
+			for (size_t i = block * DIAGNOSTICS_BLOCK; i < last; ++i)
+			{
+				const double m = bodies.Mass[i];
+				const double x = bodies.X[i], y = bodies.Y[i], z = bodies.Z[i];
+				const double px = m * bodies.VX[i], py = m * bodies.VY[i], pz = m * bodies.VZ[i];
+				sums.Kinetic.Add(0.5 * (px * bodies.VX[i] + py * bodies.VY[i] + pz * bodies.VZ[i]));
+				// every pair appears in both bodies' potentials
+				sums.Potential.Add(0.5 * m * potential[i]);
+				sums.Momentum[0].Add(px);
+				sums.Momentum[1].Add(py);
+				sums.Momentum[2].Add(pz);
+				sums.AngularMomentum[0].Add(y * pz - z * py);
+				sums.AngularMomentum[1].Add(z * px - x * pz);
+				sums.AngularMomentum[2].Add(x * py - y * px);
+			}
+		}
+	});
+	DiagnosticsSums total;
+	for (size_t block = 0; block < blocks; ++block)
+	{
+		total.Kinetic.Add(partial[block].Kinetic);
+		total.Potential.Add(partial[block].Potential);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			total.Momentum[axis].Add(partial[block].Momentum[axis]);
+			total.AngularMomentum[axis].Add(partial[block].AngularMomentum[axis]);
+		}
+	}
+	Diagnostics result;
+	result.Time = time;
+	result.Kinetic = total.Kinetic.Value();
+	result.Potential = total.Potential.Value();
+	result.Momentum = glm::dvec3(total.Momentum[0].Value(), total.Momentum[1].Value(), total.Momentum[2].Value());
+	result.AngularMomentum = glm::dvec3(total.AngularMomentum[0].Value(), total.AngularMomentum[1].Value(), total.AngularMomentum[2].Value());
+	result.EnergyError = 0.0;
+	return result;
+}
+
+DiagnosticsLog::DiagnosticsLog(size_t capacity)
+	:samples(capacity > 0 ? capacity : 1), next(0), count(0), hasReference(false), referenceEnergy(0.0), maxEnergyError(0.0)
+{
+}
+
+DiagnosticsLog::~DiagnosticsLog()
+{
+	this->CloseCsv();
+}
+
+void DiagnosticsLog::Push(Diagnostics sample)
+{
+	if (!this->hasReference)
+	{
+		this->referenceEnergy = sample.Energy();
+		this->maxEnergyError = 0.0;
+		this->hasReference = true;
+	}
+	// relative to |E0|, or absolute for a system of zero energy
+	const double scale = this->referenceEnergy != 0.0 ? std::abs(this->referenceEnergy) : 1.0;
+	sample.EnergyError = (sample.Energy() - this->referenceEnergy) / scale;
+	this->maxEnergyError = std::max(this->maxEnergyError, std::abs(sample.EnergyError));
+	this->samples[this->next] = sample;
+	this->next = (this->next + 1) % this->samples.size();
+	this->count = std::min(this->count + 1, this->samples.size());
+	if (this->csv.is_open())
+	{
+		this->csv << sample.Time << ',' << sample.Kinetic << ',' << sample.Potential << ',' << sample.Energy() << ','
+			<< sample.EnergyError << ',' << sample.Momentum.x << ',' << sample.Momentum.y << ',' << sample.Momentum.z << ','
+			<< sample.AngularMomentum.x << ',' << sample.AngularMomentum.y << ',' << sample.AngularMomentum.z << '\n';
+	}
+}
+
+const Diagnostics &DiagnosticsLog::operator[](size_t i) const
+{
+	const size_t capacity = this->samples.size();
+	return this->samples[(this->next + capacity - this->count + i) % capacity];
+}
+
+void DiagnosticsLog::Clear()
+{
+	this->next = 0;
+	this->count = 0;
+	this->hasReference = false;
+	this->maxEnergyError = 0.0;
+}
+
+bool DiagnosticsLog::OpenCsv(const std::string &path)
+{
+	this->CloseCsv();
+	bool exists = std::ifstream(path.c_str()).good();
+	this->csv.open(path.c_str(), std::ios::app);
+	if (!this->csv)
+	{
+		std::cout << "ERROR::DIAGNOSTICS: Failed to open " << path << std::endl;
+		return false;
+	}
+	this->csv << std::setprecision(17);
+	if (!exists)
+		this->csv << "time,kinetic,potential,energy,energy_error,px,py,pz,lx,ly,lz\n";
+	return true;
+}
+
+void DiagnosticsLog::CloseCsv()
+{
+	if (this->csv.is_open())
+		this->csv.close();
+	this->csv.clear();
+}
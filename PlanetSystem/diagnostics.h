@@ -0,0 +1,84 @@
+#pragma once
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <body_store.h>
+
+// Running sum with Neumaier compensation: the rounding error of every
+// addition is carried separately, so summing millions of terms of mixed
+// magnitude loses no more than a couple of ulps of the result.
+struct CompensatedSum {
+	double Sum, Compensation;
+	CompensatedSum() :Sum(0.0), Compensation(0.0) {}
+	void Add(double value)
+	{
+		const double t = this->Sum + value;
+		if (std::abs(this->Sum) >= std::abs(value))
+			this->Compensation += (this->Sum - t) + value;
+		else
+			this->Compensation += (value - t) + this->Sum;
+		this->Sum = t;
+	}
+	void Add(const CompensatedSum &other)
+	{
+		this->Add(other.Sum);
+		this->Add(other.Compensation);
+	}
+	double Value() const { return this->Sum + this->Compensation; }
+};
+
+// Conserved quantities of the system at one instant. Drift in the energy or
+// the momenta beyond what collisions and removed bodies explain means the
+// integration is inaccurate.
+struct Diagnostics {
+	double Time;
+	double Kinetic, Potential;
+	glm::dvec3 Momentum, AngularMomentum;
+	// Relative change of the total energy since the log's reference sample
+	double EnergyError;
+	double Energy() const { return this->Kinetic + this->Potential; }
+};
+
+// Computes the diagnostics of bodies from their potentials per unit mass
+// (as written by the gravity solvers). The sums run over fixed blocks of
+// bodies in parallel and combine in block order, so the result does not
+// depend on the number of threads.
+Diagnostics ComputeDiagnostics(const BodyStore &bodies, const double *potential, double time);
+
+// The latest samples in a ring buffer of fixed capacity (for the HUD and
+// plots), optionally mirrored to a CSV file as they arrive. The first
+// sample after construction, Clear or ResetReference becomes the reference
+// energy of EnergyError.
+class DiagnosticsLog
+{
+public:
+	explicit DiagnosticsLog(size_t capacity = 1024);
+	~DiagnosticsLog();
+	void Push(Diagnostics sample);
+	size_t Size() const { return this->count; }
+	// Sample i counting from the oldest still held
+	const Diagnostics &operator[](size_t i) const;
+	// The most recent sample (Size() must be positive)
+	const Diagnostics &Latest() const { return (*this)[this->count - 1]; }
+	// Largest |EnergyError| seen since the reference sample
+	double MaxEnergyError() const { return this->maxEnergyError; }
+	// Measures EnergyError against the next sample from now on, e.g. after bodies were added
+	void ResetReference() { this->hasReference = false; }
+	void Clear();
+	// Appends every following sample to a CSV file (with a header when new)
+	bool OpenCsv(const std::string &path);
+	void CloseCsv();
+private:
+	std::vector<Diagnostics> samples;
+	// Slot of the next sample and the number of samples held
+	size_t next, count;
+	bool hasReference;
+	double referenceEnergy, maxEnergyError;
+	std::ofstream csv;
+};
+
+#endif
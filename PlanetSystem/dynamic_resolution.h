@@ -0,0 +1,98 @@
+#pragma once
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cmath>
+
+// Queries in flight; results are read this many frames late so reading
+// them never stalls the CPU on the GPU
+const GLuint GPU_TIMER_QUERIES = 4;
+
+// Measures the GPU time of the commands between Begin and End with a ring of
+// GL_TIME_ELAPSED queries. Poll returns the oldest finished measurement
+// without waiting for ones still in the pipeline.
+class GpuTimer
+{
+public:
+	GpuTimer() :next(0), pending(0) { glGenQueries(GPU_TIMER_QUERIES, this->queries); }
+	~GpuTimer() { glDeleteQueries(GPU_TIMER_QUERIES, this->queries); }
+	// Only one query of a target can be active, so Begin/End must not nest with other timers
+	void Begin() { glBeginQuery(GL_TIME_ELAPSED, this->queries[this->next]); }
+	void End()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		this->next = (this->next + 1) % GPU_TIMER_QUERIES;
+		// a full ring reuses the oldest query, dropping its measurement
+		if (this->pending < GPU_TIMER_QUERIES)
+			++this->pending;
+	}
+	// Milliseconds of the oldest timed frame whose result is available; false if none is yet
+	bool Poll(double &milliseconds)
+	{
+		if (this->pending == 0)
+			return false;
+		GLuint query = this->queries[(this->next + GPU_TIMER_QUERIES - this->pending) % GPU_TIMER_QUERIES];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		--this->pending;
+		milliseconds = nanoseconds * 1.0e-6;
+		return true;
+	}
+private:
+	GLuint queries[GPU_TIMER_QUERIES];
+	GLuint next, pending;
+};
+
+// Picks the fraction of the output resolution to render at from measured
+// GPU frame times. Cost is taken as proportional to the pixel count, so an
+// average over budget jumps straight to the scale expected to fit (with some
+// headroom) and a comfortably cheap frame steps back up one Step at a time.
+// After every change the controller waits Settle frames, letting the
+// average forget the old resolution, so the scale does not oscillate.
+class DynamicResolution
+{
+public:
+	double BudgetMilliseconds;
+	GLfloat MinScale, MaxScale, Step;
+	GLuint Settle;
+	explicit DynamicResolution(double budgetMilliseconds = 1000.0 / 60.0)
+		:BudgetMilliseconds(budgetMilliseconds), MinScale(0.5f), MaxScale(1.0f), Step(0.05f), Settle(30),
+		scale(1.0f), average(0.0), framesSinceChange(0) {}
+	GLfloat Scale() const { return this->scale; }
+	// Smoothed GPU milliseconds per frame
+	double Average() const { return this->average; }
+	// Feeds the GPU time of one frame; returns the scale to render at
+	GLfloat Update(double gpuMilliseconds)
+	{
+		this->average = this->framesSinceChange == 0 ? gpuMilliseconds : this->average + 0.1 * (gpuMilliseconds - this->average);
+		if (++this->framesSinceChange < this->Settle)
+			return this->scale;
+		GLfloat scale = this->scale;
+		if (this->average > this->BudgetMilliseconds)
+		{
+			// aim for 90% of the budget, rounded down to a whole step
+			scale = this->scale * (GLfloat)std::sqrt(0.9 * this->BudgetMilliseconds / this->average);
+			scale = std::floor(scale / this->Step) * this->Step;
+		}
+		else if (this->average < 0.7 * this->BudgetMilliseconds)
+			scale = this->scale + this->Step;
+		scale = glm::clamp(scale, this->MinScale, this->MaxScale);
+		if (std::abs(scale - this->scale) > 0.5f * this->Step)
+		{
+			this->scale = scale;
+			this->framesSinceChange = 0;
+		}
+		return this->scale;
+	}
+private:
+	GLfloat scale;
+	double average;
+	GLuint framesSinceChange;
+};
+
+#endif
@@ -0,0 +1,446 @@
+#include <ephemeris.h>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <simd.h>
+#include <parallel.h>
+#include <mapped_file.h>
+#include <kepler.h>
+
+// Bytes of CSV per parsing thread at least
+static const size_t CSV_GRAIN = 1 << 20;
+// Rows per chunk of the binary copy and the conversion
+static const size_t ROW_GRAIN = 8192;
+static const double DEGREES = 3.14159265358979323846 / 180.0;
+// Powers of ten that are exact in double precision
+static const double EXACT_POWERS[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+EphemerisCsvLayout::EphemerisCsvLayout()
+	:Kind(EPHEMERIS_ELEMENTS), DefaultMass(0.0), DefaultRadius(0.005), Header(true), Degrees(true), Separator(',')
+{
+	for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+		this->Fields[c] = (int)c;
+}
+
+// Number of lines in [begin, end), counting a last line without a newline
+static size_t countLines(const char *begin, const char *end)
+{
+	size_t lines = 0;
+	const char *p = begin;
+#ifdef PLANETSYSTEM_SSE2
+	const __m128i newline = _mm_set1_epi8('\n');
+	for (; end - p >= 16; p += 16)
+	{
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), newline));
+		for (; mask != 0; mask &= mask - 1)
+			lines++;
+	}
+#endif
+	for (; p < end; ++p)
+		lines += *p == '\n';
+	if (end > begin && end[-1] != '\n')
+		lines++;
+	return lines;
+}
+
+// Whether the 8 bytes (loaded little-endian) are all ASCII digits
+static inline bool isEightDigits(uint64_t v)
+{
+	return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+// Value of eight ASCII digits with three multiplications (SWAR: all digits at once in one register)
+static inline uint32_t parseEightDigits(uint64_t v)
+{
+	v -= 0x3030303030303030ull;
+	v = v * 10 + (v >> 8);
+	v = ((v & 0x000000FF000000FFull) * 0x000F424000000064ull + ((v >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull) >> 32;
+	return (uint32_t)v;
+}
+
+// Accumulates a run of digits into mantissa while it has room for them;
+// returns the number of digits consumed
+static inline size_t parseDigits(const char *&p, const char *end, uint64_t &mantissa, size_t room)
+{
+	const char *start = p;
+	while (end - p >= 8 && room >= 8)
+	{
+		uint64_t chunk;
+		std::memcpy(&chunk, p, 8);
+		if (!isEightDigits(chunk))
+			break;
+		mantissa = mantissa * 100000000 + parseEightDigits(chunk);
+		p += 8;
+		room -= 8;
+	}
+	while (p < end && room > 0 && (unsigned)(*p - '0') < 10)
+	{
+		mantissa = mantissa * 10 + (unsigned)(*p - '0');
+		++p;
+		--room;
+	}
+	return (size_t)(p - start);
+}
+
+// Parses a decimal number at p and moves p past it. Numbers of up to 19
+// digits with a small exponent (nearly every catalogue value) are computed
+// exactly from the integer mantissa; anything else goes through strtod.
+static bool parseNumber(const char *&p, const char *end, double &value)
+{
+	const char *start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	uint64_t mantissa = 0;
+	size_t digits = parseDigits(p, end, mantissa, 19);
+	bool exact = p == end || (unsigned)(*p - '0') >= 10;
+	int exponent = 0;
+	if (exact && p < end && *p == '.')
+	{
+		++p;
+		const size_t fraction = parseDigits(p, end, mantissa, 19 - digits);
+		digits += fraction;
+		exponent -= (int)fraction;
+		exact = p == end || (unsigned)(*p - '0') >= 10;
+	}
+	if (exact && digits > 0 && p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *mark = p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = *p++ == '-';
+		int written = 0;
+		const char *exponentStart = p;
+		while (p < end && (unsigned)(*p - '0') < 10 && written < 10000)
+			written = written * 10 + (*p++ - '0');
+		if (p == exponentStart)
+			p = mark;
+		else
+			exponent += negativeExponent ? -written : written;
+		exact = p == end || (unsigned)(*p - '0') >= 10;
+	}
+	if (exact && digits > 0 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+	{
+		value = (double)mantissa;
+		value = exponent >= 0 ? value * EXACT_POWERS[exponent] : value / EXACT_POWERS[-exponent];
+		if (negative)
+			value = -value;
+		return true;
+	}
+	// long mantissas, large exponents, inf and nan
+	char buffer[64];
+	size_t length = 0;
+	for (const char *q = start; q < end && length + 1 < sizeof(buffer) && std::strchr("+-.0123456789eEinfatyINFATY", *q) != nullptr; ++q)
+		buffer[length++] = *q;
+	buffer[length] = '\0';
+	char *stop;
+	value = std::strtod(buffer, &stop);
+	if (stop == buffer)
+		return false;
+	p = start + (stop - buffer);
+	return true;
+}
+
+static inline const char *skipSpace(const char *p, const char *end, char separator)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r') && *p != separator)
+		++p;
+	return p;
+}
+
+// Moves past a field that is not read, which may be quoted
+static const char *skipField(const char *p, const char *end, char separator)
+{
+	if (p < end && *p == '"')
+	{
+		for (++p; p < end; ++p)
+		{
+			if (*p == '"')
+			{
+				// a doubled quote is an escaped one
+				if (p + 1 < end && p[1] == '"')
+					++p;
+				else
+					return p + 1;
+			}
+		}
+		return p;
+	}
+	while (p < end && *p != separator)
+		++p;
+	return p;
+}
+
+// Parses the row [p, end) into values; false if it is malformed
+static bool parseRow(const char *p, const char *end, const EphemerisCsvLayout &layout, const std::vector<int> &columnOfField,
+	double *values)
+{
+	const int lastField = (int)columnOfField.size() - 1;
+	values[EPHEMERIS_MASS] = layout.DefaultMass;
+	values[EPHEMERIS_RADIUS] = layout.DefaultRadius;
+	for (int field = 0;; ++field)
+	{
+		p = skipSpace(p, end, layout.Separator);
+		const int column = columnOfField[field];
+		// an empty mass or radius keeps the default
+		const bool empty = p == end || *p == layout.Separator;
+		if (column >= 0 && !(empty && (column == (int)EPHEMERIS_MASS || column == (int)EPHEMERIS_RADIUS)))
+		{
+			if (!parseNumber(p, end, values[column]))
+				return false;
+			p = skipSpace(p, end, layout.Separator);
+		}
+		else
+			p = skipField(p, end, layout.Separator);
+		if (p < end && *p != layout.Separator)
+			return false;
+		if (field == lastField)
+			break;
+		if (p >= end)
+			return false;
+		++p;
+	}
+	if (layout.Kind == EPHEMERIS_ELEMENTS)
+	{
+		if (layout.Degrees)
+		{
+			for (size_t c = 2; c < 6; ++c)
+				values[c] *= DEGREES;
+		}
+		// the orbits ElementsToState accepts
+		const double a = values[0], e = values[1];
+		if (!(e >= 0.0) || e == 1.0 || (e < 1.0) != (a > 0.0))
+			return false;
+	}
+	for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+	{
+		if (!std::isfinite(values[c]))
+			return false;
+	}
+	return true;
+}
+
+bool ReadEphemerisCsv(const std::string &path, const EphemerisCsvLayout &layout, EphemerisTable &table, size_t *malformed)
+{
+	// table column of every field up to the last one read
+	int lastField = -1;
+	for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+	{
+		if (layout.Fields[c] < 0 && c != EPHEMERIS_MASS && c != EPHEMERIS_RADIUS)
+		{
+			std::cout << "ERROR::EPHEMERIS: Every orbit column needs a field" << std::endl;
+			return false;
+		}
+		lastField = layout.Fields[c] > lastField ? layout.Fields[c] : lastField;
+	}
+	std::vector<int> columnOfField(lastField + 1, -1);
+	for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+	{
+		if (layout.Fields[c] >= 0)
+			columnOfField[layout.Fields[c]] = (int)c;
+	}
+
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		std::cout << "ERROR::EPHEMERIS: Failed to open " << path << std::endl;
+		return false;
+	}
+	const char *data = file.Data();
+	const size_t size = file.Size();
+	file.Prefetch(0, size);
+	size_t start = 0;
+	if (layout.Header)
+	{
+		const char *newline = static_cast<const char *>(std::memchr(data, '\n', size));
+		start = newline != nullptr ? (size_t)(newline - data) + 1 : size;
+	}
+
+	// slices of whole lines, one per thread
+	const unsigned int chunks = ParallelChunkCount(size - start, CSV_GRAIN);
+	std::vector<size_t> bounds(chunks + 1, size);
+	bounds[0] = start;
+	for (unsigned int c = 1; c < chunks; ++c)
+	{
+		size_t bound = start + (size - start) * c / chunks;
+		bound = bound > bounds[c - 1] ? bound : bounds[c - 1];
+		const char *newline = static_cast<const char *>(std::memchr(data + bound, '\n', size - bound));
+		bounds[c] = newline != nullptr ? (size_t)(newline - data) + 1 : size;
+	}
+	// every slice parses into the rows after those of the slices before it,
+	// counted up front so the table is sized once
+	std::vector<size_t> firstRow(chunks + 1, 0);
+	ParallelFor(chunks, chunks, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; ++c)
+			firstRow[c + 1] = countLines(data + bounds[c], data + bounds[c + 1]);
+	});
+	for (unsigned int c = 0; c < chunks; ++c)
+		firstRow[c + 1] += firstRow[c];
+	table.Kind = layout.Kind;
+	table.Resize(firstRow[chunks]);
+	std::vector<size_t> rows(chunks, 0), rejected(chunks, 0);
+	ParallelFor(chunks, chunks, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; ++c)
+		{
+			size_t row = firstRow[c];
+			const char *p = data + bounds[c], *last = data + bounds[c + 1];
+			while (p < last)
+			{
+				const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', last - p));
+				lineEnd = lineEnd != nullptr ? lineEnd : last;
+				const char *text = skipSpace(p, lineEnd, '\0');
+				p = lineEnd < last ? lineEnd + 1 : last;
+				if (text == lineEnd || *text == '#')
+					continue;
+				double values[EPHEMERIS_COLUMNS];
+				if (!parseRow(text, lineEnd, layout, columnOfField, values))
+				{
+					rejected[c]++;
+					continue;
+				}
+				for (size_t k = 0; k < EPHEMERIS_COLUMNS; ++k)
+					table.Columns[k][row] = values[k];
+				row++;
+			}
+			rows[c] = row - firstRow[c];
+		}
+	});
+	// close the gaps left by skipped lines
+	size_t count = 0, skipped = 0;
+	for (unsigned int c = 0; c < chunks; ++c)
+	{
+		if (count != firstRow[c] && rows[c] > 0)
+		{
+			for (size_t k = 0; k < EPHEMERIS_COLUMNS; ++k)
+				std::memmove(&table.Columns[k][count], &table.Columns[k][firstRow[c]], rows[c] * sizeof(double));
+		}
+		count += rows[c];
+		skipped += rejected[c];
+	}
+	table.Resize(count);
+	if (malformed != nullptr)
+		*malformed = skipped;
+	return true;
+}
+
+bool ReadEphemerisBinary(const std::string &path, EphemerisTable &table)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		std::cout << "ERROR::EPHEMERIS: Failed to open " << path << std::endl;
+		return false;
+	}
+	EphemerisHeader header;
+	if (file.Size() < sizeof(header))
+	{
+		std::cout << "ERROR::EPHEMERIS: " << path << " is truncated" << std::endl;
+		return false;
+	}
+	std::memcpy(&header, file.Data(), sizeof(header));
+	if (header.Magic != EPHEMERIS_MAGIC || header.Version == 0 || header.Version > EPHEMERIS_VERSION
+		|| header.Kind > EPHEMERIS_ELEMENTS)
+	{
+		std::cout << "ERROR::EPHEMERIS: " << path << " is not an ephemeris of a supported version" << std::endl;
+		return false;
+	}
+	if (header.Count > (file.Size() - sizeof(header)) / (EPHEMERIS_COLUMNS * sizeof(double)))
+	{
+		std::cout << "ERROR::EPHEMERIS: " << path << " is truncated" << std::endl;
+		return false;
+	}
+	const size_t count = (size_t)header.Count;
+	const char *columns = file.Data() + sizeof(header);
+	file.Prefetch(sizeof(header), count * EPHEMERIS_COLUMNS * sizeof(double));
+	table.Kind = (EphemerisKind)header.Kind;
+	table.Resize(count);
+	ParallelFor(count, ParallelChunkCount(count, ROW_GRAIN), [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+			std::memcpy(&table.Columns[c][begin], columns + (c * count + begin) * sizeof(double), (end - begin) * sizeof(double));
+	});
+	return true;
+}
+
+bool WriteEphemerisBinary(const std::string &path, const EphemerisTable &table)
+{
+	std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "ERROR::EPHEMERIS: Failed to create " << path << std::endl;
+		return false;
+	}
+	EphemerisHeader header;
+	header.Magic = EPHEMERIS_MAGIC;
+	header.Version = EPHEMERIS_VERSION;
+	header.Kind = table.Kind;
+	header.Reserved = 0;
+	header.Count = table.Size();
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+	{
+		if (!table.Columns[c].empty())
+			file.write(reinterpret_cast<const char *>(table.Columns[c].data()), table.Columns[c].size() * sizeof(double));
+	}
+	if (!file)
+	{
+		std::cout << "ERROR::EPHEMERIS: Failed to write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+size_t EphemerisToBodies(const EphemerisTable &table, double centralMass, const GravityParams &gravity, const glm::vec4 &color,
+	BodyStore &bodies, size_t first)
+{
+	const size_t count = table.Size();
+	const unsigned int chunks = ParallelChunkCount(count, ROW_GRAIN);
+	std::vector<size_t> failed(chunks, 0);
+	ParallelFor(count, chunks, [&](unsigned int chunk, size_t begin, size_t end)
+	{
+		if (table.Kind == EPHEMERIS_ELEMENTS && end > begin)
+		{
+			std::vector<OrbitalElements> elements(end - begin);
+			std::vector<double> mu(end - begin);
+			for (size_t k = begin; k < end; ++k)
+			{
+				OrbitalElements &el = elements[k - begin];
+				el.SemiMajorAxis = table.Columns[0][k];
+				el.Eccentricity = table.Columns[1][k];
+				el.Inclination = table.Columns[2][k];
+				el.AscendingNode = table.Columns[3][k];
+				el.ArgumentOfPeriapsis = table.Columns[4][k];
+				el.MeanAnomaly = table.Columns[5][k];
+				mu[k - begin] = gravity.G * (centralMass + table.Columns[EPHEMERIS_MASS][k]);
+			}
+			const size_t i = first + begin;
+			failed[chunk] = ElementsToStateBatch(&mu[0], &elements[0], &bodies.X[i], &bodies.Y[i], &bodies.Z[i],
+				&bodies.VX[i], &bodies.VY[i], &bodies.VZ[i], end - begin);
+		}
+		for (size_t k = begin; k < end; ++k)
+		{
+			const size_t i = first + k;
+			if (table.Kind == EPHEMERIS_STATE)
+			{
+				bodies.X[i] = table.Columns[0][k]; bodies.Y[i] = table.Columns[1][k]; bodies.Z[i] = table.Columns[2][k];
+				bodies.VX[i] = table.Columns[3][k]; bodies.VY[i] = table.Columns[4][k]; bodies.VZ[i] = table.Columns[5][k];
+			}
+			bodies.AX[i] = bodies.AY[i] = bodies.AZ[i] = 0.0;
+			bodies.JX[i] = bodies.JY[i] = bodies.JZ[i] = 0.0;
+			bodies.Mass[i] = table.Columns[EPHEMERIS_MASS][k];
+			bodies.Radius[i] = table.Columns[EPHEMERIS_RADIUS][k];
+			bodies.Color[i] = color;
+		}
+	});
+	size_t total = 0;
+	for (unsigned int c = 0; c < chunks; ++c)
+		total += failed[c];
+	return total;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <body_store.h>
+#include <gravity.h>
+
+// Loading of large body catalogues (e.g. the known asteroids) from CSV or a
+// raw binary layout. Files are memory mapped and parsed by all cores into an
+// EphemerisTable, which EphemerisToBodies then converts in parallel straight
+// into bodies appended with PlanetSystem::AddBodies:
+//
+//	EphemerisTable table;
+//	if (ReadEphemerisCsv("asteroids.csv", EphemerisCsvLayout(), table))
+//		system.AddBodies(table.Size(), [&](BodyStore &bodies, size_t first) {
+//			EphemerisToBodies(table, 1.0, system.Gravity(), glm::vec4(1.0f), bodies, first);
+//		});
+
+// What the six orbit columns of a catalogue hold
+enum EphemerisKind {
+	// x, y, z, vx, vy, vz relative to the central body
+	EPHEMERIS_STATE,
+	// Semi-major axis, eccentricity, inclination, longitude of the ascending
+	// node, argument of periapsis and mean anomaly (see OrbitalElements)
+	EPHEMERIS_ELEMENTS
+};
+
+// The six orbit columns, then mass and radius
+const size_t EPHEMERIS_COLUMNS = 8;
+const size_t EPHEMERIS_MASS = 6;
+const size_t EPHEMERIS_RADIUS = 7;
+
+// Catalogue in columns; angles are in radians
+struct EphemerisTable {
+	EphemerisKind Kind;
+	std::vector<double> Columns[EPHEMERIS_COLUMNS];
+	EphemerisTable() :Kind(EPHEMERIS_ELEMENTS) {}
+	size_t Size() const { return this->Columns[0].size(); }
+	void Resize(size_t n)
+	{
+		for (size_t c = 0; c < EPHEMERIS_COLUMNS; ++c)
+			this->Columns[c].resize(n);
+	}
+};
+
+// Where the columns are in the rows of a CSV catalogue
+struct EphemerisCsvLayout {
+	EphemerisKind Kind;
+	// Field of each table column within a row (counting from 0); mass and
+	// radius may be -1 to use the defaults below. Other fields are skipped.
+	int Fields[EPHEMERIS_COLUMNS];
+	double DefaultMass, DefaultRadius;
+	// Whether the first line holds column names
+	bool Header;
+	// Whether the angles of EPHEMERIS_ELEMENTS rows are in degrees
+	bool Degrees;
+	char Separator;
+	EphemerisCsvLayout();
+};
+
+// Raw binary catalogue: an EphemerisHeader followed by the eight columns of
+// Count little-endian doubles each, in table order
+const uint32_t EPHEMERIS_MAGIC = 0x50455350; // "PSEP"
+const uint32_t EPHEMERIS_VERSION = 1;
+
+struct EphemerisHeader {
+	uint32_t Magic, Version;
+	uint32_t Kind, Reserved;
+	uint64_t Count;
+};
+
+// Reads a CSV catalogue. Blank lines and lines starting with '#' are
+// ignored; rows with missing or unparsable fields (or, for elements, an
+// impossible orbit) are skipped and counted in malformed.
+bool ReadEphemerisCsv(const std::string &path, const EphemerisCsvLayout &layout, EphemerisTable &table, size_t *malformed = nullptr);
+bool ReadEphemerisBinary(const std::string &path, EphemerisTable &table);
+// Writes the binary layout, e.g. to convert a CSV catalogue once
+bool WriteEphemerisBinary(const std::string &path, const EphemerisTable &table);
+
+// Writes the catalogue into bodies [first, first + table.Size()) as state
+// vectors around a central body of centralMass at rest at the origin.
+// Returns the number of orbits that could not be converted (left at rest at the origin).
+size_t EphemerisToBodies(const EphemerisTable &table, double centralMass, const GravityParams &gravity, const glm::vec4 &color,
+	BodyStore &bodies, size_t first);
+
+#endif
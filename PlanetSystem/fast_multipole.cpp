@@ -0,0 +1,491 @@
+#include <fast_multipole.h>
+#include <parallel.h>
+#include <algorithm>
+#include <cmath>
+
+const GLuint FastMultipole::MAX_ORDER;
+const GLuint FastMultipole::INVALID_TERM;
+
+// Bodies sharing a position would otherwise split cells forever
+static const GLuint MAX_TREE_DEPTH = 40;
+// Number of terms of an order MAX_ORDER expansion, (p+1)(p+2)(p+3)/6
+static const GLuint MAX_TERMS = (FastMultipole::MAX_ORDER + 1) * (FastMultipole::MAX_ORDER + 2) * (FastMultipole::MAX_ORDER + 3) / 6;
+// Independent subtrees per thread, so uneven subtrees still balance
+static const unsigned int TASKS_PER_CHUNK = 8;
+
+static double binomial(GLuint n, GLuint k)
+{
+	double c = 1.0;
+	for (GLuint i = 1; i <= k; ++i)
+		c = c * (n - k + i) / i;
+	return c;
+}
+
+FastMultipole::FastMultipole()
+	:order(0), openingAngle(0.5), leafSize(64), withPotential(false), eps2(0.0)
+{
+	this->SetOrder(6);
+}
+
+void FastMultipole::SetOrder(GLuint order)
+{
+	order = std::max(1u, std::min(order, MAX_ORDER));
+	if (order == this->order)
+		return;
+	this->order = order;
+	const GLuint side = order + 1;
+	this->termIndex.assign(side * side * side, INVALID_TERM);
+	this->terms.clear();
+	for (GLuint n = 0; n <= order; ++n)
+	{
+		for (GLuint i = n + 1; i-- > 0;)
+		{
+			for (GLuint j = n - i + 1; j-- > 0;)
+			{
+				Term t;
+				t.I = i; t.J = j; t.K = n - i - j; t.Order = n;
+				this->termIndex[t.I + side * (t.J + side * t.K)] = (GLuint)this->terms.size();
+				this->terms.push_back(t);
+			}
+		}
+	}
+	for (size_t a = 0; a < this->terms.size(); ++a)
+	{
+		Term &t = this->terms[a];
+		GLuint index[3] = { t.I, t.J, t.K };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			GLuint lower[3] = { t.I, t.J, t.K };
+			t.Minus1[axis] = t.Minus2[axis] = INVALID_TERM;
+			if (index[axis] >= 1)
+			{
+				lower[axis] = index[axis] - 1;
+				t.Minus1[axis] = this->termIndex[lower[0] + side * (lower[1] + side * lower[2])];
+			}
+			if (index[axis] >= 2)
+			{
+				lower[axis] = index[axis] - 2;
+				t.Minus2[axis] = this->termIndex[lower[0] + side * (lower[1] + side * lower[2])];
+			}
+		}
+	}
+	this->shiftTable.clear();
+	this->interactionTable.clear();
+	for (GLuint a = 0; a < this->terms.size(); ++a)
+	{
+		const Term &big = this->terms[a];
+		for (GLuint b = 0; b < this->terms.size(); ++b)
+		{
+			const Term &small = this->terms[b];
+			if (small.I <= big.I && small.J <= big.J && small.K <= big.K)
+			{
+				TermProduct shift;
+				shift.Target = a;
+				shift.Source = b;
+				shift.Other = this->termIndex[(big.I - small.I) + side * ((big.J - small.J) + side * (big.K - small.K))];
+				shift.Coeff = binomial(big.I, small.I) * binomial(big.J, small.J) * binomial(big.K, small.K);
+				this->shiftTable.push_back(shift);
+			}
+			// a is the source (multipole) index, b the target (local) index
+			if (big.Order + small.Order <= order)
+			{
+				TermProduct m2l;
+				m2l.Target = b;
+				m2l.Source = a;
+				m2l.Other = this->termIndex[(big.I + small.I) + side * ((big.J + small.J) + side * (big.K + small.K))];
+				m2l.Coeff = binomial(big.I + small.I, small.I) * binomial(big.J + small.J, small.J) * binomial(big.K + small.K, small.K);
+				this->interactionTable.push_back(m2l);
+			}
+		}
+	}
+}
+
+void FastMultipole::powers(const glm::dvec3 &d, double *out) const
+{
+	double px[MAX_ORDER + 1], py[MAX_ORDER + 1], pz[MAX_ORDER + 1];
+	px[0] = py[0] = pz[0] = 1.0;
+	for (GLuint k = 1; k <= this->order; ++k)
+	{
+		px[k] = px[k - 1] * d.x;
+		py[k] = py[k - 1] * d.y;
+		pz[k] = pz[k - 1] * d.z;
+	}
+	for (size_t a = 0; a < this->terms.size(); ++a)
+		out[a] = px[this->terms[a].I] * py[this->terms[a].J] * pz[this->terms[a].K];
+}
+
+// Recurrence for the Taylor coefficients a_g of 1/|r| (n = |g|):
+// n r^2 a_g = -(2n - 1) sum_i r_i a_(g - e_i) - (n - 1) sum_i a_(g - 2e_i)
+void FastMultipole::derivatives(const glm::dvec3 &r, double *out) const
+{
+	const double r2 = glm::dot(r, r);
+	const double invR2 = 1.0 / r2;
+	const double component[3] = { r.x, r.y, r.z };
+	out[0] = std::sqrt(invR2);
+	for (size_t g = 1; g < this->terms.size(); ++g)
+	{
+		const Term &t = this->terms[g];
+		double first = 0.0, second = 0.0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (t.Minus1[axis] != INVALID_TERM)
+				first += component[axis] * out[t.Minus1[axis]];
+			if (t.Minus2[axis] != INVALID_TERM)
+				second += out[t.Minus2[axis]];
+		}
+		const double n = t.Order;
+		out[g] = (-(2.0 * n - 1.0) * first - (n - 1.0) * second) * invR2 / n;
+	}
+}
+
+// Splits at the cell center; children of non-empty octants are stored contiguously
+void FastMultipole::buildTree(GLuint cellIndex, GLuint depth)
+{
+	const Cell cell = this->cells[cellIndex];
+	if (cell.End - cell.Begin <= this->leafSize || depth >= MAX_TREE_DEPTH)
+		return;
+	GLuint counts[8] = { 0 };
+	GLuint *bodies = &this->treeOrder[0];
+	for (GLuint k = cell.Begin; k < cell.End; ++k)
+	{
+		GLuint i = bodies[k];
+		int octant = (this->px[i] >= cell.Center.x ? 1 : 0) | (this->py[i] >= cell.Center.y ? 2 : 0) | (this->pz[i] >= cell.Center.z ? 4 : 0);
+		counts[octant]++;
+	}
+	GLuint start[8], next[8];
+	GLuint children = 0;
+	for (int o = 0, offset = cell.Begin; o < 8; ++o)
+	{
+		start[o] = next[o] = offset;
+		offset += counts[o];
+		if (counts[o] > 0)
+			++children;
+	}
+	for (GLuint k = cell.Begin; k < cell.End; ++k)
+	{
+		GLuint i = bodies[k];
+		int octant = (this->px[i] >= cell.Center.x ? 1 : 0) | (this->py[i] >= cell.Center.y ? 2 : 0) | (this->pz[i] >= cell.Center.z ? 4 : 0);
+		this->partitionScratch[next[octant]++] = i;
+	}
+	std::copy(this->partitionScratch.begin() + cell.Begin, this->partitionScratch.begin() + cell.End, this->treeOrder.begin() + cell.Begin);
+
+	const GLuint first = (GLuint)this->cells.size();
+	this->cells[cellIndex].FirstChild = first;
+	this->cells[cellIndex].ChildCount = children;
+	const double half = 0.5 * cell.HalfSize;
+	for (int o = 0; o < 8; ++o)
+	{
+		if (counts[o] == 0)
+			continue;
+		Cell child;
+		child.Center = cell.Center + glm::dvec3(o & 1 ? half : -half, o & 2 ? half : -half, o & 4 ? half : -half);
+		child.HalfSize = half;
+		child.Radius = 0.0;
+		child.Begin = start[o];
+		child.End = start[o] + counts[o];
+		child.FirstChild = 0;
+		child.ChildCount = 0;
+		this->cells.push_back(child);
+	}
+	for (GLuint c = 0; c < children; ++c)
+		this->buildTree(first + c, depth + 1);
+}
+
+// Expands the frontier below the root breadth first until there are enough
+// independent subtrees; the expanded cells are kept, parents first
+void FastMultipole::chooseTasks(unsigned int chunks)
+{
+	this->tasks.assign(1, 0);
+	this->topCells.clear();
+	const size_t wanted = chunks > 1 ? (size_t)chunks * TASKS_PER_CHUNK : 1;
+	while (this->tasks.size() < wanted)
+	{
+		std::vector<GLuint> frontier;
+		bool expanded = false;
+		for (size_t t = 0; t < this->tasks.size(); ++t)
+		{
+			const Cell &cell = this->cells[this->tasks[t]];
+			if (cell.ChildCount == 0)
+			{
+				frontier.push_back(this->tasks[t]);
+				continue;
+			}
+			this->topCells.push_back(this->tasks[t]);
+			for (GLuint c = 0; c < cell.ChildCount; ++c)
+				frontier.push_back(cell.FirstChild + c);
+			expanded = true;
+		}
+		this->tasks.swap(frontier);
+		if (!expanded)
+			break;
+	}
+}
+
+void FastMultipole::computeMultipole(GLuint cellIndex)
+{
+	const GLuint terms = (GLuint)this->terms.size();
+	Cell &cell = this->cells[cellIndex];
+	double *m = &this->multipoles[(size_t)cellIndex * terms];
+	std::fill(m, m + terms, 0.0);
+	double power[MAX_TERMS];
+	if (cell.ChildCount == 0)
+	{
+		// P2M with expansion terms (c - x)^alpha
+		double radius2 = 0.0;
+		for (GLuint k = cell.Begin; k < cell.End; ++k)
+		{
+			glm::dvec3 d = cell.Center - glm::dvec3(this->px[k], this->py[k], this->pz[k]);
+			radius2 = std::max(radius2, glm::dot(d, d));
+			this->powers(d, power);
+			for (GLuint a = 0; a < terms; ++a)
+				m[a] += this->pm[k] * power[a];
+		}
+		cell.Radius = std::sqrt(radius2);
+		return;
+	}
+	// M2M from the children
+	double radius = 0.0;
+	for (GLuint c = 0; c < cell.ChildCount; ++c)
+	{
+		const GLuint childIndex = cell.FirstChild + c;
+		const Cell &child = this->cells[childIndex];
+		const double *mc = &this->multipoles[(size_t)childIndex * terms];
+		glm::dvec3 shift = cell.Center - child.Center;
+		radius = std::max(radius, child.Radius + glm::length(shift));
+		this->powers(shift, power);
+		for (size_t e = 0; e < this->shiftTable.size(); ++e)
+		{
+			const TermProduct &s = this->shiftTable[e];
+			m[s.Target] += s.Coeff * power[s.Other] * mc[s.Source];
+		}
+	}
+	cell.Radius = radius;
+}
+
+void FastMultipole::upward(GLuint cellIndex)
+{
+	const Cell &cell = this->cells[cellIndex];
+	for (GLuint c = 0; c < cell.ChildCount; ++c)
+		this->upward(cell.FirstChild + c);
+	this->computeMultipole(cellIndex);
+}
+
+void FastMultipole::directInteraction(const Cell &target, const Cell &source)
+{
+	const double *x = this->px.data(), *y = this->py.data(), *z = this->pz.data(), *m = this->pm.data();
+	for (GLuint i = target.Begin; i < target.End; ++i)
+	{
+		const double xi = x[i], yi = y[i], zi = z[i];
+		double sx = 0.0, sy = 0.0, sz = 0.0, sp = 0.0;
+		for (GLuint j = source.Begin; j < source.End; ++j)
+		{
+			double dx = x[j] - xi, dy = y[j] - yi, dz = z[j] - zi;
+			double r2 = dx * dx + dy * dy + dz * dz + this->eps2;
+			if (r2 <= 0.0)
+				continue;
+			double invR = 1.0 / std::sqrt(r2);
+			double s = m[j] * invR * invR * invR;
+			sx += s * dx;
+			sy += s * dy;
+			sz += s * dz;
+			sp += m[j] * invR;
+		}
+		this->accX[i] += sx;
+		this->accY[i] += sy;
+		this->accZ[i] += sz;
+		if (this->withPotential)
+			this->pot[i] += sp;
+	}
+}
+
+// One-directional dual walk: only the target subtree is written, so walks
+// of disjoint target subtrees can run concurrently
+void FastMultipole::interact(GLuint targetIndex, GLuint sourceIndex)
+{
+	const Cell &target = this->cells[targetIndex];
+	const Cell &source = this->cells[sourceIndex];
+	if (targetIndex != sourceIndex)
+	{
+		glm::dvec3 r = target.Center - source.Center;
+		double reach = target.Radius + source.Radius;
+		if (reach * reach < this->openingAngle * this->openingAngle * glm::dot(r, r))
+		{
+			// M2L: L_beta += sum_alpha C(alpha + beta, beta) a_(alpha + beta)(r) M_alpha
+			const GLuint terms = (GLuint)this->terms.size();
+			double derivative[MAX_TERMS];
+			this->derivatives(r, derivative);
+			double *l = &this->locals[(size_t)targetIndex * terms];
+			const double *m = &this->multipoles[(size_t)sourceIndex * terms];
+			for (size_t e = 0; e < this->interactionTable.size(); ++e)
+			{
+				const TermProduct &p = this->interactionTable[e];
+				l[p.Target] += p.Coeff * derivative[p.Other] * m[p.Source];
+			}
+			return;
+		}
+	}
+	if (target.ChildCount == 0 && source.ChildCount == 0)
+	{
+		this->directInteraction(target, source);
+		return;
+	}
+	if (targetIndex == sourceIndex)
+	{
+		for (GLuint a = 0; a < target.ChildCount; ++a)
+			for (GLuint b = 0; b < target.ChildCount; ++b)
+				this->interact(target.FirstChild + a, target.FirstChild + b);
+		return;
+	}
+	// split the larger cell (the only splittable one if the other is a leaf)
+	if (source.ChildCount == 0 || (target.ChildCount > 0 && target.Radius >= source.Radius))
+	{
+		for (GLuint a = 0; a < target.ChildCount; ++a)
+			this->interact(target.FirstChild + a, sourceIndex);
+	}
+	else
+	{
+		for (GLuint b = 0; b < source.ChildCount; ++b)
+			this->interact(targetIndex, source.FirstChild + b);
+	}
+}
+
+// L2L to the children, L2P at the leaves: the acceleration is the gradient
+// of sum_beta L_beta (x - c)^beta
+void FastMultipole::downward(GLuint cellIndex)
+{
+	const GLuint terms = (GLuint)this->terms.size();
+	const Cell &cell = this->cells[cellIndex];
+	const double *l = &this->locals[(size_t)cellIndex * terms];
+	double power[MAX_TERMS];
+	if (cell.ChildCount == 0)
+	{
+		for (GLuint k = cell.Begin; k < cell.End; ++k)
+		{
+			this->powers(glm::dvec3(this->px[k], this->py[k], this->pz[k]) - cell.Center, power);
+			double gx = 0.0, gy = 0.0, gz = 0.0;
+			for (GLuint b = 1; b < terms; ++b)
+			{
+				const Term &t = this->terms[b];
+				if (t.I > 0)
+					gx += l[b] * t.I * power[t.Minus1[0]];
+				if (t.J > 0)
+					gy += l[b] * t.J * power[t.Minus1[1]];
+				if (t.K > 0)
+					gz += l[b] * t.K * power[t.Minus1[2]];
+			}
+			this->accX[k] += gx;
+			this->accY[k] += gy;
+			this->accZ[k] += gz;
+			if (this->withPotential)
+			{
+				double p = 0.0;
+				for (GLuint b = 0; b < terms; ++b)
+					p += l[b] * power[b];
+				this->pot[k] += p;
+			}
+		}
+		return;
+	}
+	for (GLuint c = 0; c < cell.ChildCount; ++c)
+	{
+		const GLuint childIndex = cell.FirstChild + c;
+		double *lc = &this->locals[(size_t)childIndex * terms];
+		this->powers(this->cells[childIndex].Center - cell.Center, power);
+		for (size_t e = 0; e < this->shiftTable.size(); ++e)
+		{
+			// L2L: L'_small += C(big, small) d^(big - small) L_big
+			const TermProduct &s = this->shiftTable[e];
+			lc[s.Source] += s.Coeff * power[s.Other] * l[s.Target];
+		}
+		this->downward(childIndex);
+	}
+}
+
+void FastMultipole::ComputeAccelerations(const BodyStore &bodies, const GravityParams &params, double *ax, double *ay, double *az,
+	double *potential)
+{
+	const size_t n = bodies.Size();
+	if (n == 0)
+		return;
+	this->eps2 = params.Softening * params.Softening;
+
+	// root cube around the bodies, then sort the bodies into the octree
+	double minX = bodies.X[0], minY = bodies.Y[0], minZ = bodies.Z[0];
+	double maxX = minX, maxY = minY, maxZ = minZ;
+	for (size_t i = 1; i < n; ++i)
+	{
+		minX = std::min(minX, bodies.X[i]); maxX = std::max(maxX, bodies.X[i]);
+		minY = std::min(minY, bodies.Y[i]); maxY = std::max(maxY, bodies.Y[i]);
+		minZ = std::min(minZ, bodies.Z[i]); maxZ = std::max(maxZ, bodies.Z[i]);
+	}
+	Cell root;
+	root.Center = glm::dvec3(0.5 * (minX + maxX), 0.5 * (minY + maxY), 0.5 * (minZ + maxZ));
+	root.HalfSize = 0.5 * std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ)) + 1e-12;
+	root.Radius = 0.0;
+	root.Begin = 0;
+	root.End = (GLuint)n;
+	root.FirstChild = root.ChildCount = 0;
+	this->cells.assign(1, root);
+	this->treeOrder.resize(n);
+	this->partitionScratch.resize(n);
+	for (size_t i = 0; i < n; ++i)
+		this->treeOrder[i] = (GLuint)i;
+	this->px.assign(bodies.X.begin(), bodies.X.end());
+	this->py.assign(bodies.Y.begin(), bodies.Y.end());
+	this->pz.assign(bodies.Z.begin(), bodies.Z.end());
+	this->buildTree(0, 0);
+	// tree-ordered copies for the kernels
+	this->pm.resize(n);
+	for (size_t k = 0; k < n; ++k)
+	{
+		GLuint i = this->treeOrder[k];
+		this->px[k] = bodies.X[i];
+		this->py[k] = bodies.Y[i];
+		this->pz[k] = bodies.Z[i];
+		this->pm[k] = bodies.Mass[i];
+	}
+	this->accX.assign(n, 0.0);
+	this->accY.assign(n, 0.0);
+	this->accZ.assign(n, 0.0);
+	this->withPotential = potential != nullptr;
+	if (this->withPotential)
+		this->pot.assign(n, 0.0);
+	const size_t coefficients = this->cells.size() * this->terms.size();
+	this->multipoles.resize(coefficients);
+	this->locals.assign(coefficients, 0.0);
+
+	// upward pass per subtree, then the cells above them (children before parents)
+	const unsigned int chunks = ParallelChunkCount(n, 2048);
+	this->chooseTasks(chunks);
+	ParallelFor(this->tasks.size(), chunks, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+			this->upward(this->tasks[t]);
+	});
+	for (size_t c = this->topCells.size(); c-- > 0;)
+		this->computeMultipole(this->topCells[c]);
+
+	// interactions and downward pass per target subtree
+	ParallelFor(this->tasks.size(), chunks, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			this->interact(this->tasks[t], 0);
+			this->downward(this->tasks[t]);
+		}
+	});
+
+	for (size_t k = 0; k < n; ++k)
+	{
+		GLuint i = this->treeOrder[k];
+		if (ax != nullptr)
+		{
+			ax[i] = params.G * this->accX[k];
+			ay[i] = params.G * this->accY[k];
+			az[i] = params.G * this->accZ[k];
+		}
+		// the leaf's direct sum includes the softened self term m / eps
+		if (this->withPotential)
+			potential[i] = -params.G * (this->pot[k] - (this->eps2 > 0.0 ? this->pm[k] / std::sqrt(this->eps2) : 0.0));
+	}
+}
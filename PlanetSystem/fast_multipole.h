@@ -0,0 +1,102 @@
+#pragma once
+#ifndef FAST_MULTIPOLE_H
+#define FAST_MULTIPOLE_H
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <body_store.h>
+#include <gravity.h>
+
+// Fast multipole method with Cartesian Taylor expansions of configurable
+// order p on an adaptive octree. Multipoles are built bottom-up (P2M, M2M),
+// well-separated cell pairs found by a dual tree walk exchange cell-cell
+// interactions (M2L), and the locals are pushed down to the bodies (L2L,
+// L2P); pairs that fail the opening criterion below leaf level are summed
+// directly with the usual softening. Expansions are truncated at total order
+// p, which keeps M2L at O(p^6) multiply-adds with a precomputed table.
+//
+// The walk is split into independent target subtrees that run in parallel,
+// so every pair interaction is evaluated once per direction.
+class FastMultipole
+{
+public:
+	// Highest supported expansion order
+	static const GLuint MAX_ORDER = 12;
+
+	FastMultipole();
+	// Expansion order p in [1, MAX_ORDER]; the error falls roughly as theta^(p+1)
+	void SetOrder(GLuint order);
+	// Cells A and B interact through expansions when (rA + rB) < theta * |cA - cB|;
+	// theta must stay below 1 so a cell never accepts a cell containing it
+	void SetOpeningAngle(double theta) { this->openingAngle = theta; }
+	// Maximum number of bodies in a leaf cell
+	void SetLeafSize(GLuint bodies) { this->leafSize = bodies > 0 ? bodies : 1; }
+	GLuint Order() const { return this->order; }
+	double OpeningAngle() const { return this->openingAngle; }
+	// Writes the accelerations of every body into ax/ay/az (indexed by body).
+	// With potential given, the potential per unit mass of every body is
+	// evaluated from the same expansions and written there; ax/ay/az may then
+	// be nullptr.
+	void ComputeAccelerations(const BodyStore &bodies, const GravityParams &params, double *ax, double *ay, double *az,
+		double *potential = nullptr);
+private:
+	// Multi-index (I, J, K) of a Taylor term and the indices of the terms one
+	// and two steps lower along each axis (INVALID_TERM when negative)
+	struct Term {
+		GLuint I, J, K, Order;
+		GLuint Minus1[3], Minus2[3];
+	};
+	// Coefficient of a translation: target[Target] += Coeff * source[Source] * power/derivative[Other]
+	struct TermProduct {
+		GLuint Target, Source, Other;
+		double Coeff;
+	};
+	struct Cell {
+		glm::dvec3 Center;
+		double HalfSize;
+		// Distance from the center to the farthest body (bound)
+		double Radius;
+		// Range of the cell's bodies in tree order
+		GLuint Begin, End;
+		// Children are stored contiguously; ChildCount == 0 for leaves
+		GLuint FirstChild, ChildCount;
+	};
+	static const GLuint INVALID_TERM = ~0u;
+
+	GLuint order;
+	double openingAngle;
+	GLuint leafSize;
+	std::vector<Term> terms;
+	// (order+1)^3 lookup from (i, j, k) to term index
+	std::vector<GLuint> termIndex;
+	// M2M/L2L: pairs (big, small) with small <= big, Other = big - small, Coeff = C(big, small)
+	std::vector<TermProduct> shiftTable;
+	// M2L: Target = beta, Source = alpha, Other = alpha + beta, Coeff = C(alpha + beta, beta)
+	std::vector<TermProduct> interactionTable;
+
+	std::vector<Cell> cells;
+	// Body index of each tree slot and the tree-ordered copies used by the kernels
+	std::vector<GLuint> treeOrder, partitionScratch;
+	std::vector<double> px, py, pz, pm, accX, accY, accZ;
+	// Potential (sum m / r) in tree order, accumulated when withPotential is set
+	std::vector<double> pot;
+	bool withPotential;
+	std::vector<double> multipoles, locals;
+	// Target subtrees processed in parallel and the cells above them
+	std::vector<GLuint> tasks, topCells;
+	double eps2;
+
+	void buildTree(GLuint cell, GLuint depth);
+	void chooseTasks(unsigned int chunks);
+	void upward(GLuint cell);
+	void computeMultipole(GLuint cell);
+	void interact(GLuint target, GLuint source);
+	void downward(GLuint cell);
+	// Powers d^alpha of every term
+	void powers(const glm::dvec3 &d, double *out) const;
+	// Taylor coefficients of 1/|r|: D^alpha(1/|r|) / alpha!
+	void derivatives(const glm::dvec3 &r, double *out) const;
+	void directInteraction(const Cell &target, const Cell &source);
+};
+
+#endif
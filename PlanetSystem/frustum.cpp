@@ -0,0 +1,116 @@
+#include <frustum.h>
+#include <simd.h>
+
+Frustum Frustum::FromMatrix(const glm::mat4 &m)
+{
+	// Gribb/Hartmann plane extraction; glm is column-major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+	Frustum frustum;
+	frustum.Planes[0] = row3 + row0; // left
+	frustum.Planes[1] = row3 - row0; // right
+	frustum.Planes[2] = row3 + row1; // bottom
+	frustum.Planes[3] = row3 - row1; // top
+	frustum.Planes[4] = row3 + row2; // near
+	frustum.Planes[5] = row3 - row2; // far
+	for (int i = 0; i < 6; ++i)
+		frustum.Planes[i] /= glm::length(glm::vec3(frustum.Planes[i]));
+	return frustum;
+}
+
+bool Frustum::SphereVisible(const glm::vec3 &center, GLfloat radius) const
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		if (glm::dot(glm::vec3(this->Planes[i]), center) + this->Planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::BoxVisible(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		// test the box corner furthest along the plane normal
+		const glm::vec4 &p = this->Planes[i];
+		glm::vec3 corner(p.x >= 0.0f ? boxMax.x : boxMin.x,
+			p.y >= 0.0f ? boxMax.y : boxMin.y,
+			p.z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(glm::vec3(p), corner) + p.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+#ifdef PLANETSYSTEM_SSE2
+// Tests four spheres against all six planes, returns a 4-bit visibility mask
+static inline int testFourSpheres(const glm::vec4 *planes, __m128 x, __m128 y, __m128 z, __m128 r)
+{
+	__m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+	__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (int i = 0; i < 6; ++i)
+	{
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i].x), x), _mm_mul_ps(_mm_set1_ps(planes[i].y), y)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i].z), z), _mm_set1_ps(planes[i].w)));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+	}
+	return _mm_movemask_ps(inside);
+}
+#endif
+
+GLuint Frustum::CullSpheres(const GLfloat *x, const GLfloat *y, const GLfloat *z, const GLfloat *radius,
+	GLuint count, GLuint *visible) const
+{
+	GLuint written = 0;
+	GLuint i = 0;
+#ifdef PLANETSYSTEM_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		int mask = testFourSpheres(this->Planes, _mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i), _mm_loadu_ps(radius + i));
+		for (GLuint k = 0; k < 4; ++k)
+		{
+			if (mask & (1 << k))
+				visible[written++] = i + k;
+		}
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		if (this->SphereVisible(glm::vec3(x[i], y[i], z[i]), radius[i]))
+			visible[written++] = i;
+	}
+	return written;
+}
+
+GLuint Frustum::CullSpheres(const GLfloat *x, const GLfloat *y, const GLfloat *z, const GLfloat *radius,
+	const GLuint *candidates, GLuint count, GLuint *visible) const
+{
+	GLuint written = 0;
+	GLuint i = 0;
+#ifdef PLANETSYSTEM_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		const GLuint *c = candidates + i;
+		int mask = testFourSpheres(this->Planes,
+			_mm_setr_ps(x[c[0]], x[c[1]], x[c[2]], x[c[3]]),
+			_mm_setr_ps(y[c[0]], y[c[1]], y[c[2]], y[c[3]]),
+			_mm_setr_ps(z[c[0]], z[c[1]], z[c[2]], z[c[3]]),
+			_mm_setr_ps(radius[c[0]], radius[c[1]], radius[c[2]], radius[c[3]]));
+		for (GLuint k = 0; k < 4; ++k)
+		{
+			if (mask & (1 << k))
+				visible[written++] = c[k];
+		}
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		GLuint c = candidates[i];
+		if (this->SphereVisible(glm::vec3(x[c], y[c], z[c]), radius[c]))
+			visible[written++] = c;
+	}
+	return written;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Per-frame culling counters, reported on the HUD
+struct CullStats {
+	GLuint Visible;
+	GLuint Culled;
+	CullStats() : Visible(0), Culled(0) {}
+};
+
+// View frustum described by six normalized planes (left, right, bottom,
+// top, near, far) whose normals point inwards. Extracted from a
+// view-projection matrix, so it works for any camera/projection pair.
+class Frustum
+{
+public:
+	glm::vec4 Planes[6];
+	// Extracts the planes from projection * view
+	static Frustum FromMatrix(const glm::mat4 &viewProjection);
+	// Returns true if the sphere intersects or lies inside the frustum
+	bool SphereVisible(const glm::vec3 &center, GLfloat radius) const;
+	// Returns true if the axis aligned box intersects or lies inside the frustum;
+	// use it to reject whole nodes of a spatial structure before testing their bodies
+	bool BoxVisible(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+	// Batch-tests count spheres stored as separate x/y/z/radius arrays (four at a
+	// time with SSE), writes the indices of the visible ones to visible and returns
+	// how many were written. visible must have room for count indices.
+	GLuint CullSpheres(const GLfloat *x, const GLfloat *y, const GLfloat *z, const GLfloat *radius,
+		GLuint count, GLuint *visible) const;
+	// Same as above but only tests the count spheres listed in candidates, e.g. the
+	// bodies of the spatial-structure nodes that passed BoxVisible
+	GLuint CullSpheres(const GLfloat *x, const GLfloat *y, const GLfloat *z, const GLfloat *radius,
+		const GLuint *candidates, GLuint count, GLuint *visible) const;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <gravity.h>
+#include <simd.h>
+#include <cmath>
+
+void DirectAccelerations(const BodyStore &bodies, const GravityParams &params, size_t begin, size_t end,
+	double *ax, double *ay, double *az)
+{
+	const size_t n = bodies.Size();
+	const double eps2 = params.Softening * params.Softening;
+	const double *x = bodies.X.data(), *y = bodies.Y.data(), *z = bodies.Z.data(), *m = bodies.Mass.data();
+	for (size_t i = begin; i < end; ++i)
+	{
+		const double xi = x[i], yi = y[i], zi = z[i];
+		double sx = 0.0, sy = 0.0, sz = 0.0;
+		size_t j = 0;
+#ifdef PLANETSYSTEM_SSE2
+		__m128d vxi = _mm_set1_pd(xi), vyi = _mm_set1_pd(yi), vzi = _mm_set1_pd(zi), veps2 = _mm_set1_pd(eps2);
+		__m128d accx = _mm_setzero_pd(), accy = _mm_setzero_pd(), accz = _mm_setzero_pd();
+		for (; j + 2 <= n; j += 2)
+		{
+			__m128d dx = _mm_sub_pd(_mm_loadu_pd(x + j), vxi);
+			__m128d dy = _mm_sub_pd(_mm_loadu_pd(y + j), vyi);
+			__m128d dz = _mm_sub_pd(_mm_loadu_pd(z + j), vzi);
+			__m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_add_pd(_mm_mul_pd(dz, dz), veps2));
+			// mask out the self interaction (r2 == 0 without softening)
+			__m128d valid = _mm_cmpgt_pd(r2, _mm_setzero_pd());
+			__m128d safeR2 = _mm_or_pd(_mm_and_pd(valid, r2), _mm_andnot_pd(valid, _mm_set1_pd(1.0)));
+			__m128d invR = _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(safeR2));
+			__m128d invR3 = _mm_mul_pd(_mm_mul_pd(invR, invR), invR);
+			__m128d s = _mm_and_pd(valid, _mm_mul_pd(_mm_loadu_pd(m + j), invR3));
+			accx = _mm_add_pd(accx, _mm_mul_pd(s, dx));
+			accy = _mm_add_pd(accy, _mm_mul_pd(s, dy));
+			accz = _mm_add_pd(accz, _mm_mul_pd(s, dz));
+		}
+		double lanes[2];
+		_mm_storeu_pd(lanes, accx); sx = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, accy); sy = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, accz); sz = lanes[0] + lanes[1];
+#endif
+		for (; j < n; ++j)
+		{
+			double dx = x[j] - xi, dy = y[j] - yi, dz = z[j] - zi;
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0)
+				continue;
+			double invR = 1.0 / std::sqrt(r2);
+			double s = m[j] * invR * invR * invR;
+			sx += s * dx;
+			sy += s * dy;
+			sz += s * dz;
+		}
+		ax[i] = params.G * sx;
+		ay[i] = params.G * sy;
+		az[i] = params.G * sz;
+	}
+}
+
+void DirectAccelerationsJerks(const BodyStore &bodies, const GravityParams &params, const GLuint *targets, size_t count,
+	double *ax, double *ay, double *az, double *jx, double *jy, double *jz)
+{
+	const size_t n = bodies.Size();
+	const double eps2 = params.Softening * params.Softening;
+	const double *x = bodies.X.data(), *y = bodies.Y.data(), *z = bodies.Z.data();
+	const double *vx = bodies.VX.data(), *vy = bodies.VY.data(), *vz = bodies.VZ.data(), *m = bodies.Mass.data();
+	for (size_t t = 0; t < count; ++t)
+	{
+		const size_t i = targets[t];
+		const double xi = x[i], yi = y[i], zi = z[i], vxi = vx[i], vyi = vy[i], vzi = vz[i];
+		double sax = 0.0, say = 0.0, saz = 0.0, sjx = 0.0, sjy = 0.0, sjz = 0.0;
+		size_t j = 0;
+#ifdef PLANETSYSTEM_SSE2
+		__m128d pxi = _mm_set1_pd(xi), pyi = _mm_set1_pd(yi), pzi = _mm_set1_pd(zi);
+		__m128d qxi = _mm_set1_pd(vxi), qyi = _mm_set1_pd(vyi), qzi = _mm_set1_pd(vzi);
+		__m128d veps2 = _mm_set1_pd(eps2), three = _mm_set1_pd(3.0);
+		__m128d accx = _mm_setzero_pd(), accy = _mm_setzero_pd(), accz = _mm_setzero_pd();
+		__m128d jrkx = _mm_setzero_pd(), jrky = _mm_setzero_pd(), jrkz = _mm_setzero_pd();
+		for (; j + 2 <= n; j += 2)
+		{
+			__m128d dx = _mm_sub_pd(_mm_loadu_pd(x + j), pxi);
+			__m128d dy = _mm_sub_pd(_mm_loadu_pd(y + j), pyi);
+			__m128d dz = _mm_sub_pd(_mm_loadu_pd(z + j), pzi);
+			__m128d dvx = _mm_sub_pd(_mm_loadu_pd(vx + j), qxi);
+			__m128d dvy = _mm_sub_pd(_mm_loadu_pd(vy + j), qyi);
+			__m128d dvz = _mm_sub_pd(_mm_loadu_pd(vz + j), qzi);
+			__m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_add_pd(_mm_mul_pd(dz, dz), veps2));
+			// mask out the self interaction (r2 == 0 without softening)
+			__m128d valid = _mm_cmpgt_pd(r2, _mm_setzero_pd());
+			__m128d safeR2 = _mm_or_pd(_mm_and_pd(valid, r2), _mm_andnot_pd(valid, _mm_set1_pd(1.0)));
+			__m128d invR2 = _mm_div_pd(_mm_set1_pd(1.0), safeR2);
+			__m128d invR = _mm_sqrt_pd(invR2);
+			__m128d s = _mm_and_pd(valid, _mm_mul_pd(_mm_loadu_pd(m + j), _mm_mul_pd(invR2, invR)));
+			__m128d rv = _mm_mul_pd(three, _mm_mul_pd(invR2, _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dvx), _mm_mul_pd(dy, dvy)), _mm_mul_pd(dz, dvz))));
+			accx = _mm_add_pd(accx, _mm_mul_pd(s, dx));
+			accy = _mm_add_pd(accy, _mm_mul_pd(s, dy));
+			accz = _mm_add_pd(accz, _mm_mul_pd(s, dz));
+			jrkx = _mm_add_pd(jrkx, _mm_mul_pd(s, _mm_sub_pd(dvx, _mm_mul_pd(rv, dx))));
+			jrky = _mm_add_pd(jrky, _mm_mul_pd(s, _mm_sub_pd(dvy, _mm_mul_pd(rv, dy))));
+			jrkz = _mm_add_pd(jrkz, _mm_mul_pd(s, _mm_sub_pd(dvz, _mm_mul_pd(rv, dz))));
+		}
+		double lanes[2];
+		_mm_storeu_pd(lanes, accx); sax = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, accy); say = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, accz); saz = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, jrkx); sjx = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, jrky); sjy = lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, jrkz); sjz = lanes[0] + lanes[1];
+#endif
+		for (; j < n; ++j)
+		{
+			double dx = x[j] - xi, dy = y[j] - yi, dz = z[j] - zi;
+			double dvx = vx[j] - vxi, dvy = vy[j] - vyi, dvz = vz[j] - vzi;
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 <= 0.0)
+				continue;
+			double invR2 = 1.0 / r2;
+			double s = m[j] * invR2 * std::sqrt(invR2);
+			double rv = 3.0 * invR2 * (dx * dvx + dy * dvy + dz * dvz);
+			sax += s * dx;
+			say += s * dy;
+			saz += s * dz;
+			sjx += s * (dvx - rv * dx);
+			sjy += s * (dvy - rv * dy);
+			sjz += s * (dvz - rv * dz);
+		}
+		ax[i] = params.G * sax;
+		ay[i] = params.G * say;
+		az[i] = params.G * saz;
+		jx[i] = params.G * sjx;
+		jy[i] = params.G * sjy;
+		jz[i] = params.G * sjz;
+	}
+}
+
+void DirectPotentials(const BodyStore &bodies, const GravityParams &params, size_t begin, size_t end, double *potential)
+{
+	const size_t n = bodies.Size();
+	const double eps2 = params.Softening * params.Softening;
+	const double *x = bodies.X.data(), *y = bodies.Y.data(), *z = bodies.Z.data(), *m = bodies.Mass.data();
+	for (size_t i = begin; i < end; ++i)
+	{
+		const double xi = x[i], yi = y[i], zi = z[i];
+		double sum = 0.0;
+		size_t j = 0;
+#ifdef PLANETSYSTEM_SSE2
+		__m128d vxi = _mm_set1_pd(xi), vyi = _mm_set1_pd(yi), vzi = _mm_set1_pd(zi), veps2 = _mm_set1_pd(eps2);
+		__m128d acc = _mm_setzero_pd();
+		for (; j + 2 <= n; j += 2)
+		{
+			__m128d dx = _mm_sub_pd(_mm_loadu_pd(x + j), vxi);
+			__m128d dy = _mm_sub_pd(_mm_loadu_pd(y + j), vyi);
+			__m128d dz = _mm_sub_pd(_mm_loadu_pd(z + j), vzi);
+			__m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_add_pd(_mm_mul_pd(dz, dz), veps2));
+			__m128d valid = _mm_cmpgt_pd(r2, _mm_setzero_pd());
+			__m128d safeR2 = _mm_or_pd(_mm_and_pd(valid, r2), _mm_andnot_pd(valid, _mm_set1_pd(1.0)));
+			acc = _mm_add_pd(acc, _mm_and_pd(valid, _mm_div_pd(_mm_loadu_pd(m + j), _mm_sqrt_pd(safeR2))));
+		}
+		double lanes[2];
+		_mm_storeu_pd(lanes, acc); sum = lanes[0] + lanes[1];
+#endif
+		for (; j < n; ++j)
+		{
+			double dx = x[j] - xi, dy = y[j] - yi, dz = z[j] - zi;
+			double r2 = dx * dx + dy * dy + dz * dz + eps2;
+			if (r2 > 0.0)
+				sum += m[j] / std::sqrt(r2);
+		}
+		// the softened self term m_i / eps
+		if (eps2 > 0.0)
+			sum -= m[i] / std::sqrt(eps2);
+		potential[i] = -params.G * sum;
+	}
+}
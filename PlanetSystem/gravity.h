@@ -0,0 +1,34 @@
+#pragma once
+#ifndef GRAVITY_H
+#define GRAVITY_H
+#include <cstddef>
+#include <glad/glad.h>
+#include <body_store.h>
+
+// Parameters shared by the gravity kernels
+struct GravityParams {
+	// Gravitational constant in simulation units
+	double G;
+	// Plummer softening length, keeps close encounters finite
+	double Softening;
+	GravityParams() : G(1.0), Softening(0.01) {}
+};
+
+// Direct O(N^2) summation: writes the accelerations of bodies [begin, end)
+// due to every body in the store into ax/ay/az (indexed by body). The inner
+// loop over sources is vectorised with SSE2 when available.
+void DirectAccelerations(const BodyStore &bodies, const GravityParams &params, size_t begin, size_t end,
+	double *ax, double *ay, double *az);
+
+// Direct summation of accelerations and their time derivatives (jerks) in a
+// single pairwise pass, for the count bodies listed in targets only. Results
+// are written at the target's body index; other entries are left untouched.
+// Vectorised over sources like DirectAccelerations.
+void DirectAccelerationsJerks(const BodyStore &bodies, const GravityParams &params, const GLuint *targets, size_t count,
+	double *ax, double *ay, double *az, double *jx, double *jy, double *jz);
+
+// Direct summation of the softened potential per unit mass, -G sum_j m_j / sqrt(r^2 + eps^2)
+// over the other bodies, of bodies [begin, end) into potential (indexed by body)
+void DirectPotentials(const BodyStore &bodies, const GravityParams &params, size_t begin, size_t end, double *potential);
+
+#endif
@@ -0,0 +1,347 @@
+#include <ibl.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb_image.h>
+#include <mapped_file.h>
+
+// Bytes of one half float cube face or table of the given size and channel count
+static size_t layerBytes(GLuint size, GLuint channels)
+{
+	return (size_t)size * size * channels * sizeof(uint16_t);
+}
+
+// Bytes of the maps in cache layout
+static size_t cacheBytes()
+{
+	size_t bytes = 6 * layerBytes(IBL_IRRADIANCE_SIZE, 3);
+	for (GLuint mip = 0; mip < IBL_PREFILTER_MIPS; ++mip)
+		bytes += 6 * layerBytes(IBL_PREFILTER_SIZE >> mip, 3);
+	return bytes + layerBytes(IBL_BRDF_SIZE, 2);
+}
+
+static uint64_t fnv1a(const char *data, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ull;
+	return hash;
+}
+
+ImageBasedLighting::ImageBasedLighting(Shader equirectangularShader, Shader irradianceShader, Shader prefilterShader, Shader brdfShader)
+	:IrradianceMap(0), PrefilterMap(0), BrdfLUT(0), equirectangularShader(equirectangularShader), irradianceShader(irradianceShader), prefilterShader(prefilterShader), brdfShader(brdfShader)
+{
+	glGenTextures(1, &this->IrradianceMap);
+	glGenTextures(1, &this->PrefilterMap);
+	glGenTextures(1, &this->BrdfLUT);
+	glGenFramebuffers(1, &this->captureFBO);
+	// Unit cube, faces wound inwards for the camera at its centre
+	GLfloat cube[] = {
+		-1.0f, -1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f,  1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f,  1.0f, -1.0f,
+		-1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f, -1.0f,  1.0f,  1.0f, -1.0f, -1.0f,  1.0f,
+		-1.0f,  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f,  1.0f, -1.0f,  1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,  1.0f, -1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f,  1.0f,  1.0f,  1.0f, -1.0f,  1.0f,
+		-1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f, -1.0f,
+		-1.0f,  1.0f, -1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f, -1.0f,  1.0f,  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f,  1.0f
+	};
+	glGenVertexArrays(1, &this->cubeVAO);
+	glGenBuffers(1, &this->cubeVBO);
+	glBindVertexArray(this->cubeVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, this->cubeVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	// Full screen triangle for the BRDF table, laid out like PostProcessor's
+	GLfloat triangle[] = {
+		// Pos        // Tex
+		-1.0f, -1.0f, 0.0f, 0.0f,
+		 3.0f, -1.0f, 2.0f, 0.0f,
+		-1.0f,  3.0f, 0.0f, 2.0f
+	};
+	glGenVertexArrays(1, &this->quadVAO);
+	glGenBuffers(1, &this->quadVBO);
+	glBindVertexArray(this->quadVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+ImageBasedLighting::~ImageBasedLighting()
+{
+	glDeleteTextures(1, &this->IrradianceMap);
+	glDeleteTextures(1, &this->PrefilterMap);
+	glDeleteTextures(1, &this->BrdfLUT);
+	glDeleteFramebuffers(1, &this->captureFBO);
+	glDeleteVertexArrays(1, &this->cubeVAO);
+	glDeleteBuffers(1, &this->cubeVBO);
+	glDeleteVertexArrays(1, &this->quadVAO);
+	glDeleteBuffers(1, &this->quadVBO);
+}
+
+bool ImageBasedLighting::Load(const std::string &hdrPath, const std::string &cachePath)
+{
+	MappedFile source;
+	if (!source.Open(hdrPath))
+	{
+		std::cout << "ERROR::IBL: Failed to open " << hdrPath << std::endl;
+		this->allocate(std::vector<char>(cacheBytes()).data());
+		return false;
+	}
+	IblCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.Magic = IBL_CACHE_MAGIC;
+	header.Version = IBL_CACHE_VERSION;
+	header.SourceHash = fnv1a(source.Data(), source.Size());
+	header.SourceSize = source.Size();
+	header.IrradianceSize = IBL_IRRADIANCE_SIZE;
+	header.PrefilterSize = IBL_PREFILTER_SIZE;
+	header.PrefilterMips = IBL_PREFILTER_MIPS;
+	header.BrdfSize = IBL_BRDF_SIZE;
+	if (this->readCache(cachePath, header))
+		return true;
+	// The equirectangular lookup expects the first row at the bottom
+	int width, height, components;
+	stbi_set_flip_vertically_on_load(true);
+	float *image = stbi_loadf_from_memory(reinterpret_cast<const stbi_uc *>(source.Data()), (int)source.Size(), &width, &height, &components, 3);
+	stbi_set_flip_vertically_on_load(false);
+	if (!image)
+	{
+		std::cout << "ERROR::IBL: Failed to decode " << hdrPath << ": " << stbi_failure_reason() << std::endl;
+		this->allocate(std::vector<char>(cacheBytes()).data());
+		return false;
+	}
+	this->compute(image, width, height);
+	stbi_image_free(image);
+	this->writeCache(cachePath, header);
+	return true;
+}
+
+void ImageBasedLighting::Bind(GLuint firstUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + firstUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->IrradianceMap);
+	glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->PrefilterMap);
+	glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+	glBindTexture(GL_TEXTURE_2D, this->BrdfLUT);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void ImageBasedLighting::allocate(const char *data)
+{
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->IrradianceMap);
+	for (GLuint face = 0; face < 6; ++face)
+	{
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB16F, IBL_IRRADIANCE_SIZE, IBL_IRRADIANCE_SIZE, 0, GL_RGB, GL_HALF_FLOAT, data);
+		if (data)
+			data += layerBytes(IBL_IRRADIANCE_SIZE, 3);
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->PrefilterMap);
+	for (GLuint mip = 0; mip < IBL_PREFILTER_MIPS; ++mip)
+	{
+		GLuint size = IBL_PREFILTER_SIZE >> mip;
+		for (GLuint face = 0; face < 6; ++face)
+		{
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB16F, size, size, 0, GL_RGB, GL_HALF_FLOAT, data);
+			if (data)
+				data += layerBytes(size, 3);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	// trilinear, so roughness between two mips blends them
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, IBL_PREFILTER_MIPS - 1);
+
+	glBindTexture(GL_TEXTURE_2D, this->BrdfLUT);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, IBL_BRDF_SIZE, IBL_BRDF_SIZE, 0, GL_RG, GL_HALF_FLOAT, data);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+bool ImageBasedLighting::readCache(const std::string &cachePath, const IblCacheHeader &expected)
+{
+	// a missing or stale cache is expected (first run, new image) and simply recomputed
+	MappedFile file;
+	if (!file.Open(cachePath))
+		return false;
+	if (file.Size() != sizeof(IblCacheHeader) + cacheBytes() || std::memcmp(file.Data(), &expected, sizeof(IblCacheHeader)) != 0)
+		return false;
+	this->allocate(file.Data() + sizeof(IblCacheHeader));
+	return true;
+}
+
+bool ImageBasedLighting::writeCache(const std::string &cachePath, const IblCacheHeader &header) const
+{
+	std::vector<char> data(cacheBytes());
+	char *cursor = data.data();
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->IrradianceMap);
+	for (GLuint face = 0; face < 6; ++face)
+	{
+		glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, GL_HALF_FLOAT, cursor);
+		cursor += layerBytes(IBL_IRRADIANCE_SIZE, 3);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->PrefilterMap);
+	for (GLuint mip = 0; mip < IBL_PREFILTER_MIPS; ++mip)
+	{
+		for (GLuint face = 0; face < 6; ++face)
+		{
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB, GL_HALF_FLOAT, cursor);
+			cursor += layerBytes(IBL_PREFILTER_SIZE >> mip, 3);
+		}
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	glBindTexture(GL_TEXTURE_2D, this->BrdfLUT);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, cursor);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	std::ofstream file(cachePath.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "ERROR::IBL: Failed to create " << cachePath << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(data.data(), data.size());
+	if (!file)
+	{
+		std::cout << "ERROR::IBL: Failed to write " << cachePath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void ImageBasedLighting::compute(const float *image, int width, int height)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	this->allocate(NULL);
+
+	GLuint equirectangular;
+	glGenTextures(1, &equirectangular);
+	glBindTexture(GL_TEXTURE_2D, equirectangular);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, image);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// The environment as a cube map with mips; the prefilter reads coarser
+	// mips for less likely directions instead of taking more samples
+	GLuint environment;
+	glGenTextures(1, &environment);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+	for (GLuint face = 0; face < 6; ++face)
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB16F, IBL_ENVIRONMENT_SIZE, IBL_ENVIRONMENT_SIZE, 0, GL_RGB, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// One 90 degree view through each face, oriented as the cube map faces are addressed
+	const glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+	const glm::mat4 captureViews[6] = {
+		glm::lookAt(glm::vec3(0.0f), glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+	};
+	glBindFramebuffer(GL_FRAMEBUFFER, this->captureFBO);
+
+	// Equirectangular image -> environment cube map
+	this->equirectangularShader.Use();
+	this->equirectangularShader.SetInteger("equirectangularMap", 0);
+	this->equirectangularShader.SetMatrix4("projection", captureProjection);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, equirectangular);
+	glViewport(0, 0, IBL_ENVIRONMENT_SIZE, IBL_ENVIRONMENT_SIZE);
+	for (GLuint face = 0; face < 6; ++face)
+	{
+		this->equirectangularShader.SetMatrix4("view", captureViews[face]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, environment, 0);
+		if (face == 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::IBL: Failed to initialize capture FBO" << std::endl;
+		this->renderCube();
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	// Diffuse: cosine weighted convolution
+	this->irradianceShader.Use();
+	this->irradianceShader.SetInteger("environmentMap", 0);
+	this->irradianceShader.SetMatrix4("projection", captureProjection);
+	glViewport(0, 0, IBL_IRRADIANCE_SIZE, IBL_IRRADIANCE_SIZE);
+	for (GLuint face = 0; face < 6; ++face)
+	{
+		this->irradianceShader.SetMatrix4("view", captureViews[face]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->IrradianceMap, 0);
+		this->renderCube();
+	}
+
+	// Specular: GGX convolution, one roughness per mip
+	this->prefilterShader.Use();
+	this->prefilterShader.SetInteger("environmentMap", 0);
+	this->prefilterShader.SetMatrix4("projection", captureProjection);
+	this->prefilterShader.SetFloat("resolution", (GLfloat)IBL_ENVIRONMENT_SIZE);
+	for (GLuint mip = 0; mip < IBL_PREFILTER_MIPS; ++mip)
+	{
+		GLuint size = IBL_PREFILTER_SIZE >> mip;
+		glViewport(0, 0, size, size);
+		this->prefilterShader.SetFloat("roughness", (GLfloat)mip / (GLfloat)(IBL_PREFILTER_MIPS - 1));
+		for (GLuint face = 0; face < 6; ++face)
+		{
+			this->prefilterShader.SetMatrix4("view", captureViews[face]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->PrefilterMap, mip);
+			this->renderCube();
+		}
+	}
+
+	// BRDF table, independent of the environment
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->BrdfLUT, 0);
+	glViewport(0, 0, IBL_BRDF_SIZE, IBL_BRDF_SIZE);
+	this->brdfShader.Use();
+	glBindVertexArray(this->quadVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &equirectangular);
+	glDeleteTextures(1, &environment);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+	if (blend)
+		glEnable(GL_BLEND);
+}
+
+void ImageBasedLighting::renderCube() const
+{
+	glBindVertexArray(this->cubeVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glBindVertexArray(0);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef IBL_H
+#define IBL_H
+#include <string>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <shader.h>
+
+// Image based lighting from an equirectangular HDR environment, split into
+// the three lookups of the split-sum approximation (Karis, "Real Shading in
+// Unreal Engine 4"):
+//   IrradianceMap  cosine convolved environment, for diffuse light
+//   PrefilterMap   GGX convolved environment, roughness 0..1 across its mips
+//   BrdfLUT        scale and bias of F0 by (N.V, roughness)
+// A fragment then pays three texture fetches for its ambient light however
+// the environment looks. The convolutions take a while, so Load keeps their
+// result in a cache file next to the program and recomputes only when the
+// environment image changed.
+const GLuint IBL_ENVIRONMENT_SIZE = 512;
+const GLuint IBL_IRRADIANCE_SIZE = 32;
+const GLuint IBL_PREFILTER_SIZE = 128;
+const GLuint IBL_PREFILTER_MIPS = 5;
+const GLuint IBL_BRDF_SIZE = 512;
+
+// Cache file: an IblCacheHeader followed by the six irradiance faces, the
+// prefiltered faces of every mip (mip by mip) and the BRDF table, as half
+// float RGB (RG for the table) rows
+const uint32_t IBL_CACHE_MAGIC = 0x50534942; // "PSIB"
+const uint32_t IBL_CACHE_VERSION = 1;
+
+struct IblCacheHeader {
+	uint32_t Magic, Version;
+	// FNV-1a hash and size of the environment image the maps were computed from
+	uint64_t SourceHash, SourceSize;
+	uint32_t IrradianceSize, PrefilterSize, PrefilterMips, BrdfSize;
+};
+
+class ImageBasedLighting
+{
+public:
+	GLuint IrradianceMap, PrefilterMap, BrdfLUT;
+	// The shaders convert the equirectangular image to a cube map and run the three convolutions
+	ImageBasedLighting(Shader equirectangularShader, Shader irradianceShader, Shader prefilterShader, Shader brdfShader);
+	~ImageBasedLighting();
+	// Loads the maps of hdrPath from cachePath, or computes them and rewrites
+	// the cache when it is missing or was made from another image. On failure
+	// the maps are black (no ambient light).
+	bool Load(const std::string &hdrPath, const std::string &cachePath);
+	// Binds IrradianceMap, PrefilterMap and BrdfLUT to units firstUnit, firstUnit + 1 and firstUnit + 2
+	void Bind(GLuint firstUnit) const;
+private:
+	ImageBasedLighting(const ImageBasedLighting &);
+	ImageBasedLighting &operator=(const ImageBasedLighting &);
+	Shader equirectangularShader, irradianceShader, prefilterShader, brdfShader;
+	GLuint captureFBO, cubeVAO, cubeVBO, quadVAO, quadVBO;
+	// Allocates the maps, uploading data (in cache layout) when given
+	void allocate(const char *data);
+	bool readCache(const std::string &cachePath, const IblCacheHeader &expected);
+	bool writeCache(const std::string &cachePath, const IblCacheHeader &header) const;
+	// Renders the maps from an equirectangular RGB float image
+	void compute(const float *image, int width, int height);
+	// Draws the unit cube around the capture camera
+	void renderCube() const;
+};
+
+#endif
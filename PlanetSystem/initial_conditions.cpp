@@ -0,0 +1,264 @@
+#include <initial_conditions.h>
+#include <cmath>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include <kepler.h>
+#include <parallel.h>
+#include <random.h>
+
+static const double TWO_PI = 6.28318530717958647692;
+// Bodies per parallel chunk of the generators
+static const size_t GENERATOR_GRAIN = 4096;
+
+static inline void setBody(BodyStore &bodies, size_t i, const glm::dvec3 &position, const glm::dvec3 &velocity,
+	double mass, double radius, const glm::vec4 &color)
+{
+	bodies.X[i] = position.x; bodies.Y[i] = position.y; bodies.Z[i] = position.z;
+	bodies.VX[i] = velocity.x; bodies.VY[i] = velocity.y; bodies.VZ[i] = velocity.z;
+	bodies.AX[i] = bodies.AY[i] = bodies.AZ[i] = 0.0;
+	bodies.JX[i] = bodies.JY[i] = bodies.JZ[i] = 0.0;
+	bodies.Mass[i] = mass;
+	bodies.Radius[i] = radius;
+	bodies.Color[i] = color;
+}
+
+// Writes the states of count orbits around the origin into bodies [index, index + count)
+static void orbitStates(const double *mu, const OrbitalElements *elements, BodyStore &bodies, size_t index, size_t count)
+{
+	ElementsToStateBatch(mu, elements, &bodies.X[index], &bodies.Y[index], &bodies.Z[index],
+		&bodies.VX[index], &bodies.VY[index], &bodies.VZ[index], count);
+}
+
+// Uniformly distributed direction
+static glm::dvec3 isotropic(Random &rng)
+{
+	const double cosTheta = rng.Uniform(-1.0, 1.0), phi = rng.Uniform(0.0, TWO_PI);
+	const double sinTheta = std::sqrt(1.0 - cosTheta * cosTheta);
+	return glm::dvec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+// Rayleigh deviate with scale sigma
+static double rayleigh(Random &rng, double sigma)
+{
+	return sigma * std::sqrt(-2.0 * std::log(1.0 - rng.NextDouble()));
+}
+
+PlanetarySystemParams::PlanetarySystemParams()
+	:Planets(8), StarMass(1.0), StarRadius(0.2), InnerRadius(1.0), OuterRadius(10.0),
+	MinPlanetMass(1e-7), MaxPlanetMass(1e-3), PlanetRadius(0.05), MaxEccentricity(0.1), MaxInclination(0.05),
+	StarColor(1.0f, 0.9f, 0.6f, 1.0f), PlanetColor(1.0f)
+{
+}
+
+void GeneratePlanetarySystem(const PlanetarySystemParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first)
+{
+	const size_t planets = params.Planets;
+	ParallelFor(planets, ParallelChunkCount(planets, GENERATOR_GRAIN), [&](unsigned int, size_t begin, size_t end)
+	{
+		std::vector<OrbitalElements> elements(end - begin);
+		std::vector<double> mu(end - begin);
+		for (size_t k = begin; k < end; ++k)
+		{
+			// stream 0 is the star
+			Random rng(seed, k + 1);
+			OrbitalElements &el = elements[k - begin];
+			el.SemiMajorAxis = params.InnerRadius * std::pow(params.OuterRadius / params.InnerRadius, rng.NextDouble());
+			el.Eccentricity = rng.Uniform(0.0, params.MaxEccentricity);
+			el.Inclination = rng.Uniform(0.0, params.MaxInclination);
+			el.AscendingNode = rng.Uniform(0.0, TWO_PI);
+			el.ArgumentOfPeriapsis = rng.Uniform(0.0, TWO_PI);
+			el.MeanAnomaly = rng.Uniform(0.0, TWO_PI);
+			const double mass = params.MinPlanetMass * std::pow(params.MaxPlanetMass / params.MinPlanetMass, rng.NextDouble());
+			mu[k - begin] = gravity.G * (params.StarMass + mass);
+			setBody(bodies, first + 1 + k, glm::dvec3(0.0), glm::dvec3(0.0), mass, params.PlanetRadius, params.PlanetColor);
+		}
+		if (end > begin)
+			orbitStates(&mu[0], &elements[0], bodies, first + 1 + begin, end - begin);
+	});
+	// the star's reflex motion, summed in body order
+	glm::dvec3 momentum(0.0);
+	for (size_t i = first + 1; i < first + 1 + planets; ++i)
+		momentum += bodies.Mass[i] * bodies.Velocity(i);
+	setBody(bodies, first, glm::dvec3(0.0), -momentum / params.StarMass, params.StarMass, params.StarRadius, params.StarColor);
+}
+
+AsteroidBeltParams::AsteroidBeltParams()
+	:Count(10000), CentralMass(1.0), InnerRadius(2.1), OuterRadius(3.3), EccentricitySigma(0.1), InclinationSigma(0.1),
+	Mass(0.0), Radius(0.005), Color(0.6f, 0.55f, 0.5f, 1.0f)
+{
+}
+
+void GenerateAsteroidBelt(const AsteroidBeltParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first)
+{
+	const size_t count = params.Count;
+	ParallelFor(count, ParallelChunkCount(count, GENERATOR_GRAIN), [&](unsigned int, size_t begin, size_t end)
+	{
+		std::vector<OrbitalElements> elements(end - begin);
+		std::vector<double> mu(end - begin, gravity.G * (params.CentralMass + params.Mass));
+		for (size_t k = begin; k < end; ++k)
+		{
+			Random rng(seed, k);
+			OrbitalElements &el = elements[k - begin];
+			el.SemiMajorAxis = rng.Uniform(params.InnerRadius, params.OuterRadius);
+			// the Rayleigh tail is cut off before the orbits become unbound
+			el.Eccentricity = glm::min(rayleigh(rng, params.EccentricitySigma), 0.9);
+			el.Inclination = rayleigh(rng, params.InclinationSigma);
+			el.AscendingNode = rng.Uniform(0.0, TWO_PI);
+			el.ArgumentOfPeriapsis = rng.Uniform(0.0, TWO_PI);
+			el.MeanAnomaly = rng.Uniform(0.0, TWO_PI);
+			setBody(bodies, first + k, glm::dvec3(0.0), glm::dvec3(0.0), params.Mass, params.Radius, params.Color);
+		}
+		if (end > begin)
+			orbitStates(&mu[0], &elements[0], bodies, first + begin, end - begin);
+	});
+}
+
+PlummerParams::PlummerParams()
+	:Count(10000), Mass(1.0), ScaleRadius(1.0), Radius(0.01), Color(1.0f, 0.9f, 0.8f, 1.0f)
+{
+}
+
+void GeneratePlummerSphere(const PlummerParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first)
+{
+	const size_t count = params.Count;
+	if (count == 0)
+		return;
+	const double a = params.ScaleRadius;
+	const double mass = params.Mass / count;
+	const double escapeScale = std::sqrt(2.0 * gravity.G * params.Mass / a);
+	ParallelFor(count, ParallelChunkCount(count, GENERATOR_GRAIN), [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t k = begin; k < end; ++k)
+		{
+			Random rng(seed, k);
+			// radius from the inverted cumulative mass, leaving out the outermost 0.1%
+			const double enclosed = 0.999 * (1.0 - rng.NextDouble());
+			const double r = a / std::sqrt(std::pow(enclosed, -2.0 / 3.0) - 1.0);
+			const glm::dvec3 position = r * isotropic(rng);
+			// speed as a fraction q of the local escape speed, with density q^2 (1 - q^2)^3.5 (peak below 0.1)
+			double q, g;
+			do
+			{
+				q = rng.NextDouble();
+				g = 0.1 * rng.NextDouble();
+			} while (g > q * q * std::pow(1.0 - q * q, 3.5));
+			const double speed = q * escapeScale * std::pow(1.0 + r * r / (a * a), -0.25);
+			setBody(bodies, first + k, position, speed * isotropic(rng), mass, params.Radius, params.Color);
+		}
+	});
+	// move to the centre-of-mass frame (sums in body order)
+	glm::dvec3 centre(0.0), drift(0.0);
+	for (size_t i = first; i < first + count; ++i)
+	{
+		centre += bodies.Position(i);
+		drift += bodies.Velocity(i);
+	}
+	centre /= (double)count;
+	drift /= (double)count;
+	for (size_t i = first; i < first + count; ++i)
+	{
+		bodies.X[i] -= centre.x; bodies.Y[i] -= centre.y; bodies.Z[i] -= centre.z;
+		bodies.VX[i] -= drift.x; bodies.VY[i] -= drift.y; bodies.VZ[i] -= drift.z;
+	}
+}
+
+ExponentialDiskParams::ExponentialDiskParams()
+	:Count(10000), Mass(1.0), ScaleLength(1.0), ScaleHeight(0.1), MaxRadius(5.0), CentralMass(1.0), CentralRadius(0.1),
+	VelocityDispersion(0.05), Radius(0.01), Color(0.8f, 0.85f, 1.0f, 1.0f)
+{
+}
+
+// Fraction of an untruncated exponential disk's mass within x scale lengths
+static double diskMassFraction(double x)
+{
+	return 1.0 - (1.0 + x) * std::exp(-x);
+}
+
+// Disk with its plane rotated by orientation, moving with the given centre;
+// body k draws from Random(seed, stream + k)
+static void generateDisk(const ExponentialDiskParams &params, const GravityParams &gravity, uint64_t seed, uint64_t stream,
+	const glm::dvec3 &center, const glm::dvec3 &velocity, const glm::dmat3 &orientation, BodyStore &bodies, size_t first)
+{
+	size_t disk = first;
+	if (params.CentralMass > 0.0)
+		setBody(bodies, disk++, center, velocity, params.CentralMass, params.CentralRadius, params.Color);
+	const size_t count = params.Count;
+	if (count == 0)
+		return;
+	const double rd = params.ScaleLength;
+	const double truncatedFraction = diskMassFraction(params.MaxRadius / rd);
+	const double mass = params.Mass / count;
+	const double eps2 = gravity.Softening * gravity.Softening;
+	ParallelFor(count, ParallelChunkCount(count, GENERATOR_GRAIN), [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t k = begin; k < end; ++k)
+		{
+			Random rng(seed, stream + k);
+			// R e^(-R/Rd) is a Gamma(2) distribution: the sum of two exponential deviates
+			double R;
+			do
+				R = -rd * std::log((1.0 - rng.NextDouble()) * (1.0 - rng.NextDouble()));
+			while (R > params.MaxRadius);
+			const double phi = rng.Uniform(0.0, TWO_PI);
+			// inverse of the sech^2 cumulative distribution (1 + tanh(z / h)) / 2
+			const double u = glm::clamp(rng.NextDouble(), 1e-12, 1.0 - 1e-12);
+			const double z = params.ScaleHeight * std::atanh(2.0 * u - 1.0);
+			const double enclosed = params.Mass * diskMassFraction(R / rd) / truncatedFraction + params.CentralMass;
+			const double soft = R * R + eps2;
+			const double circular = std::sqrt(gravity.G * enclosed * R * R / (soft * std::sqrt(soft)));
+			const double sigma = params.VelocityDispersion * circular;
+			const double cosPhi = std::cos(phi), sinPhi = std::sin(phi);
+			const glm::dvec3 position(R * cosPhi, R * sinPhi, z);
+			const glm::dvec3 orbit(-circular * sinPhi + sigma * rng.Normal(), circular * cosPhi + sigma * rng.Normal(), sigma * rng.Normal());
+			setBody(bodies, disk + k, center + orientation * position, velocity + orientation * orbit, mass, params.Radius, params.Color);
+		}
+	});
+	// remove the sampling noise in the disk's centre and momentum (sums in body order)
+	glm::dvec3 offset(0.0), drift(0.0);
+	for (size_t i = disk; i < disk + count; ++i)
+	{
+		offset += bodies.Position(i) - center;
+		drift += bodies.Velocity(i) - velocity;
+	}
+	offset /= (double)count;
+	drift /= (double)count;
+	for (size_t i = disk; i < disk + count; ++i)
+	{
+		bodies.X[i] -= offset.x; bodies.Y[i] -= offset.y; bodies.Z[i] -= offset.z;
+		bodies.VX[i] -= drift.x; bodies.VY[i] -= drift.y; bodies.VZ[i] -= drift.z;
+	}
+}
+
+void GenerateExponentialDisk(const ExponentialDiskParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first)
+{
+	const uint64_t stream = params.CentralMass > 0.0 ? 1 : 0;
+	generateDisk(params, gravity, seed, stream, glm::dvec3(0.0), glm::dvec3(0.0), glm::dmat3(1.0), bodies, first);
+}
+
+GalaxyMergerParams::GalaxyMergerParams()
+	:Separation(20.0), Pericentre(2.0), Inclination(0.5)
+{
+	this->Second.Color = glm::vec4(1.0f, 0.85f, 0.7f, 1.0f);
+}
+
+void GenerateGalaxyMerger(const GalaxyMergerParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first)
+{
+	const double m1 = params.First.Mass + params.First.CentralMass;
+	const double m2 = params.Second.Mass + params.Second.CentralMass;
+	const double total = m1 + m2;
+	// the second galaxy relative to the first on an incoming parabola in the xy plane
+	const double r = params.Separation, q = params.Pericentre;
+	const double anomaly = -std::acos(glm::clamp(2.0 * q / r - 1.0, -1.0, 1.0));
+	const double speed = std::sqrt(gravity.G * total / (2.0 * q));
+	const glm::dvec3 relative(r * std::cos(anomaly), r * std::sin(anomaly), 0.0);
+	const glm::dvec3 relativeVelocity(-speed * std::sin(anomaly), speed * (1.0 + std::cos(anomaly)), 0.0);
+	const glm::dmat3 tilt(glm::rotate(glm::dmat4(1.0), params.Inclination, glm::normalize(relative)));
+
+	const size_t firstCount = params.First.BodyCount();
+	const uint64_t firstStream = params.First.CentralMass > 0.0 ? 1 : 0;
+	const uint64_t secondStream = firstCount + (params.Second.CentralMass > 0.0 ? 1 : 0);
+	generateDisk(params.First, gravity, seed, firstStream, -m2 / total * relative, -m2 / total * relativeVelocity,
+		glm::dmat3(1.0), bodies, first);
+	generateDisk(params.Second, gravity, seed, secondStream, m1 / total * relative, m1 / total * relativeVelocity,
+		tilt, bodies, first + firstCount);
+}
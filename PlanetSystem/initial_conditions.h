@@ -0,0 +1,87 @@
+#pragma once
+#ifndef INITIAL_CONDITIONS_H
+#define INITIAL_CONDITIONS_H
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <body_store.h>
+#include <gravity.h>
+
+// Generators for common initial conditions. Each writes BodyCount() bodies of
+// a store starting at index `first` (use PlanetSystem::AddBodies to make
+// room) and fills the bodies in parallel. Body k of a setup draws from
+// Random(seed, k), so a seed gives the same bodies whatever the thread count
+// and wherever in the store they land.
+
+// A central star at the origin plus planets on Keplerian orbits around it.
+// Semi-major axes and masses are log-uniform, eccentricities and
+// inclinations uniform up to their maxima; the star gets the reflex velocity
+// that zeroes the total momentum.
+struct PlanetarySystemParams {
+	GLuint Planets;
+	double StarMass, StarRadius;
+	double InnerRadius, OuterRadius;
+	double MinPlanetMass, MaxPlanetMass, PlanetRadius;
+	double MaxEccentricity, MaxInclination;
+	glm::vec4 StarColor, PlanetColor;
+	PlanetarySystemParams();
+	size_t BodyCount() const { return 1 + (size_t)this->Planets; }
+};
+void GeneratePlanetarySystem(const PlanetarySystemParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first);
+
+// Thin belt of bodies orbiting CentralMass at the origin, with uniformly
+// distributed semi-major axes and Rayleigh distributed eccentricities and
+// inclinations (the shape of the main asteroid belt's distributions)
+struct AsteroidBeltParams {
+	GLuint Count;
+	double CentralMass;
+	double InnerRadius, OuterRadius;
+	double EccentricitySigma, InclinationSigma;
+	double Mass, Radius;
+	glm::vec4 Color;
+	AsteroidBeltParams();
+	size_t BodyCount() const { return this->Count; }
+};
+void GenerateAsteroidBelt(const AsteroidBeltParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first);
+
+// Plummer sphere in virial equilibrium (Aarseth, Henon & Wielen 1974),
+// truncated at 99.9% of the mass and re-centred on its centre of mass
+struct PlummerParams {
+	GLuint Count;
+	double Mass, ScaleRadius;
+	double Radius;
+	glm::vec4 Color;
+	PlummerParams();
+	size_t BodyCount() const { return this->Count; }
+};
+void GeneratePlummerSphere(const PlummerParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first);
+
+// Rotating exponential disk in the xy plane: surface density
+// exp(-R / ScaleLength), sech^2 vertical profile, truncated at MaxRadius.
+// Bodies move on circular orbits for the enclosed mass (plus the central
+// mass, a point body standing in for a bulge or halo, emitted first when
+// positive) with a Gaussian dispersion of VelocityDispersion times that speed.
+struct ExponentialDiskParams {
+	GLuint Count;
+	double Mass, ScaleLength, ScaleHeight, MaxRadius;
+	double CentralMass, CentralRadius;
+	double VelocityDispersion;
+	double Radius;
+	glm::vec4 Color;
+	ExponentialDiskParams();
+	size_t BodyCount() const { return this->Count + (this->CentralMass > 0.0 ? 1 : 0); }
+};
+void GenerateExponentialDisk(const ExponentialDiskParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first);
+
+// Two exponential disks approaching each other on a parabolic orbit with the
+// given pericentre distance, starting Separation apart; the second disk is
+// tilted by Inclination about the line joining them
+struct GalaxyMergerParams {
+	ExponentialDiskParams First, Second;
+	double Separation, Pericentre, Inclination;
+	GalaxyMergerParams();
+	size_t BodyCount() const { return this->First.BodyCount() + this->Second.BodyCount(); }
+};
+void GenerateGalaxyMerger(const GalaxyMergerParams &params, const GravityParams &gravity, uint64_t seed, BodyStore &bodies, size_t first);
+
+#endif
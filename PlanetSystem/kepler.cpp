@@ -0,0 +1,271 @@
+#include <kepler.h>
+#include <simd.h>
+#include <vector>
+#include <cmath>
+
+static const int MAX_ITERATIONS = 20;
+static const double TOLERANCE = 1e-13;
+static const double TWO_PI = 6.28318530717958647692;
+// |z| below which the Stumpff series are summed directly, and a bound on the
+// quarterings that reach it (only non-finite z would need more)
+static const double STUMPFF_SERIES_LIMIT = 0.1;
+static const int STUMPFF_MAX_QUARTERINGS = 40;
+// Series coefficients of c2 and c3, 1 / (k + 2)! and 1 / (k + 3)!
+static const int STUMPFF_TERMS = 7;
+static const double C2_SERIES[STUMPFF_TERMS] = { 1.0 / 2.0, 1.0 / 24.0, 1.0 / 720.0, 1.0 / 40320.0, 1.0 / 3628800.0, 1.0 / 479001600.0, 1.0 / 87178291200.0 };
+static const double C3_SERIES[STUMPFF_TERMS] = { 1.0 / 6.0, 1.0 / 120.0, 1.0 / 5040.0, 1.0 / 362880.0, 1.0 / 39916800.0, 1.0 / 6227020800.0, 1.0 / 1307674368000.0 };
+
+// Stumpff functions c2(z) = (1 - cos sqrt z) / z and c3(z) = (sqrt z - sin sqrt z) / sqrt(z)^3,
+// continued analytically for z < 0. z is quartered until the series converge
+// quickly, and the result doubled back with c2(4z) = (1 - z c3)^2 / 2 and
+// c3(4z) = (c2 + (1 - z c2) c3) / 4 (Danby). Only arithmetic is involved, so
+// the SSE2 kernel below evaluates the same formulas for two orbits at once.
+static inline void stumpff(double z, double &c2, double &c3)
+{
+	int quarterings = 0;
+	for (; std::fabs(z) > STUMPFF_SERIES_LIMIT && quarterings < STUMPFF_MAX_QUARTERINGS; ++quarterings)
+		z *= 0.25;
+	c2 = C2_SERIES[STUMPFF_TERMS - 1];
+	c3 = C3_SERIES[STUMPFF_TERMS - 1];
+	for (int k = STUMPFF_TERMS - 2; k >= 0; --k)
+	{
+		c2 = C2_SERIES[k] - z * c2;
+		c3 = C3_SERIES[k] - z * c3;
+	}
+	for (; quarterings > 0; --quarterings)
+	{
+		double a = 1.0 - z * c3;
+		c3 = 0.25 * (c2 + (1.0 - z * c2) * c3);
+		c2 = 0.5 * (a * a);
+		z *= 4.0;
+	}
+}
+
+// One Laguerre-Conway (n = 5) step on F(chi) = sigma0 chi^2 c2 + beta chi^3 c3 + r0 chi - sqrt(mu) t
+// for an orbit that has not converged yet; returns whether it has now. The
+// SSE2 kernel evaluates the same expressions in the same order.
+static inline bool laguerreStep(double &chi, double alpha, double r0, double sigma0, double sqrtMu, double tof)
+{
+	double c = chi, c2, c3;
+	double cc = c * c;
+	double psi = alpha * cc;
+	stumpff(psi, c2, c3);
+	double beta = 1.0 - alpha * r0;
+	double f = sigma0 * cc * c2 + beta * (cc * c) * c3 + r0 * c - sqrtMu * tof;
+	double df = sigma0 * c * (1.0 - psi * c3) + beta * cc * c2 + r0;
+	double ddf = sigma0 * (1.0 - psi * c2) + beta * c * (1.0 - psi * c3);
+	double root = std::sqrt(std::fabs(16.0 * df * df - 20.0 * f * ddf));
+	double step = 5.0 * f / (df + (df >= 0.0 ? root : -root));
+	chi = c - step;
+	return std::fabs(step) <= TOLERANCE * (1.0 + std::fabs(chi));
+}
+
+#ifdef PLANETSYSTEM_SSE2
+// mask ? a : b per lane
+static inline __m128d blend(__m128d mask, __m128d a, __m128d b)
+{
+	return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+// stumpff for two arguments: both lanes quarter as often as the larger one
+// needs, and each lane doubles back only the quarterings it took
+static inline void stumpff(__m128d z, __m128d &c2, __m128d &c3)
+{
+	const __m128d absMask = _mm_castsi128_pd(_mm_srli_epi64(_mm_set1_epi32(-1), 1));
+	const __m128d limit = _mm_set1_pd(STUMPFF_SERIES_LIMIT), quarter = _mm_set1_pd(0.25), one = _mm_set1_pd(1.0);
+	__m128d quarterings = _mm_setzero_pd();
+	int passes = 0;
+	for (; passes < STUMPFF_MAX_QUARTERINGS; ++passes)
+	{
+		__m128d large = _mm_cmpgt_pd(_mm_and_pd(z, absMask), limit);
+		if (_mm_movemask_pd(large) == 0)
+			break;
+		z = blend(large, _mm_mul_pd(z, quarter), z);
+		quarterings = _mm_add_pd(quarterings, _mm_and_pd(large, one));
+	}
+	c2 = _mm_set1_pd(C2_SERIES[STUMPFF_TERMS - 1]);
+	c3 = _mm_set1_pd(C3_SERIES[STUMPFF_TERMS - 1]);
+	for (int k = STUMPFF_TERMS - 2; k >= 0; --k)
+	{
+		c2 = _mm_sub_pd(_mm_set1_pd(C2_SERIES[k]), _mm_mul_pd(z, c2));
+		c3 = _mm_sub_pd(_mm_set1_pd(C3_SERIES[k]), _mm_mul_pd(z, c3));
+	}
+	for (; passes > 0; --passes)
+	{
+		__m128d active = _mm_cmpge_pd(quarterings, _mm_set1_pd((double)passes));
+		__m128d a = _mm_sub_pd(one, _mm_mul_pd(z, c3));
+		__m128d d3 = _mm_mul_pd(quarter, _mm_add_pd(c2, _mm_mul_pd(_mm_sub_pd(one, _mm_mul_pd(z, c2)), c3)));
+		__m128d d2 = _mm_mul_pd(_mm_set1_pd(0.5), _mm_mul_pd(a, a));
+		c3 = blend(active, d3, c3);
+		c2 = blend(active, d2, c2);
+		z = blend(active, _mm_mul_pd(z, _mm_set1_pd(4.0)), z);
+	}
+}
+#endif
+// Drift of every orbit by its own time dt[i * dtStride] (stride 0 shares one)
+static size_t driftBatch(const double *mu, double *x, double *y, double *z, double *vx, double *vy, double *vz,
+	size_t count, const double *dt, size_t dtStride);
+
+bool KeplerDrift(double mu, glm::dvec3 &r, glm::dvec3 &v, double dt)
+{
+	return driftBatch(&mu, &r.x, &r.y, &r.z, &v.x, &v.y, &v.z, 1, &dt, 0) == 0;
+}
+
+size_t KeplerDriftBatch(const double *mu, double *x, double *y, double *z, double *vx, double *vy, double *vz,
+	size_t count, double dt)
+{
+	return driftBatch(mu, x, y, z, vx, vy, vz, count, &dt, 0);
+}
+
+bool ElementsToState(double mu, const OrbitalElements &elements, glm::dvec3 &r, glm::dvec3 &v)
+{
+	return ElementsToStateBatch(&mu, &elements, &r.x, &r.y, &r.z, &v.x, &v.y, &v.z, 1) == 0;
+}
+
+size_t ElementsToStateBatch(const double *mu, const OrbitalElements *elements, double *x, double *y, double *z,
+	double *vx, double *vy, double *vz, size_t count)
+{
+	// invalid sets drift as a resting dummy orbit (mu = 1, r = 1) and are zeroed afterwards
+	std::vector<double> driftMu(count), dt(count);
+	std::vector<char> valid(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const OrbitalElements &el = elements[i];
+		const double a = el.SemiMajorAxis, e = el.Eccentricity;
+		// ellipses need a > 0, hyperbolae a < 0; parabolae have no finite a
+		valid[i] = mu[i] > 0.0 && e >= 0.0 && e != 1.0 && ((e < 1.0) == (a > 0.0));
+		if (!valid[i])
+		{
+			driftMu[i] = 1.0;
+			x[i] = 1.0;
+			y[i] = z[i] = vx[i] = vy[i] = vz[i] = dt[i] = 0.0;
+			continue;
+		}
+		driftMu[i] = mu[i];
+		// periapsis direction P and the in-plane normal to it Q
+		const double cosO = std::cos(el.AscendingNode), sinO = std::sin(el.AscendingNode);
+		const double cosw = std::cos(el.ArgumentOfPeriapsis), sinw = std::sin(el.ArgumentOfPeriapsis);
+		const double cosi = std::cos(el.Inclination), sini = std::sin(el.Inclination);
+		const glm::dvec3 P(cosw * cosO - sinw * cosi * sinO, cosw * sinO + sinw * cosi * cosO, sinw * sini);
+		const glm::dvec3 Q(-sinw * cosO - cosw * cosi * sinO, -sinw * sinO + cosw * cosi * cosO, cosw * sini);
+		const double q = a * (1.0 - e);
+		const double speed = std::sqrt(mu[i] * (1.0 + e) / q);
+		x[i] = q * P.x; y[i] = q * P.y; z[i] = q * P.z;
+		vx[i] = speed * Q.x; vy[i] = speed * Q.y; vz[i] = speed * Q.z;
+		// time since periapsis from the mean motion
+		const double absA = std::fabs(a);
+		dt[i] = el.MeanAnomaly / std::sqrt(mu[i] / (absA * absA * absA));
+	}
+	size_t failed = count > 0 ? driftBatch(&driftMu[0], x, y, z, vx, vy, vz, count, &dt[0], 1) : 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (valid[i])
+			continue;
+		x[i] = y[i] = z[i] = vx[i] = vy[i] = vz[i] = 0.0;
+		++failed;
+	}
+	return failed;
+}
+
+static size_t driftBatch(const double *mu, double *x, double *y, double *z, double *vx, double *vy, double *vz,
+	size_t count, const double *dt, size_t dtStride)
+{
+	if (count == 0)
+		return 0;
+	// per orbit invariants: r0, sigma0 = r0.v0 / sqrt(mu), alpha = 1 / a, and the
+	// time of flight (reduced by whole periods for bound orbits)
+	std::vector<double> r0(count), sigma0(count), alpha(count), sqrtMu(count), tof(count), chi(count);
+	std::vector<char> done(count, 0);
+	for (size_t i = 0; i < count; ++i)
+	{
+		sqrtMu[i] = std::sqrt(mu[i]);
+		r0[i] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+		sigma0[i] = (x[i] * vx[i] + y[i] * vy[i] + z[i] * vz[i]) / sqrtMu[i];
+		double v2 = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+		alpha[i] = 2.0 / r0[i] - v2 / mu[i];
+		tof[i] = dt[i * dtStride];
+		if (alpha[i] > 0.0)
+		{
+			double period = TWO_PI / (sqrtMu[i] * alpha[i] * std::sqrt(alpha[i]));
+			tof[i] = std::fmod(tof[i], period);
+		}
+		// ellipse: mean motion guess; otherwise the near-periapsis linear guess
+		chi[i] = alpha[i] > 0.0 ? sqrtMu[i] * tof[i] * alpha[i] : sqrtMu[i] * tof[i] / r0[i];
+	}
+	// Laguerre-Conway iterations, all orbits in lockstep; converged ones keep their chi
+	size_t remaining = count;
+	for (int iteration = 0; iteration < MAX_ITERATIONS && remaining > 0; ++iteration)
+	{
+		remaining = 0;
+		size_t i = 0;
+#ifdef PLANETSYSTEM_SSE2
+		// two orbits per instruction; a pair runs until both have converged
+		const __m128d absMask = _mm_castsi128_pd(_mm_srli_epi64(_mm_set1_epi32(-1), 1));
+		const __m128d one = _mm_set1_pd(1.0), zero = _mm_setzero_pd(), tolerance = _mm_set1_pd(TOLERANCE);
+		for (; i + 2 <= count; i += 2)
+		{
+			if (done[i] && done[i + 1])
+				continue;
+			const __m128d finished = _mm_cmpneq_pd(_mm_set_pd(done[i + 1], done[i]), zero);
+			const __m128d c = _mm_loadu_pd(&chi[i]), alpha_ = _mm_loadu_pd(&alpha[i]), r0_ = _mm_loadu_pd(&r0[i]);
+			const __m128d sigma0_ = _mm_loadu_pd(&sigma0[i]);
+			__m128d c2, c3;
+			__m128d cc = _mm_mul_pd(c, c);
+			__m128d psi = _mm_mul_pd(alpha_, cc);
+			stumpff(psi, c2, c3);
+			__m128d beta = _mm_sub_pd(one, _mm_mul_pd(alpha_, r0_));
+			__m128d f = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_mul_pd(sigma0_, cc), c2), _mm_mul_pd(_mm_mul_pd(beta, _mm_mul_pd(cc, c)), c3)),
+				_mm_mul_pd(r0_, c)), _mm_mul_pd(_mm_loadu_pd(&sqrtMu[i]), _mm_loadu_pd(&tof[i])));
+			__m128d df = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_mul_pd(sigma0_, c), _mm_sub_pd(one, _mm_mul_pd(psi, c3))), _mm_mul_pd(_mm_mul_pd(beta, cc), c2)), r0_);
+			__m128d ddf = _mm_add_pd(_mm_mul_pd(sigma0_, _mm_sub_pd(one, _mm_mul_pd(psi, c2))), _mm_mul_pd(_mm_mul_pd(beta, c), _mm_sub_pd(one, _mm_mul_pd(psi, c3))));
+			__m128d root = _mm_sqrt_pd(_mm_and_pd(absMask, _mm_sub_pd(_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(16.0), df), df), _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(20.0), f), ddf))));
+			root = blend(_mm_cmpge_pd(df, zero), root, _mm_sub_pd(zero, root));
+			__m128d step = _mm_div_pd(_mm_mul_pd(_mm_set1_pd(5.0), f), _mm_add_pd(df, root));
+			__m128d next = _mm_sub_pd(c, step);
+			__m128d converged = _mm_cmple_pd(_mm_and_pd(absMask, step), _mm_mul_pd(tolerance, _mm_add_pd(one, _mm_and_pd(absMask, next))));
+			_mm_storeu_pd(&chi[i], blend(finished, c, next));
+			int newlyDone = _mm_movemask_pd(_mm_andnot_pd(finished, converged));
+			for (int lane = 0; lane < 2; ++lane)
+			{
+				if (done[i + lane])
+					continue;
+				if (newlyDone & (1 << lane))
+					done[i + lane] = 1;
+				else
+					++remaining;
+			}
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			if (done[i])
+				continue;
+			if (laguerreStep(chi[i], alpha[i], r0[i], sigma0[i], sqrtMu[i], tof[i]))
+				done[i] = 1;
+			else
+				++remaining;
+		}
+	}
+	// Lagrange coefficients
+	size_t failed = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!done[i] || !(chi[i] == chi[i]))
+		{
+			++failed;
+			continue;
+		}
+		double c = chi[i], c2, c3;
+		stumpff(alpha[i] * c * c, c2, c3);
+		double f = 1.0 - c * c * c2 / r0[i];
+		double g = tof[i] - c * c * c * c3 / sqrtMu[i];
+		double nx = f * x[i] + g * vx[i], ny = f * y[i] + g * vy[i], nz = f * z[i] + g * vz[i];
+		double r = std::sqrt(nx * nx + ny * ny + nz * nz);
+		double df = sqrtMu[i] / (r * r0[i]) * c * (alpha[i] * c * c * c3 - 1.0);
+		double dg = 1.0 - c * c * c2 / r;
+		double nvx = df * x[i] + dg * vx[i], nvy = df * y[i] + dg * vy[i], nvz = df * z[i] + dg * vz[i];
+		x[i] = nx; y[i] = ny; z[i] = nz;
+		vx[i] = nvx; vy[i] = nvy; vz[i] = nvz;
+	}
+	return failed;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef KEPLER_H
+#define KEPLER_H
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Analytic two-body propagation in universal variables (valid for elliptic,
+// parabolic and hyperbolic orbits alike). Kepler's equation is solved for the
+// universal anomaly with Laguerre-Conway iterations, which converge from a
+// crude starting guess for any eccentricity; the state is then advanced with
+// the Lagrange f and g functions.
+
+// Advances the relative state (r, v) of a body around a primary by dt, where
+// mu = G * (m_primary + m_body). Returns false and leaves the state unchanged
+// if the solver did not converge.
+bool KeplerDrift(double mu, glm::dvec3 &r, glm::dvec3 &v, double dt);
+
+// Batched form over structure-of-arrays relative states. All orbits iterate
+// in lockstep; with SSE2 the solver advances two orbits per instruction (the
+// Stumpff functions are evaluated with arithmetic only), with the same results
+// as the scalar fallback. Returns the number of orbits that did not converge;
+// their states are left unchanged.
+size_t KeplerDriftBatch(const double *mu, double *x, double *y, double *z, double *vx, double *vy, double *vz,
+	size_t count, double dt);
+
+// Classical orbital elements, angles in radians. Hyperbolic orbits (e > 1)
+// take a negative semi-major axis; the mean anomaly is then the hyperbolic one.
+struct OrbitalElements {
+	double SemiMajorAxis, Eccentricity, Inclination, AscendingNode, ArgumentOfPeriapsis, MeanAnomaly;
+};
+
+// Position and velocity relative to the primary for mu = G * (m_primary + m_body).
+// The orbit is started at periapsis and drifted by the time since periapsis,
+// so this shares the universal-variable solver. Returns false for invalid elements.
+bool ElementsToState(double mu, const OrbitalElements &elements, glm::dvec3 &r, glm::dvec3 &v);
+
+// Batched form writing SoA states; returns the number of element sets that
+// were invalid or did not converge (their states are zero).
+size_t ElementsToStateBatch(const double *mu, const OrbitalElements *elements, double *x, double *y, double *z,
+	double *vx, double *vy, double *vz, size_t count);
+
+#endif
@@ -10,11 +10,22 @@
 #include <planet_system.h>
 #include <text_renderer.h>
 #include <texture.h>
+#include <render_view.h>
+#include <checkpoint.h>
+#include <trajectory.h>
+#include <trajectory_playback.h>
+#include <diagnostics.h>
+#include <post_processor.h>
+#include <dynamic_resolution.h>
+#include <ibl.h>
 #include <learnopengl\camera.h>
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
 
 // GLFW function declerations
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
@@ -26,14 +37,52 @@ void processInput(GLFWwindow *window, float dt);
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+// floating origin: double precision world position of the camera. camera.Position is
+// folded into it every frame, so the float camera and view matrix stay near zero and
+// everything is rendered relative to the camera.
+glm::dvec3 worldOrigin(0.0);
 float lastX = 800.0f / 2.0;
 float lastY = 600.0 / 2.0;
 bool firstMouse = true;
 bool LeftMouseButton = false;
+// draw every body as a ray traced impostor (toggled with I)
+bool impostorsOnly = false;
+// save / restore the simulation to CHECKPOINT_PATH (F5 / F9), handled once per frame
+bool saveRequested = false;
+bool loadRequested = false;
+const char *CHECKPOINT_PATH = "checkpoint.psck";
+// record the bodies to TRAJECTORY_PATH every TRAJECTORY_INTERVAL updates (toggled with R)
+bool recording = false;
+const char *TRAJECTORY_PATH = "trajectory.pstr";
+const unsigned int TRAJECTORY_INTERVAL = 4;
+// conservation diagnostics every DIAGNOSTICS_INTERVAL updates, shown on the HUD and appended to DIAGNOSTICS_PATH
+const char *DIAGNOSTICS_PATH = "diagnostics.csv";
+const unsigned int DIAGNOSTICS_INTERVAL = 16;
+// anti-alias the scene by accumulating jittered frames (toggled with F3) instead of
+// shading MSAA_SAMPLES samples per pixel
+bool temporalAntiAliasing = true;
+const unsigned int MSAA_SAMPLES = 4;
+// render the scene at a lower resolution while the GPU frame time exceeds FRAME_BUDGET_MS (toggled with F2)
+bool dynamicResolution = true;
+const double FRAME_BUDGET_MS = 1000.0 / 60.0;
+// ambient light of the planets from IBL_ENVIRONMENT; its convolutions are computed on the
+// first run and loaded from IBL_CACHE_PATH afterwards. The maps are bound from IBL_TEXTURE_UNIT on.
+const char *IBL_ENVIRONMENT = "resources/textures/hdr/newport_loft.hdr";
+const char *IBL_CACHE_PATH = "newport_loft.psib";
+const GLuint IBL_TEXTURE_UNIT = 3;
+// replay TRAJECTORY_PATH instead of simulating (toggled with P): Up / Down change the
+// speed tenfold, B reverses it and Left / Right scrub through the recording
+bool playing = false;
+double playbackSpeed = 1.0;
+double scrubDirection = 0.0;
 
 // settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
+// current framebuffer size; framebuffer_size_callback records it and the
+// render targets follow once per frame
+int framebufferWidth = SCR_WIDTH, framebufferHeight = SCR_HEIGHT;
+bool framebufferResized = false;
 
 // timing
 float deltaTime = 0.0f;
@@ -46,7 +95,10 @@ int main()
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_SAMPLES, 4);
+	// antialiasing and depth testing happen in the HDR scene target of the PostProcessor;
+	// the window only receives the tonemapped image and the HUD
+	glfwWindowHint(GLFW_SAMPLES, 0);
+	glfwWindowHint(GLFW_DEPTH_BITS, 0);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
@@ -84,10 +136,25 @@ int main()
 
 	// OpenGL configuration
 	glEnable(GL_DEPTH_TEST);
-
-	ResourceManager::LoadShader("shaders/particle.vs", "shaders/particle.frag", nullptr, "particle");
-	ResourceManager::LoadShader("shaders/planet.vert", "shaders/planet.frag", nullptr, "planet");
-	ResourceManager::LoadShader("shaders/skybox.vs", "shaders/skybox.frag", nullptr, "skybox");
+	// filter across cube map face edges, which the blurry prefiltered mips would otherwise show
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	// resolve resource handles once; per-frame code only touches the handles
+	ShaderHandle particleShader = ResourceManager::LoadShader("shaders/particle.vs", "shaders/particle.frag", nullptr, "particle");
+	ShaderHandle planetShader = ResourceManager::LoadShader("shaders/planet.vert", "shaders/planet.frag", nullptr, "planet");
+	ShaderHandle skyboxShader = ResourceManager::LoadShader("shaders/skybox.vs", "shaders/skybox.frag", nullptr, "skybox");
+	ShaderHandle impostorShader = ResourceManager::LoadShader("shaders/impostor.vs", "shaders/impostor.frag", nullptr, "impostor");
+	ShaderHandle planetImpostorShader = ResourceManager::LoadShader("shaders/impostor.vs", "shaders/planet.frag", nullptr, "planet_impostor", "#define IMPOSTOR\n");
+	ShaderHandle postProcessingShader = ResourceManager::LoadShader("shaders/post_processing.vs", "shaders/post_processing.frag", nullptr, "post_processing");
+	ShaderHandle bloomDownsampleShader = ResourceManager::LoadShader("shaders/post_processing.vs", "shaders/bloom_downsample.frag", nullptr, "bloom_downsample");
+	ShaderHandle bloomUpsampleShader = ResourceManager::LoadShader("shaders/post_processing.vs", "shaders/bloom_upsample.frag", nullptr, "bloom_upsample");
+	ShaderHandle temporalShader = ResourceManager::LoadShader("shaders/post_processing.vs", "shaders/taa.frag", nullptr, "taa");
+	ShaderHandle equirectangularShader = ResourceManager::LoadShader("shaders/cubemap.vs", "shaders/equirectangular_to_cubemap.frag", nullptr, "equirectangular_to_cubemap");
+	ShaderHandle irradianceShader = ResourceManager::LoadShader("shaders/cubemap.vs", "shaders/irradiance_convolution.frag", nullptr, "irradiance_convolution");
+	ShaderHandle prefilterShader = ResourceManager::LoadShader("shaders/cubemap.vs", "shaders/prefilter.frag", nullptr, "prefilter");
+	ShaderHandle brdfShader = ResourceManager::LoadShader("shaders/post_processing.vs", "shaders/brdf.frag", nullptr, "brdf");
+	// both planet paths (meshes and ray traced impostors) share the Cook-Torrance uniforms
+	ShaderHandle litShaders[] = { planetShader, planetImpostorShader };
 	ResourceManager::LoadTexture("resources/textures/container.jpg", false, "texture1");
 	ResourceManager::LoadTexture("resources/textures/awesomeface.png", false, "texture2");
 	std::vector<std::string> faces1
@@ -117,11 +184,28 @@ int main()
 		"resources/textures/sor_cwd/cwd_ft.JPG",
 		"resources/textures/sor_cwd/cwd_bk.JPG"
 	};
-	ResourceManager::LoadTexture3D(faces1, false, "skybox");
-	ParticleGenerator *particleGenerator = new ParticleGenerator(ResourceManager::GetShader("particle"), Texture2D(), 1000);
-	PlanetSystem *planetSystem = new PlanetSystem(ResourceManager::GetShader("planet"));
-	TextRenderer *text = new TextRenderer(SCR_WIDTH, SCR_HEIGHT);
+	Texture3DHandle skyboxTexture = ResourceManager::LoadTexture3D(faces1, false, "skybox");
+	ParticleGenerator *particleGenerator = new ParticleGenerator(ResourceManager::GetShader(particleShader), ResourceManager::GetShader(impostorShader), Texture2D(), 1000);
+	PlanetSystem *planetSystem = new PlanetSystem(ResourceManager::GetShader(planetShader), ResourceManager::GetShader(planetImpostorShader));
+	CheckpointWriter checkpointWriter;
+	TrajectoryWriter trajectoryWriter;
+	TrajectoryPlayback trajectoryPlayback;
+	DiagnosticsLog diagnostics;
+	planetSystem->SetDebrisGenerator(particleGenerator);
+	diagnostics.OpenCsv(DIAGNOSTICS_PATH);
+	planetSystem->SetDiagnostics(&diagnostics, DIAGNOSTICS_INTERVAL);
+	// everything is sized in framebuffer pixels (more than the window's size on retina displays)
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	TextRenderer *text = new TextRenderer(framebufferWidth, framebufferHeight);
+	// the scene renders in linear HDR, at up to the framebuffer's resolution
+	PostProcessor *postProcessor = new PostProcessor(ResourceManager::GetShader(postProcessingShader), ResourceManager::GetShader(bloomDownsampleShader),
+		ResourceManager::GetShader(bloomUpsampleShader), ResourceManager::GetShader(temporalShader), framebufferWidth, framebufferHeight, MSAA_SAMPLES);
 	text->Load("OCRAEXT.TTF", 24);
+	GpuTimer *gpuTimer = new GpuTimer();
+	ImageBasedLighting *ibl = new ImageBasedLighting(ResourceManager::GetShader(equirectangularShader), ResourceManager::GetShader(irradianceShader),
+		ResourceManager::GetShader(prefilterShader), ResourceManager::GetShader(brdfShader));
+	ibl->Load(IBL_ENVIRONMENT, IBL_CACHE_PATH);
+	DynamicResolution resolution(FRAME_BUDGET_MS);
 
 	// set up vertex data (and buffer(s)) and configure vertex attributes
 	// ------------------------------------------------------------------
@@ -180,9 +264,15 @@ int main()
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-	ResourceManager::GetShader("skybox").Use().SetInteger("skybox", 0);
-	ResourceManager::GetShader("planet").Use().SetVector3f("albedo", glm::vec3(0.5f, 0.5f, 0.5f));
-	ResourceManager::GetShader("planet").SetFloat("ao", 1.0f);
+	ResourceManager::GetShader(skyboxShader).Use().SetInteger("skybox", 0);
+	for (ShaderHandle lit : litShaders)
+	{
+		ResourceManager::GetShader(lit).Use().SetVector3f("albedo", glm::vec3(0.5f, 0.5f, 0.5f));
+		ResourceManager::GetShader(lit).SetFloat("ao", 1.0f);
+		ResourceManager::GetShader(lit).SetInteger("irradianceMap", IBL_TEXTURE_UNIT);
+		ResourceManager::GetShader(lit).SetInteger("prefilterMap", IBL_TEXTURE_UNIT + 1);
+		ResourceManager::GetShader(lit).SetInteger("brdfLUT", IBL_TEXTURE_UNIT + 2);
+	}
 	// DeltaTime variables
 	GLfloat deltaTime = 0.0f;
 	GLfloat lastFrame = 0.0f;
@@ -198,6 +288,10 @@ int main()
 
 
 	glm::vec3 centerPos = glm::vec3(0.0f, 0.0f, 0.0f);
+	// last frame's unjittered view-projection and origin, for motion vectors
+	glm::mat4 previousViewProjection;
+	glm::dvec3 previousOrigin = worldOrigin;
+	bool hasPreviousFrame = false;
 	// render loop
 	// -----------
 	while (!glfwWindowShouldClose(window))
@@ -211,65 +305,183 @@ int main()
 		
 		// input
 		processInput(window, deltaTime);
+		worldOrigin += glm::dvec3(camera.Position);
+		camera.Position = glm::vec3(0.0f);
+		planetSystem->SetImpostorsOnly(impostorsOnly);
+		particleGenerator->SetImpostorsOnly(impostorsOnly);
+		if (playing != trajectoryPlayback.IsOpen())
+		{
+			if (playing)
+			{
+				// the recording is only complete (indexed) once closed
+				if (trajectoryWriter.IsOpen())
+				{
+					planetSystem->SetTrajectoryWriter(nullptr);
+					trajectoryWriter.Close();
+					recording = false;
+				}
+				playing = trajectoryPlayback.Open(TRAJECTORY_PATH);
+				if (playing)
+					planetSystem->SetPlayback(&trajectoryPlayback);
+			}
+			else
+			{
+				planetSystem->SetPlayback(nullptr);
+				trajectoryPlayback.Close();
+			}
+		}
+		if (playing)
+		{
+			trajectoryPlayback.SetSpeed(playbackSpeed);
+			trajectoryPlayback.Seek(trajectoryPlayback.Time() + scrubDirection * 0.25 * (trajectoryPlayback.EndTime() - trajectoryPlayback.StartTime()) * deltaTime);
+		}
+		if (recording != trajectoryWriter.IsOpen())
+		{
+			if (recording && trajectoryWriter.Open(TRAJECTORY_PATH))
+				planetSystem->SetTrajectoryWriter(&trajectoryWriter, TRAJECTORY_INTERVAL);
+			else
+			{
+				planetSystem->SetTrajectoryWriter(nullptr);
+				trajectoryWriter.Close();
+				recording = false;
+			}
+		}
+		if (saveRequested)
+		{
+			checkpointWriter.Begin();
+			planetSystem->SaveCheckpoint(checkpointWriter);
+			particleGenerator->SaveCheckpoint(checkpointWriter);
+			checkpointWriter.WriteAsync(CHECKPOINT_PATH);
+			saveRequested = false;
+		}
+		if (loadRequested)
+		{
+			CheckpointReader checkpointReader;
+			if (checkpointReader.Open(CHECKPOINT_PATH) && planetSystem->LoadCheckpoint(checkpointReader))
+				particleGenerator->LoadCheckpoint(checkpointReader);
+			loadRequested = false;
+		}
+
+		if (framebufferResized)
+		{
+			postProcessor->Resize(framebufferWidth, framebufferHeight);
+			if (framebufferWidth > 0 && framebufferHeight > 0)
+				text->Resize(framebufferWidth, framebufferHeight);
+			framebufferResized = false;
+		}
+		// follow the GPU time of frames a few behind, without waiting for the current one
+		double gpuMilliseconds;
+		while (gpuTimer->Poll(gpuMilliseconds))
+			resolution.Update(gpuMilliseconds);
+		postProcessor->SetRenderScale(dynamicResolution ? resolution.Scale() : 1.0f);
+		postProcessor->SetAntiAliasing(temporalAntiAliasing ? ANTIALIASING_TAA : ANTIALIASING_MSAA);
 
 		// Render
+		gpuTimer->Begin();
 		glClearColor(0.3f, 0.5f, 0.5f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		postProcessor->BeginRender();
 
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+		glm::mat4 unjitteredProjection = glm::perspective(glm::radians(camera.Zoom), (float)postProcessor->Width / (float)postProcessor->Height, 0.1f, 100.0f);
+		glm::mat4 projection = postProcessor->Jitter(unjitteredProjection);
 		glm::mat4 view = camera.GetViewMatrix();
 		glm::mat4 model;
-
-		ResourceManager::GetShader("planet").Use();
-		// pass projection matrix to shader (note that in this case it could change every frame)
-		ResourceManager::GetShader("planet").SetMatrix4("projection", projection);
-		// camera/view transformation
-		ResourceManager::GetShader("planet").SetMatrix4("view", view);
-		ResourceManager::GetShader("planet").SetVector3f("camPos", camera.Position);
-		ResourceManager::GetShader("planet").SetFloat("metallic", 0.5f);
-		ResourceManager::GetShader("planet").SetFloat("roughness", 0.5f);
-		
-		for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i)
+		// pixel sizes for culling and impostors are those of the scene target, not of the window
+		RenderView renderView(view, projection, (float)postProcessor->RenderHeight, worldOrigin);
+		// motion vectors: last frame's transform, moved to this frame's origin
+		renderView.ViewProjection = unjitteredProjection * view;
+		renderView.PreviousViewProjection = hasPreviousFrame ? previousViewProjection * glm::translate(glm::mat4(), glm::vec3(worldOrigin - previousOrigin)) : renderView.ViewProjection;
+		previousViewProjection = renderView.ViewProjection;
+		previousOrigin = worldOrigin;
+		hasPreviousFrame = true;
+
+		for (ShaderHandle lit : litShaders)
 		{
-			glm::vec3 newPos = lightPositions[i] + glm::vec3(sin(glfwGetTime() * 5.0) * 5.0, 0.0, 0.0);
-			newPos = lightPositions[i];
-			ResourceManager::GetShader("planet").SetVector3f(std::string("lightPositions[" + std::to_string(i) + "]").c_str(), newPos);
-			ResourceManager::GetShader("planet").SetVector3f(std::string("lightColors[" + std::to_string(i) + "]").c_str(), lightColors[i]);
+			ResourceManager::GetShader(lit).Use();
+			// pass projection matrix to shader (note that in this case it could change every frame)
+			ResourceManager::GetShader(lit).SetMatrix4("projection", projection);
+			// camera/view transformation
+			ResourceManager::GetShader(lit).SetMatrix4("view", view);
+			ResourceManager::GetShader(lit).SetVector3f("camPos", camera.Position);
+			ResourceManager::GetShader(lit).SetFloat("metallic", 0.5f);
+			ResourceManager::GetShader(lit).SetFloat("roughness", 0.5f);
+
+			for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i)
+			{
+				glm::vec3 newPos = lightPositions[i] + glm::vec3(sin(glfwGetTime() * 5.0) * 5.0, 0.0, 0.0);
+				newPos = glm::vec3(glm::dvec3(lightPositions[i]) - worldOrigin);
+				ResourceManager::GetShader(lit).SetVector3f(std::string("lightPositions[" + std::to_string(i) + "]").c_str(), newPos);
+				ResourceManager::GetShader(lit).SetVector3f(std::string("lightColors[" + std::to_string(i) + "]").c_str(), lightColors[i]);
+			}
 		}
 
-		ResourceManager::GetShader("particle").Use().SetMatrix4("projection",projection);
-		ResourceManager::GetShader("particle").SetMatrix4("view", view);
+		ResourceManager::GetShader(particleShader).Use().SetMatrix4("projection",projection);
+		ResourceManager::GetShader(particleShader).SetMatrix4("view", view);
 		particleGenerator->Update(deltaTime, 2, centerPos);
-		particleGenerator->Draw();
+		particleGenerator->Draw(renderView);
 
 		planetSystem->Update(deltaTime);
-		planetSystem->Draw();
+		ibl->Bind(IBL_TEXTURE_UNIT);
+		planetSystem->Draw(renderView);
 
 
 
 		// draw skybox as last
 		glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-		ResourceManager::GetShader("skybox").Use();
+		ResourceManager::GetShader(skyboxShader).Use();
 		view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-		ResourceManager::GetShader("skybox").SetMatrix4("view", view);
-		ResourceManager::GetShader("skybox").SetMatrix4("projection", projection);
+		ResourceManager::GetShader(skyboxShader).SetMatrix4("view", view);
+		ResourceManager::GetShader(skyboxShader).SetMatrix4("projection", projection);
+		ResourceManager::GetShader(skyboxShader).SetMatrix4("currentViewProjection", renderView.ViewProjection);
+		ResourceManager::GetShader(skyboxShader).SetMatrix4("previousViewProjection", renderView.PreviousViewProjection);
 		// skybox cube
 		glBindVertexArray(skyboxVAO);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, ResourceManager::GetTexture3D("skybox").ID);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, ResourceManager::GetTexture3D(skyboxTexture).ID);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 		glBindVertexArray(0);
 		glDepthFunc(GL_LESS); // set depth function back to default
 
+		// resolve the scene and tonemap it onto the window; the HUD draws over it in display colors
+		postProcessor->EndRender();
+		postProcessor->Render();
+		gpuTimer->End();
+
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		text->RenderText("FPS:"+std::to_string(fps), 5.0f, 5.0f, 2.0f);
+		const CullStats &planetCull = planetSystem->GetCullStats();
+		const CullStats &particleCull = particleGenerator->GetCullStats();
+		text->RenderText("Planets visible/culled: " + std::to_string(planetCull.Visible) + "/" + std::to_string(planetCull.Culled), 5.0f, 60.0f, 1.0f);
+		text->RenderText("Particles visible/culled: " + std::to_string(particleCull.Visible) + "/" + std::to_string(particleCull.Culled), 5.0f, 90.0f, 1.0f);
+		if (playing)
+			text->RenderText("Playback t=" + std::to_string(trajectoryPlayback.Time()) + "/" + std::to_string(trajectoryPlayback.EndTime()) + " speed x" + std::to_string(playbackSpeed), 5.0f, 120.0f, 1.0f);
+		if (diagnostics.Size() > 0)
+		{
+			const Diagnostics &latest = diagnostics.Latest();
+			std::ostringstream line;
+			line << std::scientific << std::setprecision(2) << "dE/E: " << latest.EnergyError << " (max " << diagnostics.MaxEnergyError()
+				<< ")  |P|: " << glm::length(latest.Momentum) << "  |L|: " << glm::length(latest.AngularMomentum);
+			text->RenderText(line.str(), 5.0f, 150.0f, 1.0f);
+		}
+		std::ostringstream gpuLine;
+		gpuLine << std::fixed << std::setprecision(2) << "GPU: " << resolution.Average() << " ms  scene: " << postProcessor->RenderWidth << "x" << postProcessor->RenderHeight
+			<< (dynamicResolution ? " (dynamic)" : "") << "  AA: " << (temporalAntiAliasing ? "TAA" : "MSAA");
+		text->RenderText(gpuLine.str(), 5.0f, 180.0f, 1.0f);
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 
 	}
+	checkpointWriter.Wait();
+	planetSystem->SetTrajectoryWriter(nullptr);
+	trajectoryWriter.Close();
+	planetSystem->SetPlayback(nullptr);
+	trajectoryPlayback.Close();
+	planetSystem->SetDiagnostics(nullptr);
+	delete gpuTimer;
+	delete ibl;
+	delete postProcessor;
 	ResourceManager::Clear();
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
@@ -295,6 +507,61 @@ void processInput(GLFWwindow *window, float dt)
 		camera.ProcessKeyboard(LEFT, dt);
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 		camera.ProcessKeyboard(RIGHT, dt);
+
+	static bool impostorKeyDown = false;
+	bool impostorKey = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+	if (impostorKey && !impostorKeyDown)
+		impostorsOnly = !impostorsOnly;
+	impostorKeyDown = impostorKey;
+
+	static bool saveKeyDown = false, loadKeyDown = false;
+	bool saveKey = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+	bool loadKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+	saveRequested = saveRequested || (saveKey && !saveKeyDown);
+	loadRequested = loadRequested || (loadKey && !loadKeyDown);
+	saveKeyDown = saveKey;
+	loadKeyDown = loadKey;
+
+	static bool recordKeyDown = false;
+	bool recordKey = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+	if (recordKey && !recordKeyDown)
+		recording = !recording;
+	recordKeyDown = recordKey;
+
+	static bool resolutionKeyDown = false;
+	bool resolutionKey = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+	if (resolutionKey && !resolutionKeyDown)
+		dynamicResolution = !dynamicResolution;
+	resolutionKeyDown = resolutionKey;
+
+	static bool antiAliasingKeyDown = false;
+	bool antiAliasingKey = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+	if (antiAliasingKey && !antiAliasingKeyDown)
+		temporalAntiAliasing = !temporalAntiAliasing;
+	antiAliasingKeyDown = antiAliasingKey;
+
+	static bool playKeyDown = false, fasterKeyDown = false, slowerKeyDown = false, reverseKeyDown = false;
+	bool playKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+	bool fasterKey = glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS;
+	bool slowerKey = glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS;
+	bool reverseKey = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+	if (playKey && !playKeyDown)
+		playing = !playing;
+	if (fasterKey && !fasterKeyDown && std::fabs(playbackSpeed) < 1e6)
+		playbackSpeed *= 10.0;
+	if (slowerKey && !slowerKeyDown && std::fabs(playbackSpeed) > 1e-3)
+		playbackSpeed /= 10.0;
+	if (reverseKey && !reverseKeyDown)
+		playbackSpeed = -playbackSpeed;
+	playKeyDown = playKey;
+	fasterKeyDown = fasterKey;
+	slowerKeyDown = slowerKey;
+	reverseKeyDown = reverseKey;
+	scrubDirection = 0.0;
+	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+		scrubDirection += 1.0;
+	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+		scrubDirection -= 1.0;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -304,6 +571,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	// make sure the viewport matches the new window dimensions; note that width and 
 	// height will be significantly larger than specified on retina displays.
 	glViewport(0, 0, width, height);
+	// the render targets are reallocated at the start of the next frame, once
+	// however many events a drag produced
+	framebufferWidth = width;
+	framebufferHeight = height;
+	framebufferResized = true;
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
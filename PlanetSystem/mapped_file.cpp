@@ -0,0 +1,102 @@
+#include <mapped_file.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+	:data(nullptr), size(0),
+#ifdef _WIN32
+	file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#else
+	file(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	this->Close();
+}
+
+bool MappedFile::Open(const std::string &path)
+{
+	this->Close();
+#ifdef _WIN32
+	this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER fileSize;
+	if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		this->Close();
+		return false;
+	}
+	this->size = (size_t)fileSize.QuadPart;
+	this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (this->mapping != nullptr)
+		this->data = static_cast<const char *>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	this->file = open(path.c_str(), O_RDONLY);
+	struct stat status;
+	if (this->file < 0 || fstat(this->file, &status) != 0 || status.st_size == 0)
+	{
+		this->Close();
+		return false;
+	}
+	this->size = (size_t)status.st_size;
+	void *mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->file, 0);
+	this->data = mapped == MAP_FAILED ? nullptr : static_cast<const char *>(mapped);
+#endif
+	if (this->data == nullptr)
+	{
+		this->Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (this->data != nullptr)
+		UnmapViewOfFile(this->data);
+	if (this->mapping != nullptr)
+		CloseHandle(this->mapping);
+	if (this->file != INVALID_HANDLE_VALUE)
+		CloseHandle(this->file);
+	this->file = INVALID_HANDLE_VALUE;
+	this->mapping = nullptr;
+#else
+	if (this->data != nullptr)
+		munmap(const_cast<char *>(this->data), this->size);
+	if (this->file >= 0)
+		close(this->file);
+	this->file = -1;
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t bytes) const
+{
+	if (this->data == nullptr || offset >= this->size)
+		return;
+	if (bytes > this->size - offset)
+		bytes = this->size - offset;
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<char *>(this->data + offset);
+	range.NumberOfBytes = bytes;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise wants page aligned addresses
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t begin = offset & ~(page - 1);
+	madvise(const_cast<char *>(this->data + begin), bytes + (offset - begin), MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. The contents are paged in on
+// first access, so opening a large file costs nothing up front.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	// Maps the file; fails for missing or empty files
+	bool Open(const std::string &path);
+	void Close();
+	bool IsOpen() const { return this->data != nullptr; }
+	const char *Data() const { return this->data; }
+	size_t Size() const { return this->size; }
+	// Asks the OS to start reading [offset, offset + bytes) in the background
+	void Prefetch(size_t offset, size_t bytes) const;
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+	const char *data;
+	size_t size;
+#ifdef _WIN32
+	void *file, *mapping;
+#else
+	int file;
+#endif
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <morton.h>
+#include <parallel.h>
+#include <algorithm>
+
+static const unsigned int MORTON_BITS = 21;
+static const unsigned int RADIX_BITS = 8;
+static const unsigned int RADIX_BUCKETS = 1 << RADIX_BITS;
+// below this many bodies per chunk threading costs more than it saves
+static const size_t SORT_GRAIN = 16384;
+
+// Spreads the low 21 bits of v so that two zero bits separate each of them
+static unsigned long long spreadBits(unsigned long long v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+unsigned long long MortonKey(unsigned int x, unsigned int y, unsigned int z)
+{
+	return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+}
+
+void MortonSorter::Sort(const BodyStore &bodies, std::vector<unsigned int> &order)
+{
+	const size_t n = bodies.Size();
+	order.resize(n);
+	if (n == 0)
+		return;
+	// quantize positions in the bounding cube to 21 bits per axis
+	double minX = bodies.X[0], minY = bodies.Y[0], minZ = bodies.Z[0];
+	double maxX = minX, maxY = minY, maxZ = minZ;
+	for (size_t i = 1; i < n; ++i)
+	{
+		minX = std::min(minX, bodies.X[i]); maxX = std::max(maxX, bodies.X[i]);
+		minY = std::min(minY, bodies.Y[i]); maxY = std::max(maxY, bodies.Y[i]);
+		minZ = std::min(minZ, bodies.Z[i]); maxZ = std::max(maxZ, bodies.Z[i]);
+	}
+	double extent = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
+	const double scale = extent > 0.0 ? ((1 << MORTON_BITS) - 1) / extent : 0.0;
+
+	const unsigned int chunks = ParallelChunkCount(n, SORT_GRAIN);
+	this->keys.resize(n);
+	this->keysScratch.resize(n);
+	this->orderScratch.resize(n);
+	this->histograms.resize(chunks * RADIX_BUCKETS);
+	unsigned long long *keys = &this->keys[0], *keysOut = &this->keysScratch[0];
+	unsigned int *values = &order[0], *valuesOut = &this->orderScratch[0];
+	ParallelFor(n, chunks, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			keys[i] = MortonKey((unsigned int)((bodies.X[i] - minX) * scale),
+				(unsigned int)((bodies.Y[i] - minY) * scale),
+				(unsigned int)((bodies.Z[i] - minZ) * scale));
+			values[i] = (unsigned int)i;
+		}
+	});
+
+	size_t *histograms = &this->histograms[0];
+	for (unsigned int shift = 0; shift < 3 * MORTON_BITS; shift += RADIX_BITS)
+	{
+		// per chunk digit counts
+		ParallelFor(n, chunks, [&](unsigned int chunk, size_t begin, size_t end)
+		{
+			size_t *counts = histograms + chunk * RADIX_BUCKETS;
+			std::fill(counts, counts + RADIX_BUCKETS, (size_t)0);
+			for (size_t i = begin; i < end; ++i)
+				counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+		});
+		// exclusive prefix sum in (digit, chunk) order keeps the sort stable;
+		// a digit shared by every key leaves the order unchanged
+		size_t offset = 0;
+		bool trivial = false;
+		for (unsigned int d = 0; d < RADIX_BUCKETS && !trivial; ++d)
+		{
+			size_t digitTotal = 0;
+			for (unsigned int c = 0; c < chunks; ++c)
+			{
+				size_t count = histograms[c * RADIX_BUCKETS + d];
+				histograms[c * RADIX_BUCKETS + d] = offset;
+				offset += count;
+				digitTotal += count;
+			}
+			trivial = digitTotal == n;
+		}
+		if (trivial)
+			continue;
+		ParallelFor(n, chunks, [&](unsigned int chunk, size_t begin, size_t end)
+		{
+			size_t *next = histograms + chunk * RADIX_BUCKETS;
+			for (size_t i = begin; i < end; ++i)
+			{
+				size_t slot = next[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				keysOut[slot] = keys[i];
+				valuesOut[slot] = values[i];
+			}
+		});
+		std::swap(keys, keysOut);
+		std::swap(values, valuesOut);
+	}
+	if (values != &order[0])
+		std::copy(values, values + n, order.begin());
+}
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef MORTON_H
+#define MORTON_H
+#include <vector>
+#include <body_store.h>
+
+// Interleaves the low 21 bits of x, y and z into a 63-bit Z-order key
+unsigned long long MortonKey(unsigned int x, unsigned int y, unsigned int z);
+
+// Computes the permutation that orders bodies along a Z-order curve through
+// their bounding cube, so bodies that are close in space end up close in
+// memory. Keys are sorted with a parallel LSD radix sort (8 bits per pass,
+// passes where every key has the same digit are skipped); the sorter keeps
+// its buffers between calls.
+class MortonSorter
+{
+public:
+	// Fills order so that order[k] is the index of the k-th body in Morton order
+	void Sort(const BodyStore &bodies, std::vector<unsigned int> &order);
+private:
+	std::vector<unsigned long long> keys, keysScratch;
+	std::vector<unsigned int> orderScratch;
+	// per chunk digit counts, 256 per chunk
+	std::vector<size_t> histograms;
+};
+
+#endif
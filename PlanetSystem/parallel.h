@@ -0,0 +1,39 @@
+#pragma once
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include <thread>
+#include <vector>
+
+// Number of chunks to split count items into: one per hardware thread, but
+// never fewer than grain items per chunk so small inputs stay single threaded.
+inline unsigned int ParallelChunkCount(size_t count, size_t grain)
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	size_t chunks = grain > 0 ? count / grain : count;
+	if (chunks < 1)
+		chunks = 1;
+	return chunks < threads ? (unsigned int)chunks : threads;
+}
+
+// Runs body(chunk, begin, end) on `chunks` contiguous, ordered slices of
+// [0, count). Chunk 0 runs on the calling thread; returns when all are done.
+template <typename Function>
+void ParallelFor(size_t count, unsigned int chunks, Function body)
+{
+	if (chunks <= 1)
+	{
+		body(0u, (size_t)0, count);
+		return;
+	}
+	std::vector<std::thread> workers;
+	workers.reserve(chunks - 1);
+	for (unsigned int c = 1; c < chunks; ++c)
+		workers.emplace_back(body, c, count * c / chunks, count * (c + 1) / chunks);
+	body(0u, (size_t)0, count / chunks);
+	for (size_t w = 0; w < workers.size(); ++w)
+		workers[w].join();
+}
+
+#endif
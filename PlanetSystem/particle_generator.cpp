@@ -8,8 +8,8 @@
 ******************************************************************/
 #include "particle_generator.h"
 
-ParticleGenerator::ParticleGenerator(Shader shader, Texture2D texture, GLuint amount)
-	: shader(shader), texture(texture), amount(amount)
+ParticleGenerator::ParticleGenerator(Shader shader, Shader impostorShader, Texture2D texture, GLuint amount, uint64_t seed)
+	: amount(amount), rng(seed), lastStep(0.0f), shader(shader), impostorShader(impostorShader), texture(texture)
 {
 	this->init();
 }
@@ -17,6 +17,7 @@ ParticleGenerator::ParticleGenerator(Shader shader, Texture2D texture, GLuint am
 void ParticleGenerator::Update(GLfloat dt, GLuint newParticles, glm::vec3 centerPos)
 {
 	//std::cout <<"ParticleGenerator::Update "<< dt << std::endl;
+	this->lastStep = dt;
 	// Add new particles 
 	for (GLuint i = 0; i < newParticles; ++i)
 	{
@@ -41,28 +42,60 @@ void ParticleGenerator::Update(GLfloat dt, GLuint newParticles, glm::vec3 center
 	}
 }
 
+void ParticleGenerator::SpawnDebris(glm::vec3 position, glm::vec3 velocity, GLfloat spread, GLuint count)
+{
+	for (GLuint i = 0; i < count; ++i)
+	{
+		Particle &particle = this->particles[this->firstUnusedParticle()];
+		particle.Position = position;
+		particle.Color = DEBRIS_COLOR;
+		particle.Life = 2.0f;
+		particle.Visible = GL_TRUE;
+		particle.Velocity = velocity + glm::vec3(this->rng.NextFloat() * 2.0f - 1.0f, this->rng.NextFloat() * 2.0f - 1.0f, this->rng.NextFloat() * 2.0f - 1.0f) * spread;
+		particle.Acceleration = glm::vec3(0.0f);
+	}
+}
+
 // Render all particles
-void ParticleGenerator::Draw()
+void ParticleGenerator::Draw(const RenderView &view)
 {
+	// Gather live particles and batch-cull their bounding spheres
+	this->cullX.clear();
+	this->cullY.clear();
+	this->cullZ.clear();
+	this->cullRadius.clear();
+	this->cullParticle.clear();
+	for (GLuint i = 0; i < this->amount; ++i)
+	{
+		const Particle &particle = this->particles[i];
+		if ((particle.Life > 0.0f) && particle.Visible)
+		{
+			// render relative to the view's origin (see RenderView)
+			glm::vec3 relative(glm::dvec3(particle.Position) - view.Origin);
+			this->cullX.push_back(relative.x);
+			this->cullY.push_back(relative.y);
+			this->cullZ.push_back(relative.z);
+			this->cullRadius.push_back(0.005f);
+			this->cullParticle.push_back(i);
+		}
+	}
+	GLuint count = this->cullParticle.size();
+	this->visibleIndices.resize(count);
+	GLuint visible = count > 0 ? view.ViewFrustum.CullSpheres(&this->cullX[0], &this->cullY[0], &this->cullZ[0], &this->cullRadius[0], count, &this->visibleIndices[0]) : 0;
+	this->cullStats.Visible = visible;
+	this->cullStats.Culled = count - visible;
+
 	// Use additive blending to give it a 'glow' effect
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 	//glDisable(GL_DEPTH_TEST);
-	this->shader.Use();
-	for (Particle particle : this->particles)
+	this->sphereLOD.Begin();
+	for (GLuint i = 0; i < visible; ++i)
 	{
-		if ( (particle.Life > 0.0f) && particle.Visible)
-		{
-			glm::mat4 model;
-			model = glm::translate(model, particle.Position);
-			model = glm::scale(model, glm::vec3(0.001f));
-			this->shader.SetMatrix4("model", model);
-			this->shader.SetVector4f("color", particle.Color);
-			//this->texture.Bind();
-			glBindVertexArray(this->VAO);
-			glDrawElements(GL_TRIANGLE_STRIP, this->indexCount, GL_UNSIGNED_INT, 0);
-			glBindVertexArray(0);
-		}
+		GLuint index = this->visibleIndices[i];
+		const Particle &particle = this->particles[this->cullParticle[index]];
+		this->sphereLOD.Add(view, SphereInstance(glm::vec3(this->cullX[index], this->cullY[index], this->cullZ[index]), this->cullRadius[index], particle.Color, particle.Velocity * this->lastStep));
 	}
+	this->sphereLOD.Draw(view, this->shader, this->impostorShader);
 	// Don't forget to reset to default blending mode
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -81,73 +114,7 @@ void ParticleGenerator::Draw()
 
 void ParticleGenerator::init()
 {
-	// Set up mesh and attribute properties
-	GLuint vbo, ebo;
-	glGenVertexArrays(1, &this->VAO);
-	glGenBuffers(1, &vbo);
-	glGenBuffers(1, &ebo);
-
-	std::vector<glm::vec3> positions;
-	std::vector<unsigned int> indices;
-
-	const unsigned int X_SEGMENTS = 32;
-	const unsigned int Y_SEGMENTS = 32;
-	const float PI = 3.14159265359;
-	for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
-	{
-		for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-		{
-			float xSegment = (float)x / (float)X_SEGMENTS;
-			float ySegment = (float)y / (float)Y_SEGMENTS;
-			float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-			float yPos = std::cos(ySegment * PI);
-			float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-
-			positions.push_back(glm::vec3(xPos, yPos, zPos));
-		}
-	}
-	bool oddRow = false;
-	for (int y = 0; y < Y_SEGMENTS; ++y)
-	{
-		if (!oddRow) // even rows: y == 0, y == 2; and so on
-		{
-			for (int x = 0; x <= X_SEGMENTS; ++x)
-			{
-				indices.push_back(y       * (X_SEGMENTS + 1) + x);
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-			}
-		}
-		else
-		{
-			for (int x = X_SEGMENTS; x >= 0; --x)
-			{
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-				indices.push_back(y       * (X_SEGMENTS + 1) + x);
-			}
-		}
-		oddRow = !oddRow;
-	}
-	indexCount = indices.size();
-
-	std::vector<float> data;
-	for (int i = 0; i < positions.size(); ++i)
-	{
-		data.push_back(positions[i].x);
-		data.push_back(positions[i].y);
-		data.push_back(positions[i].z);
-	}
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-	float stride = (3) * sizeof(float);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-
-
-	
-	glBindVertexArray(0);
+	this->sphereLOD.Init();
 
 	// Create this->amount default particle instances
 	for (GLuint i = 0; i < this->amount; ++i)
@@ -177,13 +144,31 @@ GLuint ParticleGenerator::firstUnusedParticle()
 	return 0;
 }
 
+bool ParticleGenerator::LoadCheckpoint(const CheckpointReader &reader)
+{
+	std::vector<Particle> loaded;
+	// firstUnusedParticle always hands out an index, so the pool must not be empty
+	if (!reader.ReadArray(CHECKPOINT_PARTICLES, loaded) || loaded.empty())
+	{
+		std::cout << "ERROR::CHECKPOINT: Particle pool is missing or inconsistent" << std::endl;
+		return false;
+	}
+	RandomState rngState;
+	if (reader.ReadValue(CHECKPOINT_PARTICLE_RNG, rngState))
+		this->rng = Random(rngState);
+	this->particles = loaded;
+	this->amount = this->particles.size();
+	lastUsedParticle = 0;
+	return true;
+}
+
 void ParticleGenerator::respawnParticle(Particle &particle, glm::vec3 centerPos)
 {
 	particle.Position = centerPos;
 	particle.Color = RED_COLOR;
 	particle.Life = 10.0f;
 	particle.Visible = GL_FALSE;
-	particle.Velocity = glm::vec3((rand() % 100) / 100.0f - 0.5f, (rand() % 100) / 100.0f - 0.5f, (rand() % 100) / 100.0f - 0.5f);
+	particle.Velocity = glm::vec3(this->rng.NextFloat() - 0.5f, this->rng.NextFloat() - 0.5f, this->rng.NextFloat() - 0.5f);
 	particle.Acceleration = glm::vec3(0.0f);
 	//particle.Velocity = randVelocity * 50.0f;
 }
\ No newline at end of file
@@ -18,8 +18,13 @@
 
 #include "shader.h"
 #include "texture.h"
+#include "render_view.h"
+#include "sphere_lod.h"
+#include "checkpoint.h"
+#include "random.h"
 
 #define RED_COLOR glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)
+#define DEBRIS_COLOR glm::vec4(1.0f, 0.5f, 0.1f, 1.0f)
 
 // Represents a single particle and its state
 struct Particle {
@@ -38,22 +43,44 @@ struct Particle {
 class ParticleGenerator
 {
 public:
-	// Constructor
-	ParticleGenerator(Shader shader, Texture2D texture, GLuint amount);
+	// Constructor; spawn positions and velocities come from seed
+	ParticleGenerator(Shader shader, Shader impostorShader, Texture2D texture, GLuint amount, uint64_t seed = 2);
 	// Update all particles
 	void Update(GLfloat dt, GLuint newParticles, glm::vec3 centerPos = glm::vec3(0.0f, 0.0f, 0.0f));
-	// Render all particles
-	void Draw();
+	// Spawns count short-lived debris particles at position, moving with velocity
+	// plus a random spread of up to spread in every direction
+	void SpawnDebris(glm::vec3 position, glm::vec3 velocity, GLfloat spread, GLuint count);
+	// Render all live particles inside the view frustum, bucketed into
+	// instanced draws by level of detail
+	void Draw(const RenderView &view);
+	// Appends the particle pool and the RNG position to a checkpoint snapshot
+	void SaveCheckpoint(CheckpointWriter &writer) const
+	{
+		writer.AddArray(CHECKPOINT_PARTICLES, this->particles);
+		writer.AddValue(CHECKPOINT_PARTICLE_RNG, this->rng.State());
+	}
+	// Restores the particle pool; leaves it unchanged if the snapshot has none
+	bool LoadCheckpoint(const CheckpointReader &reader);
+	// Visible/culled counts of the last Draw call
+	const CullStats &GetCullStats() const { return this->cullStats; }
+	// Draws every body as a ray traced impostor instead of choosing a mesh level
+	void SetImpostorsOnly(GLboolean impostorsOnly) { this->sphereLOD.ImpostorsOnly = impostorsOnly; }
 private:
 	// State
 	std::vector<Particle> particles;
+	// Culling scratch buffers: live particles gathered as SoA bounding spheres
+	std::vector<GLfloat> cullX, cullY, cullZ, cullRadius;
+	std::vector<GLuint> cullParticle, visibleIndices;
+	CullStats cullStats;
 	GLuint amount;
+	Random rng;
+	// Step of the last Update; particles move in straight lines, so Velocity * lastStep is their motion since the previous frame
+	GLfloat lastStep;
 	// Render state
 	Shader shader;
+	Shader impostorShader;
 	Texture2D texture;
-	GLuint VAO;
-	// element buffer size, use in glDrawElements
-	GLuint indexCount;
+	SphereLOD sphereLOD;
 	// Initializes buffer and vertex attributes
 	void init();
 	// Returns the first Particle index that's currently unused e.g. Life <= 0.0f or 0 if no particle is currently inactive
@@ -0,0 +1,321 @@
+#include <particle_mesh.h>
+#include <parallel.h>
+#include <algorithm>
+#include <cmath>
+
+// Gaussian split scale of P3M in cells; the mesh force is accurate beyond
+// about 4.5 rs, which is where the direct part is cut off
+static const double SPLIT_CELLS = 1.25;
+static const double SHORT_RANGE_CUT = 4.5;
+// the pure mesh kernel is Plummer softened by one cell, the mesh cannot resolve less
+static const double MESH_SOFTENING_CELLS = 1.0;
+static const double PI = 3.14159265358979323846;
+static const GLuint SPLIT_TABLE_SIZE = 4096;
+// lines per chunk below which the FFT stays single threaded
+static const size_t LINE_GRAIN = 256;
+
+ParticleMesh::ParticleMesh()
+	:gridSize(0), paddedSize(0), shortRange(false), greenValid(false)
+{
+	this->SetGridSize(64);
+	// erfc(u) + 2u/sqrt(pi) exp(-u^2) with u = r / 2rs, sampled uniformly in r^2
+	this->splitTable.resize(SPLIT_TABLE_SIZE + 2);
+	this->splitPotentialTable.resize(SPLIT_TABLE_SIZE + 2);
+	for (GLuint k = 0; k < SPLIT_TABLE_SIZE + 2; ++k)
+	{
+		double u = SHORT_RANGE_CUT * std::sqrt((double)k / SPLIT_TABLE_SIZE) / 2.0;
+		this->splitTable[k] = std::erfc(u) + 2.0 * u / std::sqrt(PI) * std::exp(-u * u);
+		this->splitPotentialTable[k] = std::erfc(u);
+	}
+}
+
+void ParticleMesh::SetGridSize(GLuint cells)
+{
+	GLuint size = 8;
+	while (size < cells && size < MAX_GRID_SIZE)
+		size <<= 1;
+	if (size == this->gridSize)
+		return;
+	this->gridSize = size;
+	this->paddedSize = 2 * size;
+	const GLuint n = this->paddedSize;
+	this->twiddles.resize(n / 2);
+	for (GLuint k = 0; k < n / 2; ++k)
+		this->twiddles[k] = std::polar(1.0, -2.0 * PI * k / n);
+	GLuint bits = 0;
+	while ((1u << bits) < n)
+		++bits;
+	this->bitReverse.resize(n);
+	for (GLuint i = 0; i < n; ++i)
+	{
+		GLuint r = 0;
+		for (GLuint b = 0; b < bits; ++b)
+			r |= ((i >> b) & 1u) << (bits - 1 - b);
+		this->bitReverse[i] = r;
+	}
+	this->greenValid = false;
+}
+
+void ParticleMesh::SetShortRange(bool enabled)
+{
+	if (enabled != this->shortRange)
+		this->greenValid = false;
+	this->shortRange = enabled;
+}
+
+void ParticleMesh::transformLine(Complex *line, bool inverse) const
+{
+	const GLuint n = this->paddedSize;
+	for (GLuint i = 0; i < n; ++i)
+	{
+		GLuint j = this->bitReverse[i];
+		if (i < j)
+			std::swap(line[i], line[j]);
+	}
+	for (GLuint len = 2; len <= n; len <<= 1)
+	{
+		const GLuint half = len / 2, step = n / len;
+		for (GLuint i = 0; i < n; i += len)
+		{
+			for (GLuint k = 0; k < half; ++k)
+			{
+				Complex w = inverse ? std::conj(this->twiddles[k * step]) : this->twiddles[k * step];
+				Complex u = line[i + k], v = line[i + k + half] * w;
+				line[i + k] = u + v;
+				line[i + k + half] = u - v;
+			}
+		}
+	}
+	if (inverse)
+	{
+		const double scale = 1.0 / n;
+		for (GLuint i = 0; i < n; ++i)
+			line[i] *= scale;
+	}
+}
+
+void ParticleMesh::transformAxis(int axis, bool inverse, GLuint limitA, GLuint limitB)
+{
+	const size_t n = this->paddedSize;
+	// line base offsets and element stride for each axis
+	const size_t strideA = axis == 0 ? n : 1;
+	const size_t strideB = axis == 2 ? n : n * n;
+	const size_t stride = axis == 0 ? 1 : (axis == 1 ? n : n * n);
+	const size_t lines = (size_t)limitA * limitB;
+	Complex *grid = &this->grid[0];
+	ParallelFor(lines, ParallelChunkCount(lines, LINE_GRAIN), [&](unsigned int, size_t begin, size_t end)
+	{
+		std::vector<Complex> line(n);
+		for (size_t l = begin; l < end; ++l)
+		{
+			Complex *base = grid + (l % limitA) * strideA + (l / limitA) * strideB;
+			for (size_t k = 0; k < n; ++k)
+				line[k] = base[k * stride];
+			this->transformLine(&line[0], inverse);
+			for (size_t k = 0; k < n; ++k)
+				base[k * stride] = line[k];
+		}
+	});
+}
+
+double ParticleMesh::kernel(double r) const
+{
+	if (this->shortRange)
+		return r > 0.0 ? std::erf(r / (2.0 * SPLIT_CELLS)) / r : 1.0 / (SPLIT_CELLS * std::sqrt(PI));
+	return 1.0 / std::sqrt(r * r + MESH_SOFTENING_CELLS * MESH_SOFTENING_CELLS);
+}
+
+// The kernel is tabulated in cell units on the padded grid with wrapped
+// (negative) offsets, so the circular convolution equals the isolated one over
+// the unpadded octant.
+void ParticleMesh::buildGreen()
+{
+	const GLuint n = this->paddedSize;
+	this->grid.assign((size_t)n * n * n, Complex(0.0, 0.0));
+	for (GLuint z = 0; z < n; ++z)
+	for (GLuint y = 0; y < n; ++y)
+	for (GLuint x = 0; x < n; ++x)
+	{
+		double dx = x <= n / 2 ? x : (double)n - x;
+		double dy = y <= n / 2 ? y : (double)n - y;
+		double dz = z <= n / 2 ? z : (double)n - z;
+		this->grid[x + (size_t)n * (y + (size_t)n * z)] = Complex(this->kernel(std::sqrt(dx * dx + dy * dy + dz * dz)), 0.0);
+	}
+	this->transformAxis(0, false, n, n);
+	this->transformAxis(1, false, n, n);
+	this->transformAxis(2, false, n, n);
+	this->greenHat.resize(this->grid.size());
+	for (size_t k = 0; k < this->grid.size(); ++k)
+		this->greenHat[k] = this->grid[k].real();
+	this->greenValid = true;
+}
+
+void ParticleMesh::ComputeAccelerations(const BodyStore &bodies, const GravityParams &params, double *ax, double *ay, double *az,
+	double *potential)
+{
+	const size_t count = bodies.Size();
+	if (count == 0)
+		return;
+	if (!this->greenValid)
+		this->buildGreen();
+	const GLuint g = this->gridSize, n = this->paddedSize;
+
+	// Bodies map to mesh coordinates [1, g - 3]: cloud-in-cell reaches one node
+	// up and the central difference one node either way, so no lookup leaves the mesh
+	double minX = bodies.X[0], minY = bodies.Y[0], minZ = bodies.Z[0];
+	double maxX = minX, maxY = minY, maxZ = minZ;
+	for (size_t i = 1; i < count; ++i)
+	{
+		minX = std::min(minX, bodies.X[i]); maxX = std::max(maxX, bodies.X[i]);
+		minY = std::min(minY, bodies.Y[i]); maxY = std::max(maxY, bodies.Y[i]);
+		minZ = std::min(minZ, bodies.Z[i]); maxZ = std::max(maxZ, bodies.Z[i]);
+	}
+	double extent = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
+	const double h = extent > 0.0 ? extent / (g - 4) : 1.0;
+	const double invH = 1.0 / h;
+	const double originX = minX - h, originY = minY - h, originZ = minZ - h;
+
+	// cloud-in-cell deposit
+	this->grid.assign((size_t)n * n * n, Complex(0.0, 0.0));
+	for (size_t i = 0; i < count; ++i)
+	{
+		double ux = (bodies.X[i] - originX) * invH, uy = (bodies.Y[i] - originY) * invH, uz = (bodies.Z[i] - originZ) * invH;
+		size_t ix = std::min((size_t)ux, (size_t)g - 3), iy = std::min((size_t)uy, (size_t)g - 3), iz = std::min((size_t)uz, (size_t)g - 3);
+		double fx = ux - ix, fy = uy - iy, fz = uz - iz;
+		for (int c = 0; c < 8; ++c)
+		{
+			int ox = c & 1, oy = (c >> 1) & 1, oz = c >> 2;
+			double w = (ox ? fx : 1.0 - fx) * (oy ? fy : 1.0 - fy) * (oz ? fz : 1.0 - fz);
+			this->grid[(ix + ox) + n * ((iy + oy) + n * (iz + oz))] += w * bodies.Mass[i];
+		}
+	}
+
+	// convolve; only the mass-carrying octant is transformed on the way in
+	// and only that octant of the potential is transformed back
+	this->transformAxis(0, false, g, g);
+	this->transformAxis(1, false, n, g);
+	this->transformAxis(2, false, n, n);
+	for (size_t k = 0; k < this->grid.size(); ++k)
+		this->grid[k] *= this->greenHat[k];
+	this->transformAxis(2, true, n, n);
+	this->transformAxis(1, true, n, g);
+	this->transformAxis(0, true, g, g);
+
+	if (ax != nullptr)
+	{
+		// field = -grad(phi) with phi = -G * grid / h, by central differences
+		const size_t cells = (size_t)g * g * g;
+		this->fieldX.assign(cells, 0.0);
+		this->fieldY.assign(cells, 0.0);
+		this->fieldZ.assign(cells, 0.0);
+		const double fieldScale = params.G * invH * invH * 0.5;
+		for (GLuint z = 1; z + 1 < g; ++z)
+		for (GLuint y = 1; y + 1 < g; ++y)
+		for (GLuint x = 1; x + 1 < g; ++x)
+		{
+			size_t p = x + (size_t)n * (y + (size_t)n * z);
+			size_t m = x + (size_t)g * (y + (size_t)g * z);
+			this->fieldX[m] = fieldScale * (this->grid[p + 1].real() - this->grid[p - 1].real());
+			this->fieldY[m] = fieldScale * (this->grid[p + n].real() - this->grid[p - n].real());
+			this->fieldZ[m] = fieldScale * (this->grid[p + (size_t)n * n].real() - this->grid[p - (size_t)n * n].real());
+		}
+
+		// interpolate back with the deposit weights
+		ParallelFor(count, ParallelChunkCount(count, 4096), [&](unsigned int, size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				double ux = (bodies.X[i] - originX) * invH, uy = (bodies.Y[i] - originY) * invH, uz = (bodies.Z[i] - originZ) * invH;
+				size_t ix = std::min((size_t)ux, (size_t)g - 3), iy = std::min((size_t)uy, (size_t)g - 3), iz = std::min((size_t)uz, (size_t)g - 3);
+				double fx = ux - ix, fy = uy - iy, fz = uz - iz;
+				double sx = 0.0, sy = 0.0, sz = 0.0;
+				for (int c = 0; c < 8; ++c)
+				{
+					int ox = c & 1, oy = (c >> 1) & 1, oz = c >> 2;
+					double w = (ox ? fx : 1.0 - fx) * (oy ? fy : 1.0 - fy) * (oz ? fz : 1.0 - fz);
+					size_t m = (ix + ox) + g * ((iy + oy) + g * (iz + oz));
+					sx += w * this->fieldX[m];
+					sy += w * this->fieldY[m];
+					sz += w * this->fieldZ[m];
+				}
+				ax[i] = sx;
+				ay[i] = sy;
+				az[i] = sz;
+			}
+		});
+	}
+
+	if (potential != nullptr)
+	{
+		// phi = -G * grid / h at the body, less the body's own deposit seen
+		// through the kernel: sum over its cells c, c' of w_c w_c' kernel(c - c')
+		double nearKernel[4];
+		for (int k = 0; k < 4; ++k)
+			nearKernel[k] = this->kernel(std::sqrt((double)k));
+		const double potentialScale = -params.G * invH;
+		ParallelFor(count, ParallelChunkCount(count, 4096), [&](unsigned int, size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				double ux = (bodies.X[i] - originX) * invH, uy = (bodies.Y[i] - originY) * invH, uz = (bodies.Z[i] - originZ) * invH;
+				size_t ix = std::min((size_t)ux, (size_t)g - 3), iy = std::min((size_t)uy, (size_t)g - 3), iz = std::min((size_t)uz, (size_t)g - 3);
+				double fx = ux - ix, fy = uy - iy, fz = uz - iz;
+				double w[8];
+				double sum = 0.0, self = 0.0;
+				for (int c = 0; c < 8; ++c)
+				{
+					int ox = c & 1, oy = (c >> 1) & 1, oz = c >> 2;
+					w[c] = (ox ? fx : 1.0 - fx) * (oy ? fy : 1.0 - fy) * (oz ? fz : 1.0 - fz);
+					sum += w[c] * this->grid[(ix + ox) + n * ((iy + oy) + n * (iz + oz))].real();
+				}
+				for (int c = 0; c < 8; ++c)
+				for (int d = 0; d < 8; ++d)
+				{
+					const int differing = ((c ^ d) & 1) + (((c ^ d) >> 1) & 1) + ((c ^ d) >> 2);
+					self += w[c] * w[d] * nearKernel[differing];
+				}
+				potential[i] = potentialScale * (sum - bodies.Mass[i] * self);
+			}
+		});
+	}
+
+	if (this->shortRange)
+		this->addShortRange(bodies, params, h, ax, ay, az, potential);
+}
+
+// Direct sum of the erfc part of the split force over pairs within the cutoff;
+// the softening of GravityParams applies here just like in DirectAccelerations
+void ParticleMesh::addShortRange(const BodyStore &bodies, const GravityParams &params, double cellSize, double *ax, double *ay, double *az,
+	double *potential)
+{
+	const double rs = SPLIT_CELLS * cellSize;
+	const double cut = SHORT_RANGE_CUT * rs, cut2 = cut * cut;
+	const double eps2 = params.Softening * params.Softening;
+	const double tableScale = SPLIT_TABLE_SIZE / cut2;
+	const double *table = &this->splitTable[0], *potentialTable = &this->splitPotentialTable[0];
+	const double *x = bodies.X.data(), *y = bodies.Y.data(), *z = bodies.Z.data(), *m = bodies.Mass.data();
+	this->shortRangeHash.Build(x, y, z, bodies.Size(), cut);
+	this->shortRangeHash.ForEachNeighbourPair([&](GLuint i, GLuint j)
+	{
+		double dx = x[j] - x[i], dy = y[j] - y[i], dz = z[j] - z[i];
+		double r2 = dx * dx + dy * dy + dz * dz;
+		double soft2 = r2 + eps2;
+		if (r2 >= cut2 || soft2 <= 0.0)
+			return;
+		double t = r2 * tableScale;
+		size_t k = (size_t)t;
+		if (ax != nullptr)
+		{
+			double split = table[k] + (t - k) * (table[k + 1] - table[k]);
+			double s = params.G * split / (soft2 * std::sqrt(soft2));
+			ax[i] += s * m[j] * dx; ay[i] += s * m[j] * dy; az[i] += s * m[j] * dz;
+			ax[j] -= s * m[i] * dx; ay[j] -= s * m[i] * dy; az[j] -= s * m[i] * dz;
+		}
+		if (potential != nullptr)
+		{
+			double p = params.G * (potentialTable[k] + (t - k) * (potentialTable[k + 1] - potentialTable[k])) / std::sqrt(soft2);
+			potential[i] -= p * m[j];
+			potential[j] -= p * m[i];
+		}
+	});
+}
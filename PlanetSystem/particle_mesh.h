@@ -0,0 +1,69 @@
+#pragma once
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+#include <vector>
+#include <complex>
+#include <glad/glad.h>
+#include <body_store.h>
+#include <gravity.h>
+#include <collision.h>
+
+// Particle-mesh gravity: masses are deposited on a cubic grid around the
+// bodies with cloud-in-cell weights, the potential is obtained by convolving
+// with the Green's function via FFT, and the finite-difference field is
+// interpolated back with the same weights. Boundaries are isolated (Hockney &
+// Eastwood): the grid is zero padded to twice its size per axis, so the cost
+// is O(N + G^3 log G) for G cells per axis.
+//
+// With the short-range correction enabled (P3M) the mesh only carries the
+// smooth part of the force, erf(r / 2rs) / r, and pairs closer than a few
+// cells add the remaining erfc part directly, found through a SpatialHash.
+class ParticleMesh
+{
+public:
+	// Largest mesh accepted; its zero padded FFT grid alone is 512^3 complex values (2 GiB)
+	static const GLuint MAX_GRID_SIZE = 256;
+	ParticleMesh();
+	// Mesh cells per axis, rounded up to a power of two (at least 8, at most MAX_GRID_SIZE)
+	void SetGridSize(GLuint cells);
+	// Enables the direct short-range correction (P3M)
+	void SetShortRange(bool enabled);
+	GLuint GridSize() const { return this->gridSize; }
+	// Writes the accelerations of every body into ax/ay/az (indexed by body).
+	// With potential given, the potential per unit mass of every body is
+	// interpolated from the same mesh (less each body's own mesh contribution)
+	// and written there; ax/ay/az may then be nullptr.
+	void ComputeAccelerations(const BodyStore &bodies, const GravityParams &params, double *ax, double *ay, double *az,
+		double *potential = nullptr);
+private:
+	typedef std::complex<double> Complex;
+	// Cells per axis of the mesh and of the zero padded FFT grid
+	GLuint gridSize, paddedSize;
+	bool shortRange;
+	// Transform of the Green's function in cell units; real because the kernel is even
+	std::vector<double> greenHat;
+	bool greenValid;
+	// Padded density / potential grid
+	std::vector<Complex> grid;
+	// Mesh field, gridSize^3 per component
+	std::vector<double> fieldX, fieldY, fieldZ;
+	// Radix-2 FFT tables for paddedSize points
+	std::vector<Complex> twiddles;
+	std::vector<GLuint> bitReverse;
+	SpatialHash shortRangeHash;
+	// erfc part of the split force and of the split potential tabulated over (r / cutoff)^2
+	std::vector<double> splitTable, splitPotentialTable;
+
+	// Mesh kernel at a distance of r cells
+	double kernel(double r) const;
+	void buildGreen();
+	// In-place FFT of paddedSize contiguous points (the inverse is normalised)
+	void transformLine(Complex *line, bool inverse) const;
+	// Transforms the lines along axis (0 = x) whose other two indices are
+	// below the given limits; zero lines of the padding are skipped this way
+	void transformAxis(int axis, bool inverse, GLuint limitA, GLuint limitB);
+	void addShortRange(const BodyStore &bodies, const GravityParams &params, double cellSize, double *ax, double *ay, double *az,
+		double *potential);
+};
+
+#endif
@@ -1,7 +1,21 @@
 #include <planet_system.h>
+#include <cmath>
+#include <cstdint>
+#include <parallel.h>
 
-PlanetSystem::PlanetSystem(Shader shader)
-	:shader(shader)
+// Scalar state of a PlanetSystem as stored in CHECKPOINT_SETTINGS
+struct PlanetSystemSettings {
+	double Time, G, Softening, TimestepEta, Restitution, KeplerThreshold, OpeningAngle;
+	uint64_t ForceEvaluations, IdCount;
+	uint32_t Integrator, Backend, BlockTimesteps, MaxLevel, SortInterval, UpdatesSinceSort;
+	uint32_t CollisionResponse, KeplerCheckInterval, UpdatesSinceKeplerCheck, CentralId;
+	uint32_t AccelerationsValid, GridSize, MultipoleOrder, Reserved;
+};
+
+PlanetSystem::PlanetSystem(Shader shader, Shader impostorShader, uint64_t seed)
+	:integrator(INTEGRATOR_LEAPFROG), gravityBackend(GRAVITY_DIRECT), time(0.0), accelerationsValid(false), blockTimesteps(false), maxLevel(10), timestepEta(0.02), forceEvaluations(0),
+	centralId(~0u), keplerThreshold(1e-3), keplerCheckInterval(8), updatesSinceKeplerCheck(0), sortInterval(16), updatesSinceSort(0), collisionResponse(COLLISION_NONE), restitution(0.5), debrisGenerator(nullptr), collisionsLastStep(0), trajectoryWriter(nullptr), trajectoryInterval(1), updatesSinceRecord(0), diagnostics(nullptr), diagnosticsInterval(16), updatesSinceDiagnostics(0), playback(nullptr),
+	rng(seed), drawFrame(0), shader(shader), impostorShader(impostorShader)
 {
 	this->init();
 }
@@ -9,119 +23,955 @@ PlanetSystem::PlanetSystem(Shader shader)
 // calculate the gravity effect
 void PlanetSystem::Update(GLfloat dt)
 {
+	if (this->playback != nullptr)
+	{
+		this->playback->Advance(dt);
+		this->playback->Interpolate(this->bodies, this->playbackBodies);
+		return;
+	}
+	if (this->sortInterval > 0 && ++this->updatesSinceSort >= this->sortInterval)
+	{
+		this->sortBodies();
+		this->updatesSinceSort = 0;
+	}
+	this->prepareKeplerBodies();
+	if (this->integrator == INTEGRATOR_WISDOM_HOLMAN)
+		this->updateWisdomHolman(dt);
+	else if (this->integrator == INTEGRATOR_HERMITE)
+		this->updateHermite(dt);
+	else if (this->blockTimesteps)
+		this->updateBlock(dt);
+	else
+		this->updateShared(dt);
+	this->advanceKeplerBodies(dt);
+	this->resolveCollisions(dt);
+	this->time += dt;
+	if (this->trajectoryWriter != nullptr && ++this->updatesSinceRecord >= this->trajectoryInterval)
+	{
+		this->trajectoryWriter->Record(this->time, this->bodies);
+		this->updatesSinceRecord = 0;
+	}
+	if (this->diagnostics != nullptr && ++this->updatesSinceDiagnostics >= this->diagnosticsInterval)
+	{
+		this->sampleDiagnostics();
+		this->updatesSinceDiagnostics = 0;
+	}
+	if (!this->keplerBodies.empty() && ++this->updatesSinceKeplerCheck >= this->keplerCheckInterval)
+	{
+		this->checkKeplerBodies();
+		this->updatesSinceKeplerCheck = 0;
+	}
+}
 
+void PlanetSystem::SetKeplerPrimary(unsigned int id, unsigned int primaryId)
+{
+	this->ClearKeplerPrimary(id);
+	if (id == primaryId)
+		return;
+	// starts numeric; the next check decides whether the orbit is clean enough
+	KeplerBody body;
+	body.Id = id;
+	body.PrimaryId = primaryId;
+	body.Analytic = false;
+	this->keplerBodies.push_back(body);
+	this->updatesSinceKeplerCheck = this->keplerCheckInterval;
 }
 
-void PlanetSystem::Draw()
+void PlanetSystem::ClearKeplerPrimary(unsigned int id)
 {
-	this->shader.Use();
-	for (Planet planet : this->planets)
+	for (size_t k = 0; k < this->keplerBodies.size(); ++k)
 	{
-		glm::mat4 model;
-		model = glm::translate(model, planet.Position);
-		model = glm::scale(model, glm::vec3(0.1f));
-		this->shader.SetMatrix4("model", model);
-		this->shader.SetVector4f("color", planet.Color);
-		glBindVertexArray(this->sphereVAO);
-		glDrawElements(GL_TRIANGLE_STRIP, this->indexCount, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		if (this->keplerBodies[k].Id != id)
+			continue;
+		// its acceleration (and jerk) are stale after analytic steps
+		if (this->keplerBodies[k].Analytic)
+			this->accelerationsValid = false;
+		this->keplerBodies.erase(this->keplerBodies.begin() + k);
+		return;
 	}
 }
 
-void PlanetSystem::init()
+void PlanetSystem::SetTrajectoryWriter(TrajectoryWriter *writer, GLuint interval)
+{
+	this->trajectoryWriter = writer;
+	this->trajectoryInterval = interval > 0 ? interval : 1;
+	this->updatesSinceRecord = 0;
+	if (writer != nullptr)
+		writer->Record(this->time, this->bodies);
+}
+
+void PlanetSystem::SetDiagnostics(DiagnosticsLog *log, GLuint interval)
 {
-	// Set up mesh and attribute properties
-	GLuint vbo, ebo;
-	glGenVertexArrays(1, &this->sphereVAO);
-	glGenBuffers(1, &vbo);
-	glGenBuffers(1, &ebo);
+	this->diagnostics = log;
+	this->diagnosticsInterval = interval > 0 ? interval : 1;
+	this->updatesSinceDiagnostics = 0;
+	if (log != nullptr)
+		this->sampleDiagnostics();
+}
 
-	std::vector<glm::vec3> positions;
-	std::vector<glm::vec2> uv;
-	std::vector<glm::vec3> normals;
-	std::vector<unsigned int> indices;
+GravityBackend PlanetSystem::activeBackend() const
+{
+	return this->integrator == INTEGRATOR_LEAPFROG && !this->blockTimesteps ? this->gravityBackend : GRAVITY_DIRECT;
+}
 
-	const unsigned int X_SEGMENTS = 64;
-	const unsigned int Y_SEGMENTS = 64;
-	const float PI = 3.14159265359;
-	for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+void PlanetSystem::sampleDiagnostics()
+{
+	const BodyStore &b = this->bodies;
+	const size_t n = b.Size();
+	this->potential.resize(n);
+	if (n > 0)
 	{
-		for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+		const GravityBackend backend = this->activeBackend();
+		if (backend == GRAVITY_DIRECT)
 		{
-			float xSegment = (float)x / (float)X_SEGMENTS;
-			float ySegment = (float)y / (float)Y_SEGMENTS;
-			float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-			float yPos = std::cos(ySegment * PI);
-			float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-
-			positions.push_back(glm::vec3(xPos, yPos, zPos));
-			uv.push_back(glm::vec2(xSegment, ySegment));
-			normals.push_back(glm::vec3(xPos, yPos, zPos));
+			ParallelFor(n, ParallelChunkCount(n, 256), [&](unsigned int, size_t begin, size_t end)
+			{
+				DirectPotentials(b, this->gravity, begin, end, &this->potential[0]);
+			});
 		}
+		else if (backend == GRAVITY_FMM)
+			this->fastMultipole.ComputeAccelerations(b, this->gravity, nullptr, nullptr, nullptr, &this->potential[0]);
+		else
+			this->particleMesh.ComputeAccelerations(b, this->gravity, nullptr, nullptr, nullptr, &this->potential[0]);
+	}
+	this->diagnostics->Push(ComputeDiagnostics(b, n > 0 ? &this->potential[0] : nullptr, this->time));
+}
+
+void PlanetSystem::SetPlayback(TrajectoryPlayback *playback)
+{
+	this->playback = playback;
+	if (playback != nullptr)
+		playback->Interpolate(this->bodies, this->playbackBodies);
+	else
+		this->playbackBodies.Clear();
+}
+
+void PlanetSystem::SetGravityBackend(GravityBackend backend, GLuint gridSize)
+{
+	this->gravityBackend = backend;
+	this->particleMesh.SetGridSize(gridSize);
+	this->particleMesh.SetShortRange(backend == GRAVITY_P3M);
+	this->accelerationsValid = false;
+}
+
+void PlanetSystem::SetMultipoleAccuracy(GLuint order, double theta)
+{
+	this->fastMultipole.SetOrder(order);
+	this->fastMultipole.SetOpeningAngle(theta);
+	this->accelerationsValid = false;
+}
+
+void PlanetSystem::SetBlockTimesteps(bool enabled, GLuint maxLevel, double eta)
+{
+	this->blockTimesteps = enabled;
+	this->maxLevel = maxLevel < MAX_TIMESTEP_LEVEL ? maxLevel : MAX_TIMESTEP_LEVEL;
+	this->timestepEta = eta;
+	// levels and jerks are (re)assigned on the next update
+	this->accelerationsValid = false;
+}
+
+void PlanetSystem::updateShared(double h)
+{
+	const size_t n = this->bodies.Size();
+	BodyStore &b = this->bodies;
+	if (!this->accelerationsValid)
+		this->computeAccelerations();
+	// kick (half step) and drift
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (this->analytic[i])
+			continue;
+		b.VX[i] += 0.5 * h * b.AX[i];
+		b.VY[i] += 0.5 * h * b.AY[i];
+		b.VZ[i] += 0.5 * h * b.AZ[i];
+		b.X[i] += h * b.VX[i];
+		b.Y[i] += h * b.VY[i];
+		b.Z[i] += h * b.VZ[i];
+	}
+	this->computeAccelerations();
+	// closing half kick
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (this->analytic[i])
+			continue;
+		b.VX[i] += 0.5 * h * b.AX[i];
+		b.VY[i] += 0.5 * h * b.AY[i];
+		b.VZ[i] += 0.5 * h * b.AZ[i];
+	}
+}
+
+// Hierarchical kick-drift-kick: the root step dt is split into 2^maxLevel ticks and
+// body i steps every 2^(maxLevel - level[i]) ticks. All bodies drift to the next
+// tick on which any step ends; only the bodies whose step ends there get new
+// forces, their closing half kick and a new level. Every step ends on the root
+// step boundary, so the whole system is synchronised when Update returns.
+void PlanetSystem::updateBlock(double dt)
+{
+	const size_t n = this->bodies.Size();
+	BodyStore &b = this->bodies;
+	if (!this->accelerationsValid)
+	{
+		this->activateAll();
+		this->computeActiveAccelerationsJerks();
+		for (size_t k = 0; k < this->activeBodies.size(); ++k)
+			this->stepLevel[this->activeBodies[k]] = this->chooseLevel(this->activeBodies[k], dt, 0);
 	}
-	bool oddRow = false;
-	for (int y = 0; y < Y_SEGMENTS; ++y)
+	const unsigned long long ticks = 1ull << this->maxLevel;
+	const double tickDt = dt / ticks;
+	unsigned long long tick = 0;
+	while (tick < ticks)
 	{
-		if (!oddRow) // even rows: y == 0, y == 2; and so on
+		// opening half kicks for the bodies starting a step on this tick
+		for (size_t i = 0; i < n; ++i)
 		{
-			for (int x = 0; x <= X_SEGMENTS; ++x)
+			if (this->analytic[i])
+				continue;
+			unsigned long long stepTicks = 1ull << (this->maxLevel - this->stepLevel[i]);
+			if (tick % stepTicks == 0)
 			{
-				indices.push_back(y       * (X_SEGMENTS + 1) + x);
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+				double half = 0.5 * stepTicks * tickDt;
+				b.VX[i] += half * b.AX[i];
+				b.VY[i] += half * b.AY[i];
+				b.VZ[i] += half * b.AZ[i];
 			}
 		}
-		else
+		// drift everybody to the next step boundary of the finest populated level
+		unsigned long long next = this->nextBlockTick(tick, this->maxLevel);
+		double h = (next - tick) * tickDt;
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (this->analytic[i])
+				continue;
+			b.X[i] += h * b.VX[i];
+			b.Y[i] += h * b.VY[i];
+			b.Z[i] += h * b.VZ[i];
+		}
+		tick = next;
+		// forces, closing half kicks and new levels for the bodies finishing a step
+		this->activateFinishing(tick, this->maxLevel);
+		this->computeActiveAccelerationsJerks();
+		for (size_t k = 0; k < this->activeBodies.size(); ++k)
+		{
+			GLuint i = this->activeBodies[k];
+			double half = 0.5 * (1ull << (this->maxLevel - this->stepLevel[i])) * tickDt;
+			b.VX[i] += half * b.AX[i];
+			b.VY[i] += half * b.AY[i];
+			b.VZ[i] += half * b.AZ[i];
+			this->stepLevel[i] = this->chooseLevel(i, dt, tick);
+		}
+	}
+}
+
+// 4th-order Hermite predictor-corrector (Makino & Aarseth 1992). Every body keeps
+// its position, velocity, acceleration and jerk at the start of its step; all
+// bodies are predicted to the next step boundary with a Taylor series, the
+// bodies finishing their step get new accelerations and jerks from the
+// predicted state and are corrected. With block timesteps disabled every body
+// uses the whole dt; otherwise the same tick scheme as updateBlock is used.
+void PlanetSystem::updateHermite(double dt)
+{
+	const size_t n = this->bodies.Size();
+	const GLuint topLevel = this->blockTimesteps ? this->maxLevel : 0;
+	BodyStore &b = this->bodies;
+	BodyStore &s = this->stepStart;
+	if (!this->accelerationsValid)
+	{
+		this->activateAll();
+		this->computeActiveAccelerationsJerks();
+		for (size_t k = 0; k < this->activeBodies.size(); ++k)
+			this->stepLevel[this->activeBodies[k]] = this->blockTimesteps ? this->chooseLevel(this->activeBodies[k], dt, 0) : 0;
+		s = b;
+	}
+	this->stepStartTick.assign(n, 0);
+	const unsigned long long ticks = 1ull << topLevel;
+	const double tickDt = dt / ticks;
+	unsigned long long tick = 0;
+	while (tick < ticks)
+	{
+		tick = this->nextBlockTick(tick, topLevel);
+		// predict every body to the new tick
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (this->analytic[i])
+				continue;
+			double h = (tick - this->stepStartTick[i]) * tickDt;
+			double h2 = h * h / 2.0, h3 = h * h * h / 6.0;
+			b.X[i] = s.X[i] + h * s.VX[i] + h2 * s.AX[i] + h3 * s.JX[i];
+			b.Y[i] = s.Y[i] + h * s.VY[i] + h2 * s.AY[i] + h3 * s.JY[i];
+			b.Z[i] = s.Z[i] + h * s.VZ[i] + h2 * s.AZ[i] + h3 * s.JZ[i];
+			b.VX[i] = s.VX[i] + h * s.AX[i] + h2 * s.JX[i];
+			b.VY[i] = s.VY[i] + h * s.AY[i] + h2 * s.JY[i];
+			b.VZ[i] = s.VZ[i] + h * s.AZ[i] + h2 * s.JZ[i];
+		}
+		// evaluate and correct the bodies whose step ends here
+		this->activateFinishing(tick, topLevel);
+		this->computeActiveAccelerationsJerks();
+		for (size_t k = 0; k < this->activeBodies.size(); ++k)
+		{
+			GLuint i = this->activeBodies[k];
+			double h = (tick - this->stepStartTick[i]) * tickDt;
+			double h12 = h * h / 12.0;
+			b.VX[i] = s.VX[i] + 0.5 * h * (s.AX[i] + b.AX[i]) + h12 * (s.JX[i] - b.JX[i]);
+			b.VY[i] = s.VY[i] + 0.5 * h * (s.AY[i] + b.AY[i]) + h12 * (s.JY[i] - b.JY[i]);
+			b.VZ[i] = s.VZ[i] + 0.5 * h * (s.AZ[i] + b.AZ[i]) + h12 * (s.JZ[i] - b.JZ[i]);
+			b.X[i] = s.X[i] + 0.5 * h * (s.VX[i] + b.VX[i]) + h12 * (s.AX[i] - b.AX[i]);
+			b.Y[i] = s.Y[i] + 0.5 * h * (s.VY[i] + b.VY[i]) + h12 * (s.AY[i] - b.AY[i]);
+			b.Z[i] = s.Z[i] + 0.5 * h * (s.VZ[i] + b.VZ[i]) + h12 * (s.AZ[i] - b.AZ[i]);
+			s.X[i] = b.X[i]; s.Y[i] = b.Y[i]; s.Z[i] = b.Z[i];
+			s.VX[i] = b.VX[i]; s.VY[i] = b.VY[i]; s.VZ[i] = b.VZ[i];
+			s.AX[i] = b.AX[i]; s.AY[i] = b.AY[i]; s.AZ[i] = b.AZ[i];
+			s.JX[i] = b.JX[i]; s.JY[i] = b.JY[i]; s.JZ[i] = b.JZ[i];
+			this->stepStartTick[i] = tick;
+			if (this->blockTimesteps)
+				this->stepLevel[i] = this->chooseLevel(i, dt, tick);
+		}
+	}
+}
+
+// Every body is synchronised between updates, so besides the body arrays
+// (accelerations and jerks included) only the step levels and the Hermite
+// step-start copies need the same permutation; forces stay valid.
+void PlanetSystem::sortBodies()
+{
+	this->sorter.Sort(this->bodies, this->sortOrder);
+	this->bodies.Permute(this->sortOrder);
+	if (this->stepStart.Size() == this->bodies.Size())
+		this->stepStart.Permute(this->sortOrder);
+	std::vector<GLuint> levels(this->stepLevel.size());
+	for (size_t k = 0; k < this->sortOrder.size(); ++k)
+		levels[k] = this->stepLevel[this->sortOrder[k]];
+	this->stepLevel.swap(levels);
+}
+
+void PlanetSystem::prepareKeplerBodies()
+{
+	const BodyStore &b = this->bodies;
+	this->analytic.assign(b.Size(), 0);
+	this->keplerIndex.clear();
+	this->keplerPrimary.clear();
+	// Wisdom-Holman drifts every body on a Kepler orbit already
+	if (this->integrator == INTEGRATOR_WISDOM_HOLMAN)
+		return;
+	for (size_t k = 0; k < this->keplerBodies.size();)
+	{
+		size_t i = b.IndexOf(this->keplerBodies[k].Id), p = b.IndexOf(this->keplerBodies[k].PrimaryId);
+		if (i == BodyStore::INVALID_INDEX || p == BodyStore::INVALID_INDEX)
+		{
+			// the body or its primary is gone (merged away)
+			this->keplerBodies.erase(this->keplerBodies.begin() + k);
+			continue;
+		}
+		if (this->keplerBodies[k].Analytic)
+		{
+			this->analytic[i] = 1;
+			this->keplerIndex.push_back(i);
+			this->keplerPrimary.push_back(p);
+		}
+		++k;
+	}
+	// a primary must move numerically so its new state is known when its satellites are placed
+	size_t count = 0;
+	for (size_t k = 0; k < this->keplerIndex.size(); ++k)
+	{
+		if (this->analytic[this->keplerPrimary[k]])
+			continue;
+		this->keplerIndex[count] = this->keplerIndex[k];
+		this->keplerPrimary[count] = this->keplerPrimary[k];
+		++count;
+	}
+	for (size_t k = count; k < this->keplerIndex.size(); ++k)
+		this->analytic[this->keplerIndex[k]] = 0;
+	this->keplerIndex.resize(count);
+	this->keplerPrimary.resize(count);
+	this->keplerMu.resize(count);
+	this->keplerX.resize(count); this->keplerY.resize(count); this->keplerZ.resize(count);
+	this->keplerVX.resize(count); this->keplerVY.resize(count); this->keplerVZ.resize(count);
+	for (size_t k = 0; k < count; ++k)
+	{
+		GLuint i = this->keplerIndex[k], p = this->keplerPrimary[k];
+		this->keplerMu[k] = this->gravity.G * (b.Mass[i] + b.Mass[p]);
+		this->keplerX[k] = b.X[i] - b.X[p]; this->keplerY[k] = b.Y[i] - b.Y[p]; this->keplerZ[k] = b.Z[i] - b.Z[p];
+		this->keplerVX[k] = b.VX[i] - b.VX[p]; this->keplerVY[k] = b.VY[i] - b.VY[p]; this->keplerVZ[k] = b.VZ[i] - b.VZ[p];
+		this->stepLevel[i] = 0;
+	}
+}
+
+void PlanetSystem::advanceKeplerBodies(double dt)
+{
+	const size_t count = this->keplerIndex.size();
+	if (count == 0)
+		return;
+	BodyStore &b = this->bodies;
+	KeplerDriftBatch(&this->keplerMu[0], &this->keplerX[0], &this->keplerY[0], &this->keplerZ[0],
+		&this->keplerVX[0], &this->keplerVY[0], &this->keplerVZ[0], count, dt);
+	for (size_t k = 0; k < count; ++k)
+	{
+		GLuint i = this->keplerIndex[k], p = this->keplerPrimary[k];
+		b.X[i] = b.X[p] + this->keplerX[k]; b.Y[i] = b.Y[p] + this->keplerY[k]; b.Z[i] = b.Z[p] + this->keplerZ[k];
+		b.VX[i] = b.VX[p] + this->keplerVX[k]; b.VY[i] = b.VY[p] + this->keplerVY[k]; b.VZ[i] = b.VZ[p] + this->keplerVZ[k];
+	}
+}
+
+// The perturbation is measured on the relative motion, so a moon is not
+// disturbed by the star its planet orbits, only by the star's tide. The
+// check uses the softened direct kernel, so orbits that softening would
+// noticeably bend are integrated numerically as well.
+void PlanetSystem::checkKeplerBodies()
+{
+	// Wisdom-Holman ignores the bindings, and its cached accelerations are the
+	// interaction terms only, which the full accelerations below would overwrite
+	if (this->integrator == INTEGRATOR_WISDOM_HOLMAN)
+		return;
+	BodyStore &b = this->bodies;
+	std::vector<GLuint> targets;
+	std::vector<char> listed(b.Size(), 0);
+	for (size_t k = 0; k < this->keplerBodies.size(); ++k)
+	{
+		size_t i = b.IndexOf(this->keplerBodies[k].Id), p = b.IndexOf(this->keplerBodies[k].PrimaryId);
+		if (i == BodyStore::INVALID_INDEX || p == BodyStore::INVALID_INDEX)
+			continue;
+		if (!listed[i])
+			targets.push_back(i);
+		if (!listed[p])
+			targets.push_back(p);
+		listed[i] = listed[p] = 1;
+	}
+	if (targets.empty())
+		return;
+	// accelerations at the current, synchronised state; stored in place
+	DirectAccelerationsJerks(b, this->gravity, &targets[0], targets.size(),
+		&b.AX[0], &b.AY[0], &b.AZ[0], &b.JX[0], &b.JY[0], &b.JZ[0]);
+	this->forceEvaluations += targets.size();
+	for (size_t k = 0; k < this->keplerBodies.size(); ++k)
+	{
+		KeplerBody &body = this->keplerBodies[k];
+		size_t i = b.IndexOf(body.Id), p = b.IndexOf(body.PrimaryId);
+		if (i == BodyStore::INVALID_INDEX || p == BodyStore::INVALID_INDEX)
+			continue;
+		glm::dvec3 r = b.Position(i) - b.Position(p);
+		double distance = glm::length(r);
+		glm::dvec3 kepler = -this->gravity.G * (b.Mass[i] + b.Mass[p]) * r / (distance * distance * distance);
+		glm::dvec3 relative = b.Acceleration(i) - b.Acceleration(p);
+		double perturbation = glm::length(relative - kepler) / glm::length(kepler);
+		if (body.Analytic && perturbation > this->keplerThreshold)
+		{
+			body.Analytic = false;
+			this->accelerationsValid = false;
+		}
+		else if (!body.Analytic && perturbation < 0.5 * this->keplerThreshold)
+			body.Analytic = true;
+	}
+}
+
+// Democratic heliocentric Wisdom-Holman (Duncan, Levison & Lee 1998):
+// positions relative to the central body, velocities relative to the
+// barycentre. The step is kick(interaction, dt/2) jump(dt/2) Kepler(dt)
+// jump(dt/2) kick(interaction, dt/2); the interaction accelerations of the
+// end of a step are kept in bodies.AX/AY/AZ for the next one.
+void PlanetSystem::updateWisdomHolman(double dt)
+{
+	BodyStore &b = this->bodies;
+	const size_t n = b.Size();
+	if (n == 0)
+		return;
+	size_t central = 0;
+	double totalMass = 0.0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		totalMass += b.Mass[i];
+		if (b.Mass[i] > b.Mass[central])
+			central = i;
+	}
+	const double centralMass = b.Mass[central];
+	if (centralMass <= 0.0)
+	{
+		// nothing to orbit
+		this->updateShared(dt);
+		return;
+	}
+	if (b.Id[central] != this->centralId)
+	{
+		this->centralId = b.Id[central];
+		this->accelerationsValid = false;
+	}
+	glm::dvec3 barycentre(0.0), barycentreVelocity(0.0);
+	for (size_t i = 0; i < n; ++i)
+	{
+		barycentre += b.Mass[i] * b.Position(i);
+		barycentreVelocity += b.Mass[i] * b.Velocity(i);
+	}
+	barycentre /= totalMass;
+	barycentreVelocity /= totalMass;
+
+	BodyStore &h = this->heliocentric;
+	h.Clear();
+	h.Reserve(n - 1);
+	this->heliocentricIndex.clear();
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (i == central)
+			continue;
+		h.Add(b.Position(i) - b.Position(central), b.Velocity(i) - barycentreVelocity, b.Mass[i], b.Radius[i], b.Color[i]);
+		h.AX.back() = b.AX[i]; h.AY.back() = b.AY[i]; h.AZ.back() = b.AZ[i];
+		this->heliocentricIndex.push_back(i);
+	}
+	const size_t count = h.Size();
+	this->heliocentricMu.assign(count, this->gravity.G * centralMass);
+	if (!this->accelerationsValid)
+		this->computeHeliocentricAccelerations();
+
+	const double half = 0.5 * dt;
+	for (size_t k = 0; k < count; ++k)
+	{
+		h.VX[k] += half * h.AX[k];
+		h.VY[k] += half * h.AY[k];
+		h.VZ[k] += half * h.AZ[k];
+	}
+	for (int jump = 0; jump < 2; ++jump)
+	{
+		// the central body's barycentric momentum, -sum m_i V_i, moves everybody else
+		glm::dvec3 momentum(0.0);
+		for (size_t k = 0; k < count; ++k)
+			momentum += h.Mass[k] * glm::dvec3(h.VX[k], h.VY[k], h.VZ[k]);
+		glm::dvec3 shift = half * momentum / centralMass;
+		for (size_t k = 0; k < count; ++k)
+		{
+			h.X[k] += shift.x;
+			h.Y[k] += shift.y;
+			h.Z[k] += shift.z;
+		}
+		if (jump == 0 && count > 0)
+			KeplerDriftBatch(&this->heliocentricMu[0], &h.X[0], &h.Y[0], &h.Z[0], &h.VX[0], &h.VY[0], &h.VZ[0], count, dt);
+	}
+	this->computeHeliocentricAccelerations();
+	for (size_t k = 0; k < count; ++k)
+	{
+		h.VX[k] += half * h.AX[k];
+		h.VY[k] += half * h.AY[k];
+		h.VZ[k] += half * h.AZ[k];
+	}
+
+	// back to absolute coordinates; the barycentre moves uniformly
+	barycentre += dt * barycentreVelocity;
+	glm::dvec3 weighted(0.0), momentum(0.0);
+	for (size_t k = 0; k < count; ++k)
+	{
+		weighted += h.Mass[k] * h.Position(k);
+		momentum += h.Mass[k] * h.Velocity(k);
+	}
+	glm::dvec3 centralPosition = barycentre - weighted / totalMass;
+	glm::dvec3 centralVelocity = barycentreVelocity - momentum / centralMass;
+	b.X[central] = centralPosition.x; b.Y[central] = centralPosition.y; b.Z[central] = centralPosition.z;
+	b.VX[central] = centralVelocity.x; b.VY[central] = centralVelocity.y; b.VZ[central] = centralVelocity.z;
+	b.AX[central] = b.AY[central] = b.AZ[central] = 0.0;
+	for (size_t k = 0; k < count; ++k)
+	{
+		GLuint i = this->heliocentricIndex[k];
+		b.X[i] = h.X[k] + centralPosition.x; b.Y[i] = h.Y[k] + centralPosition.y; b.Z[i] = h.Z[k] + centralPosition.z;
+		b.VX[i] = h.VX[k] + barycentreVelocity.x; b.VY[i] = h.VY[k] + barycentreVelocity.y; b.VZ[i] = h.VZ[k] + barycentreVelocity.z;
+		b.AX[i] = h.AX[k]; b.AY[i] = h.AY[k]; b.AZ[i] = h.AZ[k];
+	}
+}
+
+void PlanetSystem::computeHeliocentricAccelerations()
+{
+	BodyStore &h = this->heliocentric;
+	if (h.Size() > 0)
+		DirectAccelerations(h, this->gravity, 0, h.Size(), &h.AX[0], &h.AY[0], &h.AZ[0]);
+	this->forceEvaluations += h.Size();
+	this->accelerationsValid = true;
+}
+
+// Contacts are handled in time-of-impact order and every body takes part in at
+// most one collision per step; a merged body can collide again next step.
+void PlanetSystem::resolveCollisions(double dt)
+{
+	this->collisionsLastStep = 0;
+	if (this->collisionResponse == COLLISION_NONE)
+		return;
+	BodyStore &b = this->bodies;
+	FindContacts(b, dt, this->collisionHash, this->contacts);
+	if (this->contacts.empty())
+		return;
+	// 1 = collided this step, 2 = merged away
+	this->collided.assign(b.Size(), 0);
+	for (size_t c = 0; c < this->contacts.size(); ++c)
+	{
+		GLuint i = this->contacts[c].First, j = this->contacts[c].Second;
+		if (this->collided[i] || this->collided[j])
+			continue;
+		this->collided[i] = this->collided[j] = 1;
+		this->collisionsLastStep++;
+		// weigh by mass, or by volume for massless tracer bodies
+		double ri = b.Radius[i], rj = b.Radius[j];
+		double wi = b.Mass[i], wj = b.Mass[j];
+		if (wi + wj <= 0.0)
 		{
-			for (int x = X_SEGMENTS; x >= 0; --x)
+			wi = ri * ri * ri;
+			wj = rj * rj * rj;
+		}
+		if (wi + wj <= 0.0)
+			wi = wj = 1.0;
+		glm::dvec3 xi = b.Position(i), xj = b.Position(j), vi = b.Velocity(i), vj = b.Velocity(j);
+		if (this->collisionResponse == COLLISION_BOUNCE)
+		{
+			// rewind to the time of impact, exchange the normal impulse, then move on
+			double remaining = dt - this->contacts[c].Time;
+			glm::dvec3 ci = xi - vi * remaining, cj = xj - vj * remaining;
+			glm::dvec3 normal = cj - ci;
+			double distance = glm::length(normal);
+			normal = distance > 0.0 ? normal / distance : glm::dvec3(1.0, 0.0, 0.0);
+			double vn = glm::dot(vj - vi, normal);
+			if (vn < 0.0)
 			{
-				indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-				indices.push_back(y       * (X_SEGMENTS + 1) + x);
+				double impulse = -(1.0 + this->restitution) * vn / (1.0 / wi + 1.0 / wj);
+				vi -= normal * (impulse / wi);
+				vj += normal * (impulse / wj);
 			}
+			// bodies that already overlapped at the start are pushed apart to touching
+			double overlap = ri + rj - distance;
+			if (overlap > 0.0)
+			{
+				ci -= normal * (overlap * wj / (wi + wj));
+				cj += normal * (overlap * wi / (wi + wj));
+			}
+			xi = ci + vi * remaining;
+			xj = cj + vj * remaining;
+			b.X[i] = xi.x; b.Y[i] = xi.y; b.Z[i] = xi.z;
+			b.X[j] = xj.x; b.Y[j] = xj.y; b.Z[j] = xj.z;
+			b.VX[i] = vi.x; b.VY[i] = vi.y; b.VZ[i] = vi.z;
+			b.VX[j] = vj.x; b.VY[j] = vj.y; b.VZ[j] = vj.z;
+			continue;
+		}
+		// merge (and fragment): the combined body replaces the heavier one
+		GLuint keep = wi >= wj ? i : j, gone = wi >= wj ? j : i;
+		double w = wi + wj;
+		glm::dvec3 position = (xi * wi + xj * wj) / w;
+		glm::dvec3 velocity = (vi * wi + vj * wj) / w;
+		if (this->collisionResponse == COLLISION_FRAGMENT && this->debrisGenerator != nullptr)
+		{
+			glm::dvec3 contact = xi + (xj - xi) * (ri + rj > 0.0 ? ri / (ri + rj) : 0.5);
+			GLfloat impactSpeed = (GLfloat)glm::length(vj - vi);
+			this->debrisGenerator->SpawnDebris(glm::vec3(contact), glm::vec3(velocity), 0.5f * impactSpeed, 20);
 		}
-		oddRow = !oddRow;
+		b.X[keep] = position.x; b.Y[keep] = position.y; b.Z[keep] = position.z;
+		b.VX[keep] = velocity.x; b.VY[keep] = velocity.y; b.VZ[keep] = velocity.z;
+		b.Mass[keep] = b.Mass[i] + b.Mass[j];
+		b.Radius[keep] = std::cbrt(ri * ri * ri + rj * rj * rj);
+		b.Color[keep] = (b.Color[i] * (GLfloat)wi + b.Color[j] * (GLfloat)wj) / (GLfloat)w;
+		this->collided[gone] = 2;
+	}
+	// remove merged bodies from the back so swap-removal never moves a removed body
+	for (size_t i = b.Size(); i-- > 0;)
+	{
+		if (this->collided[i] == 2)
+			b.Remove(i);
+	}
+	this->stepLevel.resize(b.Size());
+	this->accelerationsValid = false;
+}
+
+void PlanetSystem::activateAll()
+{
+	const size_t n = this->bodies.Size();
+	this->activeBodies.clear();
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (!this->analytic[i])
+			this->activeBodies.push_back(i);
+	}
+}
+
+void PlanetSystem::activateFinishing(unsigned long long tick, GLuint topLevel)
+{
+	const size_t n = this->bodies.Size();
+	this->activeBodies.clear();
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (!this->analytic[i] && tick % (1ull << (topLevel - this->stepLevel[i])) == 0)
+			this->activeBodies.push_back(i);
+	}
+}
+
+unsigned long long PlanetSystem::nextBlockTick(unsigned long long tick, GLuint topLevel) const
+{
+	GLuint finest = 0;
+	for (size_t i = 0; i < this->stepLevel.size(); ++i)
+	{
+		if (this->stepLevel[i] > finest)
+			finest = this->stepLevel[i];
 	}
-	this->indexCount = indices.size();
+	unsigned long long stride = 1ull << (topLevel - finest);
+	return (tick / stride + 1) * stride;
+}
 
-	std::vector<float> data;
-	for (int i = 0; i < positions.size(); ++i)
+GLuint PlanetSystem::chooseLevel(size_t i, double dt, unsigned long long tick) const
+{
+	const BodyStore &b = this->bodies;
+	double a = glm::length(b.Acceleration(i));
+	double j = glm::length(glm::dvec3(b.JX[i], b.JY[i], b.JZ[i]));
+	double step = (a > 0.0 && j > 0.0) ? this->timestepEta * a / j : dt;
+	GLuint level = 0;
+	while (level < this->maxLevel && dt / (double)(1ull << level) > step)
+		++level;
+	// a coarser step may only start on a tick that is a multiple of it
+	while (level < this->maxLevel && tick % (1ull << (this->maxLevel - level)) != 0)
+		++level;
+	return level;
+}
+
+void PlanetSystem::computeAccelerations()
+{
+	BodyStore &b = this->bodies;
+	if (b.Size() > 0)
 	{
-		data.push_back(positions[i].x);
-		data.push_back(positions[i].y);
-		data.push_back(positions[i].z);
-		if (uv.size() > 0)
+		if (this->gravityBackend == GRAVITY_DIRECT)
 		{
-			data.push_back(uv[i].x);
-			data.push_back(uv[i].y);
+			// only the runs of numerically integrated bodies
+			const size_t n = b.Size();
+			for (size_t begin = 0, end; begin < n; begin = end)
+			{
+				for (end = begin; end < n && !this->analytic[end]; ++end)
+					;
+				if (end > begin)
+					DirectAccelerations(b, this->gravity, begin, end, &b.AX[0], &b.AY[0], &b.AZ[0]);
+				else
+					++end;
+			}
 		}
-		if (normals.size() > 0)
+		else if (this->gravityBackend == GRAVITY_FMM)
+			this->fastMultipole.ComputeAccelerations(b, this->gravity, &b.AX[0], &b.AY[0], &b.AZ[0]);
+		else
+			this->particleMesh.ComputeAccelerations(b, this->gravity, &b.AX[0], &b.AY[0], &b.AZ[0]);
+	}
+	this->forceEvaluations += this->bodies.Size() - this->keplerIndex.size();
+	this->accelerationsValid = true;
+}
+
+void PlanetSystem::computeActiveAccelerationsJerks()
+{
+	BodyStore &b = this->bodies;
+	if (!this->activeBodies.empty())
+		DirectAccelerationsJerks(b, this->gravity, &this->activeBodies[0], this->activeBodies.size(),
+			&b.AX[0], &b.AY[0], &b.AZ[0], &b.JX[0], &b.JY[0], &b.JZ[0]);
+	this->forceEvaluations += this->activeBodies.size();
+	this->accelerationsValid = true;
+}
+
+unsigned int PlanetSystem::AddPlanet(const Planet &planet)
+{
+	this->accelerationsValid = false;
+	this->stepLevel.push_back(0);
+	if (this->diagnostics != nullptr)
+		this->diagnostics->ResetReference();
+	size_t index = this->bodies.Add(planet.Position, planet.Velocity, planet.Mass, planet.Scale, planet.Color);
+	return this->bodies.Id[index];
+}
+
+size_t PlanetSystem::appendBodies(size_t count)
+{
+	this->accelerationsValid = false;
+	this->stepLevel.resize(this->stepLevel.size() + count, 0);
+	if (this->diagnostics != nullptr)
+		this->diagnostics->ResetReference();
+	return this->bodies.AddBulk(count);
+}
+
+void PlanetSystem::Draw(const RenderView &view)
+{
+	// Gather camera-relative bounding spheres (the subtraction happens in double,
+	// so only the small offsets are rounded to float) and batch-cull them
+	const BodyStore &b = this->playback != nullptr ? this->playbackBodies : this->bodies;
+	GLuint count = b.Size();
+	this->cullX.resize(count);
+	this->cullY.resize(count);
+	this->cullZ.resize(count);
+	this->cullRadius.resize(count);
+	this->visibleIndices.resize(count);
+	this->drawMotion.resize(count);
+	++this->drawFrame;
+	for (GLuint i = 0; i < count; ++i)
+	{
+		this->cullX[i] = (GLfloat)(b.X[i] - view.Origin.x);
+		this->cullY[i] = (GLfloat)(b.Y[i] - view.Origin.y);
+		this->cullZ[i] = (GLfloat)(b.Z[i] - view.Origin.z);
+		this->cullRadius[i] = (GLfloat)b.Radius[i];
+		// displacement since the previous Draw; bodies that were not there yet have none
+		unsigned int id = b.Id[i];
+		if (id >= this->drawnFrame.size())
 		{
-			data.push_back(normals[i].x);
-			data.push_back(normals[i].y);
-			data.push_back(normals[i].z);
+			this->drawnPosition.resize(id + 1);
+			this->drawnFrame.resize(id + 1, 0);
 		}
+		glm::dvec3 position(b.X[i], b.Y[i], b.Z[i]);
+		this->drawMotion[i] = this->drawnFrame[id] + 1 == this->drawFrame ? glm::vec3(position - this->drawnPosition[id]) : glm::vec3(0.0f);
+		this->drawnPosition[id] = position;
+		this->drawnFrame[id] = this->drawFrame;
+	}
+	GLuint visible = count > 0 ? view.ViewFrustum.CullSpheres(&this->cullX[0], &this->cullY[0], &this->cullZ[0], &this->cullRadius[0], count, &this->visibleIndices[0]) : 0;
+	this->cullStats.Visible = visible;
+	this->cullStats.Culled = count - visible;
+
+	// Bucket the visible planets by projected size and draw each level instanced
+	this->sphereLOD.Begin();
+	for (GLuint i = 0; i < visible; ++i)
+	{
+		GLuint index = this->visibleIndices[i];
+		this->sphereLOD.Add(view, SphereInstance(glm::vec3(this->cullX[index], this->cullY[index], this->cullZ[index]), this->cullRadius[index], b.Color[index], this->drawMotion[index]));
 	}
-	glBindVertexArray(this->sphereVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-	float stride = (3 + 2 + 3 ) * sizeof(float);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(float)));
-
-	glBindVertexArray(0);
+	this->sphereLOD.Draw(view, this->shader, this->impostorShader);
+}
+
+void PlanetSystem::init()
+{
+	this->sphereLOD.Init();
 
 	this->amout = 50;
-	for (int i = 0; i < this->amout; i++)
+	PlanetarySystemParams params;
+	params.Planets = this->amout - 1;
+	params.PlanetRadius = 0.1;
+	const uint64_t seed = ((uint64_t)this->rng.NextUInt() << 32) | this->rng.NextUInt();
+	this->AddBodies(params.BodyCount(), [this, &params, seed](BodyStore &bodies, size_t first) {
+		GeneratePlanetarySystem(params, this->gravity, seed, bodies, first);
+	});
+}
+
+void PlanetSystem::SaveCheckpoint(CheckpointWriter &writer) const
+{
+	PlanetSystemSettings settings;
+	std::memset(&settings, 0, sizeof(settings));
+	settings.Time = this->time;
+	settings.G = this->gravity.G;
+	settings.Softening = this->gravity.Softening;
+	settings.TimestepEta = this->timestepEta;
+	settings.Restitution = this->restitution;
+	settings.KeplerThreshold = this->keplerThreshold;
+	settings.OpeningAngle = this->fastMultipole.OpeningAngle();
+	settings.ForceEvaluations = this->forceEvaluations;
+	settings.IdCount = this->bodies.IdCount();
+	settings.Integrator = this->integrator;
+	settings.Backend = this->gravityBackend;
+	settings.BlockTimesteps = this->blockTimesteps;
+	settings.MaxLevel = this->maxLevel;
+	settings.SortInterval = this->sortInterval;
+	settings.UpdatesSinceSort = this->updatesSinceSort;
+	settings.CollisionResponse = this->collisionResponse;
+	settings.KeplerCheckInterval = this->keplerCheckInterval;
+	settings.UpdatesSinceKeplerCheck = this->updatesSinceKeplerCheck;
+	settings.CentralId = this->centralId;
+	settings.AccelerationsValid = this->accelerationsValid;
+	settings.GridSize = this->particleMesh.GridSize();
+	settings.MultipoleOrder = this->fastMultipole.Order();
+	writer.AddValue(CHECKPOINT_SETTINGS, settings);
+	writer.AddValue(CHECKPOINT_RNG, this->rng.State());
+	writer.AddArray(CHECKPOINT_STEP_LEVELS, this->stepLevel);
+	WriteBodyStore(writer, CHECKPOINT_BODIES, this->bodies);
+	// Hermite start-of-step state is only meaningful with matching accelerations
+	if (this->integrator == INTEGRATOR_HERMITE && this->stepStart.Size() == this->bodies.Size())
+		WriteBodyStore(writer, CHECKPOINT_STEP_START, this->stepStart);
+	// Kepler bindings as (id, primary id, analytic) triples
+	std::vector<uint32_t> kepler;
+	for (size_t k = 0; k < this->keplerBodies.size(); ++k)
 	{
-		this->planets.push_back(Planet());
-		(*this->planets.rbegin()).Position = glm::vec3(rand() % 100 / 100.0f - 0.5f,
-			rand() % 100 / 100.0f - 0.5f,
-			rand() % 100 / 100.0f - 0.5f) * 10.0f;
+		kepler.push_back(this->keplerBodies[k].Id);
+		kepler.push_back(this->keplerBodies[k].PrimaryId);
+		kepler.push_back(this->keplerBodies[k].Analytic ? 1 : 0);
+	}
+	writer.AddArray(CHECKPOINT_KEPLER_BODIES, kepler);
+}
 
+// Whether the scalar state and step levels read from a checkpoint are in the
+// ranges the setters would produce; anything else (a corrupt or crafted file)
+// would index enums out of range, shift by more than 63 bits or allocate an
+// unbounded mesh
+static bool validSettings(const PlanetSystemSettings &settings, const std::vector<GLuint> &levels)
+{
+	if (settings.Integrator > INTEGRATOR_WISDOM_HOLMAN || settings.Backend > GRAVITY_FMM || settings.CollisionResponse > COLLISION_FRAGMENT)
+		return false;
+	if (settings.MaxLevel > MAX_TIMESTEP_LEVEL || settings.GridSize > ParticleMesh::MAX_GRID_SIZE)
+		return false;
+	// ids are 32 bit, and the id index is allocated for IdCount of them
+	if (settings.IdCount > (uint64_t)UINT32_MAX + 1)
+		return false;
+	// FastMultipole needs theta in (0, 1) so a cell never accepts a cell containing it
+	if (!(settings.OpeningAngle > 0.0 && settings.OpeningAngle < 1.0))
+		return false;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		if (levels[i] > settings.MaxLevel)
+			return false;
 	}
-}
\ No newline at end of file
+	return true;
+}
+
+bool PlanetSystem::LoadCheckpoint(const CheckpointReader &reader)
+{
+	PlanetSystemSettings settings;
+	RandomState rngState = this->rng.State();
+	std::vector<GLuint> levels;
+	std::vector<uint32_t> kepler;
+	BodyStore loaded, loadedStart;
+	if (!reader.ReadValue(CHECKPOINT_SETTINGS, settings) || !reader.ReadArray(CHECKPOINT_STEP_LEVELS, levels) || !validSettings(settings, levels)
+		|| !ReadBodyStore(reader, CHECKPOINT_BODIES, (size_t)settings.IdCount, loaded) || levels.size() != loaded.Size()
+		|| !reader.ReadArray(CHECKPOINT_KEPLER_BODIES, kepler) || kepler.size() % 3 != 0)
+	{
+		std::cout << "ERROR::CHECKPOINT: Planet system state is missing or inconsistent" << std::endl;
+		return false;
+	}
+	// version 1 stored the seed of rand(), whose sequence cannot be continued
+	uint32_t legacySeed;
+	if (reader.Version() < 2 && reader.ReadValue(CHECKPOINT_RNG, legacySeed))
+		rngState = Random(legacySeed).State();
+	else
+		reader.ReadValue(CHECKPOINT_RNG, rngState);
+	bool hasStepStart = ReadBodyStore(reader, CHECKPOINT_STEP_START, (size_t)settings.IdCount, loadedStart) && loadedStart.Size() == loaded.Size();
+
+	// levels only matter with block timesteps; without them Hermite expects every body on level 0
+	if (settings.BlockTimesteps == 0)
+		levels.assign(levels.size(), 0);
+
+	this->bodies = loaded;
+	this->stepLevel = levels;
+	this->stepStart = hasStepStart ? loadedStart : BodyStore();
+	this->time = settings.Time;
+	this->gravity.G = settings.G;
+	this->gravity.Softening = settings.Softening;
+	this->timestepEta = settings.TimestepEta;
+	this->restitution = settings.Restitution;
+	this->keplerThreshold = settings.KeplerThreshold;
+	this->forceEvaluations = settings.ForceEvaluations;
+	this->integrator = (IntegratorType)settings.Integrator;
+	this->gravityBackend = (GravityBackend)settings.Backend;
+	this->blockTimesteps = settings.BlockTimesteps != 0;
+	this->maxLevel = settings.MaxLevel;
+	this->sortInterval = settings.SortInterval;
+	this->updatesSinceSort = settings.UpdatesSinceSort;
+	this->collisionResponse = (CollisionResponse)settings.CollisionResponse;
+	this->keplerCheckInterval = settings.KeplerCheckInterval;
+	this->updatesSinceKeplerCheck = settings.UpdatesSinceKeplerCheck;
+	this->centralId = settings.CentralId;
+	this->particleMesh.SetGridSize(settings.GridSize);
+	this->particleMesh.SetShortRange(this->gravityBackend == GRAVITY_P3M);
+	this->fastMultipole.SetOrder(settings.MultipoleOrder);
+	this->fastMultipole.SetOpeningAngle(settings.OpeningAngle);
+	this->keplerBodies.clear();
+	for (size_t k = 0; k < kepler.size(); k += 3)
+	{
+		KeplerBody body;
+		body.Id = kepler[k];
+		body.PrimaryId = kepler[k + 1];
+		body.Analytic = kepler[k + 2] != 0;
+		this->keplerBodies.push_back(body);
+	}
+	// the saved accelerations (and Hermite start states) continue the run exactly
+	this->accelerationsValid = settings.AccelerationsValid != 0 && (this->integrator != INTEGRATOR_HERMITE || hasStepStart);
+	this->rng = Random(rngState);
+	// a different run: measure the energy error from the restored state
+	if (this->diagnostics != nullptr)
+	{
+		this->diagnostics->ResetReference();
+		this->updatesSinceDiagnostics = 0;
+		this->sampleDiagnostics();
+	}
+	return true;
+}
@@ -5,30 +5,264 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <shader.h>
+#include <render_view.h>
+#include <sphere_lod.h>
+#include <body_store.h>
+#include <gravity.h>
+#include <collision.h>
+#include <morton.h>
+#include <particle_mesh.h>
+#include <fast_multipole.h>
+#include <kepler.h>
+#include <random.h>
+#include <initial_conditions.h>
+#include <checkpoint.h>
+#include <trajectory.h>
+#include <trajectory_playback.h>
+#include <diagnostics.h>
+#include <particle_generator.h>
 #include <vector>
 #include <map>
 #include <string>
 
+// Time integration schemes offered by PlanetSystem
+enum IntegratorType {
+	// Kick-drift-kick leapfrog: second order, symplectic with shared steps
+	INTEGRATOR_LEAPFROG,
+	// 4th-order Hermite predictor-corrector using accelerations and jerks
+	INTEGRATOR_HERMITE,
+	// Wisdom-Holman map in democratic heliocentric coordinates: Kepler drifts
+	// around the most massive body plus interaction kicks; symplectic with
+	// much larger steps than leapfrog for star-dominated systems. Always uses
+	// shared steps and direct summation of the interactions.
+	INTEGRATOR_WISDOM_HOLMAN
+};
+
+// Force solvers offered by PlanetSystem for the shared-step leapfrog.
+// Hermite and block timesteps need jerks and always sum directly.
+enum GravityBackend {
+	// O(N^2) direct summation
+	GRAVITY_DIRECT,
+	// Particle-mesh: cloud-in-cell deposit and FFT Poisson solve, O(N + G^3 log G)
+	GRAVITY_PM,
+	// Particle-mesh for the long-range part plus direct short-range pairs
+	GRAVITY_P3M,
+	// Fast multipole method, O(N) with configurable expansion order
+	GRAVITY_FMM
+};
+
+// Deepest block timestep level: the root step is split into at most 2^30 ticks
+const GLuint MAX_TIMESTEP_LEVEL = 30;
+
+// Initial state of a single body, used to add bodies to the system.
+// The simulation itself keeps its state in the SoA BodyStore.
 struct Planet {
-	glm::vec3 Position, Velocity;
-	GLfloat Scale;
-	GLfloat Mass;
+	glm::dvec3 Position, Velocity;
+	GLdouble Scale; // radius
+	GLdouble Mass;
 	glm::vec4 Color;
-	Planet() :Position(0.0f), Scale(1.0f), Mass(0.0f), Color(1.0f) {}
+	Planet() :Position(0.0), Velocity(0.0), Scale(1.0), Mass(0.0), Color(1.0f) {}
 };
 
 class PlanetSystem
 {
 public:
-	PlanetSystem(Shader shader);
+	// The initial bodies (and everything else random in the system) come from seed
+	PlanetSystem(Shader shader, Shader impostorShader, uint64_t seed = 1);
+	// Advances the simulation by dt in double precision with the scheme chosen by
+	// SetIntegrator: Wisdom-Holman, Hermite, or leapfrog with shared steps or (after
+	// SetBlockTimesteps) power-of-two block steps. With block timesteps enabled dt is
+	// the root step that every body's step divides.
 	void Update(GLfloat dt);
-	void Draw();
+	// Draws the planets whose bounding spheres intersect the view frustum,
+	// bucketed into instanced draws by level of detail. Positions are sent to
+	// the GPU as float offsets from the view's origin.
+	void Draw(const RenderView &view);
+	// Adds a body and returns its stable id. Body indices change when bodies
+	// are re-sorted or removed; use Bodies().IndexOf(id) to find it again.
+	unsigned int AddPlanet(const Planet &planet);
+	// Bulk loading: appends count bodies with consecutive ids and lets
+	// fill(BodyStore &, size_t first) write their state in place, e.g. with
+	// one of the initial-condition generators. Returns the first new id.
+	template <typename Fill>
+	unsigned int AddBodies(size_t count, Fill fill)
+	{
+		const size_t first = this->appendBodies(count);
+		fill(this->bodies, first);
+		return count > 0 ? this->bodies.Id[first] : (unsigned int)this->bodies.IdCount();
+	}
+	const BodyStore &Bodies() const { return this->bodies; }
+	const GravityParams &Gravity() const { return this->gravity; }
+	// Simulated time since the start of the run
+	double Time() const { return this->time; }
+	void SetGravity(const GravityParams &params) { this->gravity = params; this->accelerationsValid = false; }
+	// Selects the integration scheme used by Update
+	void SetIntegrator(IntegratorType integrator) { this->integrator = integrator; this->accelerationsValid = false; }
+	// Selects the force solver; gridSize is the number of mesh cells per axis of the mesh backends
+	void SetGravityBackend(GravityBackend backend, GLuint gridSize = 64);
+	// Expansion order and opening angle of GRAVITY_FMM
+	void SetMultipoleAccuracy(GLuint order, double theta = 0.5);
+	// Enables power-of-two block timesteps (for either integrator): each body steps with dt / 2^level, where the
+	// level (at most maxLevel, itself at most MAX_TIMESTEP_LEVEL) comes from the criterion eta * |a| / |jerk|, and only the
+	// bodies finishing a step on a sub-step get their forces recomputed.
+	void SetBlockTimesteps(bool enabled, GLuint maxLevel = 10, double eta = 0.02);
+	// Configures how touching bodies are resolved after every step; restitution
+	// is the coefficient used by COLLISION_BOUNCE (1 = elastic)
+	void SetCollisionResponse(CollisionResponse response, double restitution = 0.5) { this->collisionResponse = response; this->restitution = restitution; }
+	// Receives the debris of COLLISION_FRAGMENT (may be nullptr)
+	void SetDebrisGenerator(ParticleGenerator *generator) { this->debrisGenerator = generator; }
+	// Number of collisions resolved in the last Update
+	GLuint CollisionsLastStep() const { return this->collisionsLastStep; }
+	// Advances body `id` analytically on a Kepler orbit around body `primaryId`
+	// (ids as returned by AddPlanet) while the other bodies perturb the pair's
+	// relative motion by less than the Kepler threshold; above it the body is
+	// integrated numerically until the perturbation falls below half the threshold
+	void SetKeplerPrimary(unsigned int id, unsigned int primaryId);
+	// Returns the body to plain numerical integration
+	void ClearKeplerPrimary(unsigned int id);
+	// Perturbation |relative acceleration - Kepler term| / |Kepler term| at which
+	// Kepler bodies switch to numerical integration, checked every `interval` updates
+	void SetKeplerThreshold(double threshold, GLuint interval = 8) { this->keplerThreshold = threshold; this->keplerCheckInterval = interval > 0 ? interval : 1; }
+	// Number of bodies advanced analytically in the last Update
+	GLuint KeplerBodiesLastStep() const { return (GLuint)this->keplerIndex.size(); }
+	// Re-sorts the bodies into Morton order every `steps` updates (0 disables)
+	void SetSortInterval(GLuint steps) { this->sortInterval = steps; }
+	// Records the current state into writer and then every `interval` updates (nullptr stops recording)
+	void SetTrajectoryWriter(TrajectoryWriter *writer, GLuint interval = 1);
+	// Samples the energy, momentum and angular momentum into log now and then
+	// every `interval` updates (nullptr stops). The potential comes from the
+	// solver that produces the forces (the gravity backend with shared-step
+	// leapfrog, direct summation otherwise), so a sample costs about one force
+	// evaluation and measures the integrator's error, not the solver's.
+	void SetDiagnostics(DiagnosticsLog *log, GLuint interval = 16);
+	// While a playback is set, Update advances it instead of the simulation and
+	// Draw shows its interpolated bodies; nullptr resumes the simulation where it was
+	void SetPlayback(TrajectoryPlayback *playback);
+	// Appends the complete simulation state (bodies, integrator and solver
+	// settings, Kepler bindings, RNG position) to a checkpoint snapshot
+	void SaveCheckpoint(CheckpointWriter &writer) const;
+	// Restores a state saved by SaveCheckpoint; leaves the system unchanged on failure
+	bool LoadCheckpoint(const CheckpointReader &reader);
+	// Number of per-body force evaluations since the start of the run
+	unsigned long long ForceEvaluations() const { return this->forceEvaluations; }
+	// Visible/culled counts of the last Draw call
+	const CullStats &GetCullStats() const { return this->cullStats; }
+	// Draws every body as a ray traced impostor instead of choosing a mesh level
+	void SetImpostorsOnly(GLboolean impostorsOnly) { this->sphereLOD.ImpostorsOnly = impostorsOnly; }
 private:
-	std::vector<Planet> planets;
+	BodyStore bodies;
+	GravityParams gravity;
+	IntegratorType integrator;
+	GravityBackend gravityBackend;
+	ParticleMesh particleMesh;
+	FastMultipole fastMultipole;
+	double time;
+	// Whether bodies.AX/AY/AZ (and JX/JY/JZ in block mode) match the current state
+	bool accelerationsValid;
+	// Block timestep state
+	bool blockTimesteps;
+	GLuint maxLevel;
+	double timestepEta;
+	std::vector<GLuint> stepLevel;
+	std::vector<GLuint> activeBodies;
+	unsigned long long forceEvaluations;
+	// Wisdom-Holman: id of the central body, the democratic heliocentric
+	// state of the other bodies and the Kepler parameters of their drifts
+	unsigned int centralId;
+	BodyStore heliocentric;
+	std::vector<GLuint> heliocentricIndex;
+	std::vector<double> heliocentricMu;
+	// Hermite: state of every body at the start of its current step, and that step's start tick
+	BodyStore stepStart;
+	std::vector<unsigned long long> stepStartTick;
+	// Bodies bound to a Kepler primary, by id
+	struct KeplerBody {
+		unsigned int Id, PrimaryId;
+		bool Analytic;
+	};
+	std::vector<KeplerBody> keplerBodies;
+	double keplerThreshold;
+	GLuint keplerCheckInterval;
+	GLuint updatesSinceKeplerCheck;
+	// 1 for the bodies advanced analytically in the current update, by index
+	std::vector<char> analytic;
+	// The analytic bodies of the current update, their primaries and their
+	// state relative to the primary (SoA for the batched Kepler solver)
+	std::vector<GLuint> keplerIndex, keplerPrimary;
+	std::vector<double> keplerMu, keplerX, keplerY, keplerZ, keplerVX, keplerVY, keplerVZ;
+	// Morton re-sorting
+	GLuint sortInterval;
+	GLuint updatesSinceSort;
+	MortonSorter sorter;
+	std::vector<unsigned int> sortOrder;
+	// Collision handling
+	CollisionResponse collisionResponse;
+	double restitution;
+	ParticleGenerator *debrisGenerator;
+	SpatialHash collisionHash;
+	std::vector<Contact> contacts;
+	std::vector<char> collided;
+	GLuint collisionsLastStep;
+	// Trajectory recording
+	TrajectoryWriter *trajectoryWriter;
+	GLuint trajectoryInterval;
+	GLuint updatesSinceRecord;
+	// Conservation diagnostics and the potentials of the last sample, per unit mass
+	DiagnosticsLog *diagnostics;
+	GLuint diagnosticsInterval;
+	GLuint updatesSinceDiagnostics;
+	std::vector<double> potential;
+	// Trajectory playback and the bodies it shows
+	TrajectoryPlayback *playback;
+	BodyStore playbackBodies;
 	GLuint amout;
+	Random rng;
+	// Culling scratch buffers (bounding spheres as SoA for the batch test)
+	std::vector<GLfloat> cullX, cullY, cullZ, cullRadius;
+	std::vector<GLuint> visibleIndices;
+	CullStats cullStats;
+	// Where each body id was last drawn and on which Draw (0 = never), for
+	// motion vectors; drawMotion holds this Draw's displacements by index
+	std::vector<glm::dvec3> drawnPosition;
+	std::vector<GLuint> drawnFrame;
+	std::vector<glm::vec3> drawMotion;
+	GLuint drawFrame;
 	Shader shader;
-	GLuint sphereVAO;
-	GLuint indexCount;
+	Shader impostorShader;
+	SphereLOD sphereLOD;
+	// Appends count zeroed bodies for AddBodies and returns the index of the first
+	size_t appendBodies(size_t count);
+	void computeAccelerations();
+	// Recomputes accelerations and jerks of the bodies in activeBodies
+	void computeActiveAccelerationsJerks();
+	void updateShared(double dt);
+	void updateBlock(double dt);
+	void updateHermite(double dt);
+	void updateWisdomHolman(double dt);
+	// Interaction accelerations of the heliocentric bodies (all but the central one)
+	void computeHeliocentricAccelerations();
+	// The force solver of the current integrator: Hermite, block timesteps and
+	// Wisdom-Holman always sum directly
+	GravityBackend activeBackend() const;
+	// Evaluates the potentials with the active backend and pushes a diagnostics sample
+	void sampleDiagnostics();
+	// Reorders the bodies and all per-body integrator state into Morton order
+	void sortBodies();
+	// Resolves the Kepler bindings to indices and stores the analytic bodies' relative states
+	void prepareKeplerBodies();
+	// Moves the analytic bodies along their orbits over dt around their primary's new state
+	void advanceKeplerBodies(double dt);
+	// Measures the perturbation of every Kepler body and switches it between analytic and numeric
+	void checkKeplerBodies();
+	// Detects and resolves the collisions of the step of length dt that just ended
+	void resolveCollisions(double dt);
+	// Marks every body active / the bodies whose step ends on tick
+	void activateAll();
+	void activateFinishing(unsigned long long tick, GLuint topLevel);
+	// Next tick on which the step of the finest populated level ends
+	unsigned long long nextBlockTick(unsigned long long tick, GLuint topLevel) const;
+	// Level for body i after finishing a step at sub-step tick of a root step dt
+	GLuint chooseLevel(size_t i, double dt, unsigned long long tick) const;
 	void init();
 };
-#endif
\ No newline at end of file
+#endif
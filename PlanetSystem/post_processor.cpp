@@ -10,104 +10,261 @@
 
 #include <iostream>
 
-PostProcessor::PostProcessor(Shader shader, GLuint width, GLuint height)
-	: PostProcessingShader(shader), Texture(), Width(width), Height(height), Confuse(GL_FALSE), Chaos(GL_FALSE), Shake(GL_FALSE)
+// Fewest texels along either side of the smallest bloom mip, and the most mips
+static const GLuint BLOOM_MIN_SIZE = 8;
+static const GLuint BLOOM_MAX_MIPS = 6;
+// Length of the jitter sequence; every pixel is covered by this many distinct subpixel positions
+static const GLuint JITTER_SAMPLES = 8;
+
+// Element index of the Halton low discrepancy sequence in base, in [0, 1)
+static GLfloat halton(GLuint index, GLuint base)
 {
-	// Initialize renderbuffer/framebuffer object
+	GLfloat result = 0.0f, fraction = 1.0f;
+	while (index > 0)
+	{
+		fraction /= base;
+		result += fraction * (index % base);
+		index /= base;
+	}
+	return result;
+}
+
+PostProcessor::PostProcessor(Shader shader, Shader downsampleShader, Shader upsampleShader, Shader temporalShader, GLuint width, GLuint height, GLuint samples, AntiAliasing mode)
+	: PostProcessingShader(shader), DownsampleShader(downsampleShader), UpsampleShader(upsampleShader), TemporalShader(temporalShader), Texture(), Width(width), Height(height),
+	RenderWidth(width), RenderHeight(height), RenderScale(1.0f), Samples(samples), Mode(mode),
+	Exposure(1.0f), Bloom(GL_TRUE), BloomThreshold(1.0f), BloomKnee(0.5f), BloomIntensity(0.05f), BloomRadius(1.0f), TemporalFeedback(0.9f), Sharpness(0.5f),
+	historyIndex(0), historyValid(GL_FALSE), frameIndex(0), allocatedMode(mode)
+{
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	if (this->Samples > (GLuint)maxSamples)
+		this->Samples = (GLuint)maxSamples;
 	glGenFramebuffers(1, &this->MSFBO);
 	glGenFramebuffers(1, &this->FBO);
-	glGenRenderbuffers(1, &this->RBO);
-
-	// Initialize renderbuffer storage with a multisampled color buffer (don't need a depth/stencil buffer)
-	glBindFramebuffer(GL_FRAMEBUFFER, this->MSFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, this->RBO);
-	glRenderbufferStorageMultisample(GL_RENDERBUFFER, 8, GL_RGB, width, height); // Allocate storage for render buffer object
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->RBO); // Attach MS render buffer object to framebuffer
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "ERROR::POSTPROCESSOR: Failed to initialize MSFBO" << std::endl;
-
-	// Also initialize the FBO/texture to blit multisampled color-buffer to; used for shader operations (for postprocessing effects)
-	glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
-	this->Texture.Generate(width, height, NULL);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->Texture.ID, 0); // Attach texture to framebuffer as its color attachment
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "ERROR::POSTPROCESSOR: Failed to initialize FBO" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGenFramebuffers(2, this->historyFBO);
+	glGenFramebuffers(1, &this->bloomFBO);
+	glGenRenderbuffers(1, &this->colorRBO);
+	glGenRenderbuffers(1, &this->depthRBO);
+	this->Texture.Internal_Format = GL_RGBA16F;
+	this->Texture.Image_Format = GL_RGBA;
+	this->Texture.Wrap_S = GL_CLAMP_TO_EDGE;
+	this->Texture.Wrap_T = GL_CLAMP_TO_EDGE;
+	// motion vectors are read per pixel, never between pixels
+	this->motionTexture.Internal_Format = GL_RG16F;
+	this->motionTexture.Image_Format = GL_RG;
+	this->motionTexture.Wrap_S = GL_CLAMP_TO_EDGE;
+	this->motionTexture.Wrap_T = GL_CLAMP_TO_EDGE;
+	this->motionTexture.Filter_Min = GL_NEAREST;
+	this->motionTexture.Filter_Max = GL_NEAREST;
+	for (Texture2D &texture : this->history)
+	{
+		texture.Internal_Format = GL_RGBA16F;
+		texture.Image_Format = GL_RGBA;
+		texture.Wrap_S = GL_CLAMP_TO_EDGE;
+		texture.Wrap_T = GL_CLAMP_TO_EDGE;
+	}
+	this->allocateTargets();
 
 	// Initialize render data and uniforms
 	this->initRenderData();
 	this->PostProcessingShader.SetInteger("scene", 0, GL_TRUE);
-	GLfloat offset = 1.0f / 300.0f;
-	GLfloat offsets[9][2] = {
-		{ -offset,  offset },  // top-left
-	{ 0.0f,    offset },  // top-center
-	{ offset,  offset },  // top-right
-	{ -offset,  0.0f },  // center-left
-	{ 0.0f,    0.0f },  // center-center
-	{ offset,  0.0f },  // center - right
-	{ -offset, -offset },  // bottom-left
-	{ 0.0f,   -offset },  // bottom-center
-	{ offset, -offset }   // bottom-right    
-	};
-	glUniform2fv(glGetUniformLocation(this->PostProcessingShader.ID, "offsets"), 9, (GLfloat*)offsets);
-	GLint edge_kernel[9] = {
-		-1, -1, -1,
-		-1,  8, -1,
-		-1, -1, -1
-	};
-	glUniform1iv(glGetUniformLocation(this->PostProcessingShader.ID, "edge_kernel"), 9, edge_kernel);
-	GLfloat blur_kernel[9] = {
-		1.0 / 16, 2.0 / 16, 1.0 / 16,
-		2.0 / 16, 4.0 / 16, 2.0 / 16,
-		1.0 / 16, 2.0 / 16, 1.0 / 16
-	};
-	glUniform1fv(glGetUniformLocation(this->PostProcessingShader.ID, "blur_kernel"), 9, blur_kernel);
+	this->PostProcessingShader.SetInteger("bloom", 1);
+	this->DownsampleShader.SetInteger("source", 0, GL_TRUE);
+	this->UpsampleShader.SetInteger("source", 0, GL_TRUE);
+	this->TemporalShader.SetInteger("scene", 0, GL_TRUE);
+	this->TemporalShader.SetInteger("history", 1);
+	this->TemporalShader.SetInteger("motion", 2);
+}
+
+PostProcessor::~PostProcessor()
+{
+	glDeleteFramebuffers(1, &this->MSFBO);
+	glDeleteFramebuffers(1, &this->FBO);
+	glDeleteFramebuffers(2, this->historyFBO);
+	glDeleteRenderbuffers(1, &this->colorRBO);
+	glDeleteRenderbuffers(1, &this->depthRBO);
+	glDeleteTextures(1, &this->Texture.ID);
+	glDeleteTextures(1, &this->motionTexture.ID);
+	for (Texture2D &texture : this->history)
+		glDeleteTextures(1, &texture.ID);
+	glDeleteFramebuffers(1, &this->bloomFBO);
+	for (Texture2D &mip : this->bloomMips)
+		glDeleteTextures(1, &mip.ID);
+	glDeleteVertexArrays(1, &this->VAO);
+}
+
+void PostProcessor::Resize(GLuint width, GLuint height)
+{
+	// a minimized window has no pixels; keep the targets until it comes back
+	if (width == 0 || height == 0 || (width == this->Width && height == this->Height))
+		return;
+	this->Width = width;
+	this->Height = height;
+	this->allocateTargets();
+}
+
+void PostProcessor::SetRenderScale(GLfloat scale)
+{
+	this->RenderScale = glm::clamp(scale, 0.25f, 1.0f);
+	this->allocateTargets();
+}
+
+void PostProcessor::SetAntiAliasing(AntiAliasing mode)
+{
+	this->Mode = mode;
+	this->allocateTargets();
+}
+
+glm::mat4 PostProcessor::Jitter(const glm::mat4 &projection) const
+{
+	if (this->Mode != ANTIALIASING_TAA)
+		return projection;
+	// Halton(2, 3) offsets in [-0.5, 0.5) pixels, shifting clip space x and y by 2 * offset / size
+	GLuint index = this->frameIndex % JITTER_SAMPLES + 1;
+	glm::mat4 jittered = projection;
+	jittered[2][0] += 2.0f * (halton(index, 2) - 0.5f) / this->RenderWidth;
+	jittered[2][1] += 2.0f * (halton(index, 3) - 0.5f) / this->RenderHeight;
+	return jittered;
 }
 
 void PostProcessor::BeginRender()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, this->MSFBO);
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->Mode == ANTIALIASING_TAA ? this->FBO : this->MSFBO);
+	glViewport(0, 0, this->RenderWidth, this->RenderHeight);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (this->Mode == ANTIALIASING_TAA)
+	{
+		// nothing drawn, nothing moved
+		const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 1, zero);
+		// blending applies to motion vectors too; the frontmost surface's motion must
+		// replace what is behind it even where its color is blended (additive particles)
+		glDisablei(GL_BLEND, 1);
+	}
 }
+
 void PostProcessor::EndRender()
 {
-	// Now resolve multisampled color-buffer into intermediate FBO to store to texture
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, this->MSFBO);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->FBO);
-	glBlitFramebuffer(0, 0, this->Width, this->Height, 0, 0, this->Width, this->Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	// Resolve the multisampled color once; depth is not needed after the scene
+	if (this->Mode == ANTIALIASING_MSAA)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, this->MSFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->FBO);
+		glBlitFramebuffer(0, 0, this->RenderWidth, this->RenderHeight, 0, 0, this->RenderWidth, this->RenderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0); // Binds both READ and WRITE framebuffer to default framebuffer
 }
 
-void PostProcessor::Render(GLfloat time)
+void PostProcessor::Render()
 {
-	// Set uniforms/options
+	// every pixel is written exactly once
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glBindVertexArray(this->VAO);
+	const Texture2D *scene = &this->Texture;
+	if (this->Mode == ANTIALIASING_TAA)
+	{
+		this->resolveTemporal();
+		scene = &this->history[this->historyIndex];
+	}
+	if (this->Bloom)
+		this->renderBloom(*scene);
+	// the scene is upscaled to the window by the bilinear filter of its texture
+	glViewport(0, 0, this->Width, this->Height);
 	this->PostProcessingShader.Use();
-	this->PostProcessingShader.SetFloat("time", time);
-	this->PostProcessingShader.SetInteger("confuse", this->Confuse);
-	this->PostProcessingShader.SetInteger("chaos", this->Chaos);
-	this->PostProcessingShader.SetInteger("shake", this->Shake);
-	// Render textured quad
+	this->PostProcessingShader.SetFloat("exposure", this->Exposure);
+	// the upsample passes sum every mip of the chain, so keep the glow independent of its length
+	this->PostProcessingShader.SetFloat("bloomStrength", this->Bloom ? this->BloomIntensity / this->bloomMips.size() : 0.0f);
+	this->PostProcessingShader.SetFloat("sharpness", this->Mode == ANTIALIASING_TAA ? this->Sharpness : 0.0f);
+	this->PostProcessingShader.SetVector2f("texelSize", 1.0f / this->RenderWidth, 1.0f / this->RenderHeight);
+	glActiveTexture(GL_TEXTURE0);
+	scene->Bind();
+	glActiveTexture(GL_TEXTURE1);
+	this->bloomMips[0].Bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glActiveTexture(GL_TEXTURE0);
-	this->Texture.Bind();
-	glBindVertexArray(this->VAO);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
 	glBindVertexArray(0);
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+	if (blend)
+		glEnable(GL_BLEND);
+	++this->frameIndex;
+}
+
+void PostProcessor::resolveTemporal()
+{
+	const Texture2D &previous = this->history[this->historyIndex];
+	this->historyIndex ^= 1;
+	glBindFramebuffer(GL_FRAMEBUFFER, this->historyFBO[this->historyIndex]);
+	glViewport(0, 0, this->RenderWidth, this->RenderHeight);
+	this->TemporalShader.Use();
+	this->TemporalShader.SetVector2f("texelSize", 1.0f / this->RenderWidth, 1.0f / this->RenderHeight);
+	this->TemporalShader.SetFloat("feedback", this->TemporalFeedback);
+	this->TemporalShader.SetInteger("historyValid", this->historyValid);
+	glActiveTexture(GL_TEXTURE0);
+	this->Texture.Bind();
+	glActiveTexture(GL_TEXTURE1);
+	previous.Bind();
+	glActiveTexture(GL_TEXTURE2);
+	this->motionTexture.Bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glActiveTexture(GL_TEXTURE0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	this->historyValid = GL_TRUE;
+}
+
+void PostProcessor::renderBloom(const Texture2D &scene)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, this->bloomFBO);
+	glActiveTexture(GL_TEXTURE0);
+	// downsample: the scene into the half resolution mip (thresholded), then every mip into the next smaller one
+	this->DownsampleShader.Use();
+	this->DownsampleShader.SetFloat("threshold", this->BloomThreshold);
+	this->DownsampleShader.SetFloat("knee", this->BloomKnee);
+	const Texture2D *source = &scene;
+	for (size_t i = 0; i < this->bloomMips.size(); ++i)
+	{
+		const Texture2D &target = this->bloomMips[i];
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.ID, 0);
+		glViewport(0, 0, target.Width, target.Height);
+		this->DownsampleShader.SetVector2f("texelSize", 1.0f / source->Width, 1.0f / source->Height);
+		this->DownsampleShader.SetInteger("prefilter", i == 0);
+		source->Bind();
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		source = &target;
+	}
+	// upsample: add each mip, blurred by the tent, onto the next larger one
+	this->UpsampleShader.Use();
+	GLint blendSrc, blendDst;
+	glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrc);
+	glGetIntegerv(GL_BLEND_DST_RGB, &blendDst);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	for (size_t i = this->bloomMips.size() - 1; i > 0; --i)
+	{
+		const Texture2D &smaller = this->bloomMips[i], &target = this->bloomMips[i - 1];
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.ID, 0);
+		glViewport(0, 0, target.Width, target.Height);
+		this->UpsampleShader.SetVector2f("texelSize", this->BloomRadius / smaller.Width, this->BloomRadius / smaller.Height);
+		smaller.Bind();
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	glBlendFunc(blendSrc, blendDst);
+	glDisable(GL_BLEND);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void PostProcessor::initRenderData()
 {
-	// Configure VAO/VBO
+	// One triangle covering the screen: no diagonal seam where two
+	// triangles would shade the same pixels twice
 	GLuint VBO;
 	GLfloat vertices[] = {
 		// Pos        // Tex
 		-1.0f, -1.0f, 0.0f, 0.0f,
-		1.0f,  1.0f, 1.0f, 1.0f,
-		-1.0f,  1.0f, 0.0f, 1.0f,
-
-		-1.0f, -1.0f, 0.0f, 0.0f,
-		1.0f, -1.0f, 1.0f, 0.0f,
-		1.0f,  1.0f, 1.0f, 1.0f
+		3.0f, -1.0f, 2.0f, 0.0f,
+		-1.0f,  3.0f, 0.0f, 2.0f
 	};
 	glGenVertexArrays(1, &this->VAO);
 	glGenBuffers(1, &VBO);
@@ -120,4 +277,77 @@ void PostProcessor::initRenderData()
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GL_FLOAT), (GLvoid*)0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
-}
\ No newline at end of file
+}
+
+void PostProcessor::allocateTargets()
+{
+	GLuint renderWidth = glm::max((GLuint)(this->Width * this->RenderScale + 0.5f), 1u);
+	GLuint renderHeight = glm::max((GLuint)(this->Height * this->RenderScale + 0.5f), 1u);
+	if (!this->bloomMips.empty() && renderWidth == this->RenderWidth && renderHeight == this->RenderHeight && this->Mode == this->allocatedMode)
+		return;
+	this->RenderWidth = renderWidth;
+	this->RenderHeight = renderHeight;
+	this->allocatedMode = this->Mode;
+	const bool temporal = this->Mode == ANTIALIASING_TAA;
+
+	// Multisampled half float color and depth for the scene (MSAA); with TAA
+	// the depth is single sampled and moves to FBO, and the color buffer is released
+	glBindFramebuffer(GL_FRAMEBUFFER, this->MSFBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->colorRBO);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->Samples, GL_RGBA16F, temporal ? 1 : renderWidth, temporal ? 1 : renderHeight);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->depthRBO);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, temporal ? 0 : this->Samples, GL_DEPTH_COMPONENT24, renderWidth, renderHeight);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, temporal ? 0 : this->depthRBO);
+	if (!temporal && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::POSTPROCESSOR: Failed to initialize MSFBO" << std::endl;
+
+	// Single sampled half float texture the scene is resolved into (MSAA) or,
+	// together with the motion vectors and the depth, rendered into (TAA)
+	glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+	this->Texture.Generate(renderWidth, renderHeight, NULL);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->Texture.ID, 0);
+	this->motionTexture.Generate(temporal ? renderWidth : 1, temporal ? renderHeight : 1, NULL);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, temporal ? this->motionTexture.ID : 0, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, temporal ? this->depthRBO : 0);
+	const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(temporal ? 2 : 1, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::POSTPROCESSOR: Failed to initialize FBO" << std::endl;
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// TAA history; the old one no longer lines up, so accumulation restarts
+	for (GLuint i = 0; i < 2; ++i)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, this->historyFBO[i]);
+		this->history[i].Generate(temporal ? renderWidth : 1, temporal ? renderHeight : 1, NULL);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->history[i].ID, 0);
+		if (temporal && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::POSTPROCESSOR: Failed to initialize history FBO" << std::endl;
+	}
+	this->historyValid = GL_FALSE;
+
+	// Bloom chain, from half the render resolution down
+	for (Texture2D &mip : this->bloomMips)
+		glDeleteTextures(1, &mip.ID);
+	this->bloomMips.clear();
+	GLuint width = renderWidth / 2, height = renderHeight / 2;
+	while (this->bloomMips.size() < BLOOM_MAX_MIPS && (this->bloomMips.empty() || (width >= BLOOM_MIN_SIZE && height >= BLOOM_MIN_SIZE)))
+	{
+		// bloom needs no alpha, and packed 11/10 bit floats halve the bandwidth of RGBA16F
+		Texture2D mip;
+		mip.Internal_Format = GL_R11F_G11F_B10F;
+		mip.Image_Format = GL_RGB;
+		mip.Wrap_S = GL_CLAMP_TO_EDGE;
+		mip.Wrap_T = GL_CLAMP_TO_EDGE;
+		mip.Generate(width > 0 ? width : 1, height > 0 ? height : 1, NULL);
+		this->bloomMips.push_back(mip);
+		width /= 2;
+		height /= 2;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, this->bloomFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->bloomMips[0].ID, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::POSTPROCESSOR: Failed to initialize bloom FBO" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -13,41 +13,115 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <vector>
+
 #include "texture.h"
-#include "sprite_renderer.h"
 #include "shader.h"
 
 
-// PostProcessor hosts all PostProcessing effects for the Breakout
-// Game. It renders the game on a textured quad after which one can
-// enable specific effects by enabling either the Confuse, Chaos or 
-// Shake boolean. 
-// It is required to call BeginRender() before rendering the game
-// and EndRender() after rendering the game for the class to work.
+// How the scene target is anti-aliased
+enum AntiAliasing {
+	// multisampled target resolved by a blit
+	ANTIALIASING_MSAA,
+	// one jittered sample per pixel accumulated over frames
+	ANTIALIASING_TAA
+};
+
+// PostProcessor owns the HDR render targets of the scene and the passes
+// that turn them into the displayed image. The scene is rendered into an
+// RGBA16F target with depth between BeginRender() and EndRender(), and
+// Render() adds bloom, tonemaps and gamma corrects it onto the default
+// framebuffer, once per pixel however much the scene overdrew. Shaders
+// drawing into the scene write linear radiance.
+//
+// With MSAA the target is multisampled and EndRender() resolves it once
+// into Texture. With TAA the scene renders one sample per pixel straight
+// into Texture, with the projection offset by a different subpixel jitter
+// every frame (see Jitter()) and a second attachment receiving every
+// pixel's motion since the previous frame. Render() then reprojects the
+// accumulated history along those motion vectors, clamps it to the current
+// pixel's 3x3 neighbourhood and blends a tenth of the new frame in; the
+// tonemap pass sharpens the result slightly. Shading one sample instead of
+// Samples saves most of the scene's fill rate.
+//
+// Bloom thresholds the scene into a chain of mips starting at half
+// resolution, each downsampled from the previous one with a 13-tap filter,
+// then walks back up the chain adding a 3x3 tent upsample of every mip into
+// the next larger one. Every pass reads a handful of texels of a small
+// target, so a wide glow costs about two half resolution fills in total.
+//
+// Width and Height are the size of the window the result is drawn to; the
+// scene renders at RenderScale times that (RenderWidth x RenderHeight) and is
+// upscaled by the tonemap pass, so the internal resolution can follow the
+// frame time while the window and the HUD stay sharp.
 class PostProcessor
 {
 public:
 	// State
-	Shader PostProcessingShader;
+	Shader PostProcessingShader, DownsampleShader, UpsampleShader, TemporalShader;
+	// Scene color (resolved with MSAA, this frame's jittered samples with TAA)
 	Texture2D Texture;
+	// Size of the output and of the scene targets
 	GLuint Width, Height;
+	GLuint RenderWidth, RenderHeight;
+	GLfloat RenderScale;
+	// MSAA samples of the scene target (clamped to what the driver supports)
+	GLuint Samples;
+	AntiAliasing Mode;
 	// Options
-	GLboolean Confuse, Chaos, Shake;
+	GLfloat Exposure;
+	GLboolean Bloom;
+	// Radiance where bloom starts, and the width of the soft transition below it
+	GLfloat BloomThreshold, BloomKnee;
+	// Fraction of the blurred chain added to the scene
+	GLfloat BloomIntensity;
+	// Tent radius of the upsample in texels of the smaller mip
+	GLfloat BloomRadius;
+	// TAA: weight of the history against the new frame, and the sharpening applied afterwards
+	GLfloat TemporalFeedback, Sharpness;
 	// Constructor
-	PostProcessor(Shader shader, GLuint width, GLuint height);
-	// Prepares the postprocessor's framebuffer operations before rendering the game
+	PostProcessor(Shader shader, Shader downsampleShader, Shader upsampleShader, Shader temporalShader, GLuint width, GLuint height, GLuint samples = 4, AntiAliasing mode = ANTIALIASING_TAA);
+	~PostProcessor();
+	// Reallocates the targets for a new output size (ignored while it is zero, e.g. minimized)
+	void Resize(GLuint width, GLuint height);
+	// Sets the fraction of the output resolution the scene renders at (clamped to [0.25, 1])
+	void SetRenderScale(GLfloat scale);
+	// Switches between MSAA and TAA, reallocating the scene target
+	void SetAntiAliasing(AntiAliasing mode);
+	// The projection offset by this frame's subpixel jitter (unchanged without TAA)
+	glm::mat4 Jitter(const glm::mat4 &projection) const;
+	// Binds the scene target and clears it with the current clear color (motion to zero)
 	void BeginRender();
-	// Should be called after rendering the game, so it stores all the rendered data into a texture object
+	// Resolves the scene target into Texture (MSAA) and rebinds the default framebuffer
 	void EndRender();
-	// Renders the PostProcessor texture quad (as a screen-encompassing large sprite)
-	void Render(GLfloat time);
+	// Accumulates (TAA), blooms, tonemaps and upscales the scene onto the default framebuffer with a full screen triangle
+	void Render();
 private:
 	// Render state
-	GLuint MSFBO, FBO; // MSFBO = Multisampled FBO. FBO is regular, used for blitting MS color-buffer to texture
-	GLuint RBO; // RBO is used for multisampled color buffer
+	GLuint MSFBO, FBO; // MSFBO = Multisampled scene FBO. FBO holds Texture (and with TAA is the scene target)
+	GLuint colorRBO, depthRBO; // Color buffer of MSFBO and the scene's depth buffer
 	GLuint VAO;
-	// Initialize quad for rendering postprocessing texture
+	// TAA: motion vectors of the scene and the accumulated history, written to alternately
+	Texture2D motionTexture;
+	Texture2D history[2];
+	GLuint historyFBO[2];
+	GLuint historyIndex;
+	GLboolean historyValid;
+	// Frames rendered, indexing the jitter sequence
+	GLuint frameIndex;
+	// Mode the targets were allocated for
+	AntiAliasing allocatedMode;
+	// Bloom mip chain, from half resolution down, and the FBO its passes render with
+	std::vector<Texture2D> bloomMips;
+	GLuint bloomFBO;
+	// Initialize the full screen triangle
 	void initRenderData();
+	// (Re)allocates the scene targets and the bloom chain when the render size or mode changed
+	void allocateTargets();
+	// Blends this frame into the history; the result is history[historyIndex]
+	void resolveTemporal();
+	// Fills bloomMips[0] with the blurred bright parts of scene
+	void renderBloom(const Texture2D &scene);
 };
 
-#endif
\ No newline at end of file
+#endif
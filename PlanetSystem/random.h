@@ -0,0 +1,104 @@
+#pragma once
+#ifndef RANDOM_H
+#define RANDOM_H
+#include <cstdint>
+#include <cmath>
+
+// Position of a Random in its sequence; restoring it continues the sequence exactly
+struct RandomState {
+	uint64_t Seed, Stream, Counter;
+};
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011). Every
+// output is a pure function of (seed, stream, position), so there is no
+// shared state to contend for: parallel workers each take their own
+// Stream(n), e.g. one per body, and get the same numbers whichever thread
+// runs them and however the work is split.
+class Random
+{
+public:
+	explicit Random(uint64_t seed = 0, uint64_t stream = 0)
+		:seed(seed), stream(stream), counter(0), cachedBlock(~(uint64_t)0) {}
+	explicit Random(const RandomState &state)
+		:seed(state.Seed), stream(state.Stream), counter(state.Counter), cachedBlock(~(uint64_t)0) {}
+	RandomState State() const
+	{
+		RandomState state;
+		state.Seed = this->seed;
+		state.Stream = this->stream;
+		state.Counter = this->counter;
+		return state;
+	}
+	// Independent generator of the same seed; streams never overlap
+	Random Stream(uint64_t stream) const { return Random(this->seed, stream); }
+
+	// 32 uniformly distributed bits
+	uint32_t NextUInt()
+	{
+		const uint64_t block = this->counter >> 2;
+		if (block != this->cachedBlock)
+		{
+			philox(block, this->output);
+			this->cachedBlock = block;
+		}
+		return this->output[this->counter++ & 3];
+	}
+	// Uniform in [0, 1) with 53 random bits
+	double NextDouble()
+	{
+		const uint64_t high = this->NextUInt() >> 5, low = this->NextUInt() >> 6;
+		return (double)(high * 67108864 + low) * (1.0 / 9007199254740992.0);
+	}
+	// Uniform in [0, 1) with 24 random bits
+	float NextFloat() { return (float)(this->NextUInt() >> 8) * (1.0f / 16777216.0f); }
+	double Uniform(double low, double high) { return low + (high - low) * this->NextDouble(); }
+	// Uniform integer in [0, n) (n > 0), without modulo bias
+	uint32_t Below(uint32_t n)
+	{
+		const uint32_t limit = (uint32_t)(0x100000000ull - 0x100000000ull % n);
+		uint32_t value;
+		do
+			value = this->NextUInt();
+		while (limit != 0 && value >= limit);
+		return value % n;
+	}
+	// Standard normal deviate (Box-Muller)
+	double Normal()
+	{
+		const double u = 1.0 - this->NextDouble(), v = this->NextDouble();
+		return std::sqrt(-2.0 * std::log(u)) * std::cos(6.28318530717958647692 * v);
+	}
+private:
+	uint64_t seed, stream;
+	// Index of the next 32-bit output; four are produced per block
+	uint64_t counter;
+	uint64_t cachedBlock;
+	uint32_t output[4];
+
+	static inline uint32_t mulhilo(uint32_t a, uint32_t b, uint32_t &low)
+	{
+		const uint64_t product = (uint64_t)a * b;
+		low = (uint32_t)product;
+		return (uint32_t)(product >> 32);
+	}
+	// Ten Philox rounds over the counter (block, stream) with key seed
+	void philox(uint64_t block, uint32_t *out) const
+	{
+		uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32);
+		uint32_t c2 = (uint32_t)this->stream, c3 = (uint32_t)(this->stream >> 32);
+		uint32_t k0 = (uint32_t)this->seed, k1 = (uint32_t)(this->seed >> 32);
+		for (int round = 0; round < 10; ++round)
+		{
+			uint32_t low0, low1;
+			const uint32_t high0 = mulhilo(0xD2511F53u, c0, low0);
+			const uint32_t high1 = mulhilo(0xCD9E8D57u, c2, low1);
+			const uint32_t n0 = high1 ^ c1 ^ k0, n2 = high0 ^ c3 ^ k1;
+			c0 = n0; c1 = low1; c2 = n2; c3 = low0;
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+		out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+	}
+};
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+#ifndef RENDER_VIEW_H
+#define RENDER_VIEW_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <frustum.h>
+
+// Per-frame camera state shared by the draw paths: matrices, the culling
+// frustum and the scale used to turn world radii into screen pixels.
+// Rendering is camera relative: Origin is the double precision world
+// position that float render positions (and View) are measured from, so
+// draw paths send (position - Origin) to the GPU.
+//
+// Projection may carry a subpixel jitter (temporal anti-aliasing);
+// ViewProjection is the same transform without it and
+// PreviousViewProjection is last frame's, both taking origin-relative
+// positions of this frame, so shaders can write the screen motion of what
+// they draw.
+struct RenderView
+{
+	glm::dvec3 Origin;
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::mat4 ViewProjection, PreviousViewProjection;
+	glm::vec3 CameraPosition;
+	Frustum ViewFrustum;
+	// Pixels covered by a radius of 1 at a view depth of 1
+	GLfloat PixelScale;
+	RenderView(const glm::mat4 &view, const glm::mat4 &projection, GLfloat viewportHeight, const glm::dvec3 &origin = glm::dvec3(0.0))
+		: Origin(origin), View(view), Projection(projection), ViewProjection(projection * view), PreviousViewProjection(projection * view), CameraPosition(glm::inverse(view)[3]), ViewFrustum(Frustum::FromMatrix(projection * view)),
+		PixelScale(0.5f * viewportHeight * projection[1][1]) {}
+	// Projected radius in pixels of a sphere centered at an origin-relative position
+	GLfloat ProjectedRadius(const glm::vec3 &center, GLfloat radius) const
+	{
+		// view-space depth is the negated z of the transformed center
+		GLfloat depth = -(this->View[0][2] * center.x + this->View[1][2] * center.y + this->View[2][2] * center.z + this->View[3][2]);
+		return depth > radius ? radius * this->PixelScale / depth : 1.0e9f;
+	}
+};
+
+#endif
@@ -11,58 +11,166 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <stdexcept>
 
 // Instantiate static variables
-std::map<std::string, Texture2D>    ResourceManager::Textures;
-std::map<std::string, Texture3D> ResourceManager::Textures3D;
-std::map<std::string, Shader>       ResourceManager::Shaders;
+std::deque<Texture2D>         ResourceManager::Textures;
+std::deque<Texture3D>         ResourceManager::Textures3D;
+std::deque<Shader>            ResourceManager::Shaders;
+std::map<std::string, GLuint> ResourceManager::shaderNames;
+std::map<std::string, GLuint> ResourceManager::textureNames;
+std::map<std::string, GLuint> ResourceManager::texture3DNames;
 
 
+// Deletes the GL object behind a resource
+static void releaseResource(const Shader &shader)
+{
+	glDeleteProgram(shader.ID);
+}
+
+static void releaseResource(const Texture2D &texture)
+{
+	glDeleteTextures(1, &texture.ID);
+}
 
-Shader ResourceManager::LoadShader(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, std::string name)
+static void releaseResource(const Texture3D &texture)
 {
-	Shaders[name] = loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile);
-	return Shaders[name];
+	glDeleteTextures(1, &texture.ID);
 }
 
-Shader ResourceManager::GetShader(std::string name)
+// Stores a resource under name, reusing the slot (and deleting the GL object
+// it held) if the name was loaded before
+template <typename T>
+static GLuint storeResource(std::deque<T> &storage, std::map<std::string, GLuint> &names, const T &resource, const std::string &name)
 {
-	return Shaders[name];
+	std::map<std::string, GLuint>::iterator it = names.find(name);
+	if (it != names.end())
+	{
+		releaseResource(storage[it->second]);
+		storage[it->second] = resource;
+		return it->second;
+	}
+	GLuint index = (GLuint)storage.size();
+	storage.push_back(resource);
+	names[name] = index;
+	return index;
 }
 
-Texture2D ResourceManager::LoadTexture(const GLchar *file, GLboolean alpha, std::string name)
+// Resolves a name to its index; a missing name is a programming error, so report it loudly
+static GLuint findResource(const std::map<std::string, GLuint> &names, const std::string &name, const char *kind)
 {
-	Textures[name] = loadTextureFromFile(file, alpha);
-	return Textures[name];
+	std::map<std::string, GLuint>::const_iterator it = names.find(name);
+	if (it == names.end())
+	{
+		std::cout << "ERROR::RESOURCE_MANAGER: No " << kind << " named \"" << name << "\" has been loaded" << std::endl;
+		throw std::out_of_range("ResourceManager: unknown " + std::string(kind) + " \"" + name + "\"");
+	}
+	return it->second;
 }
 
-Texture3D ResourceManager::LoadTexture3D(std::vector<std::string> faces, GLboolean alpha, std::string name)
+// Validates a handle against its storage before dereferencing it
+template <typename T>
+static T &fetchResource(std::deque<T> &storage, ResourceHandle<T> handle, const char *kind)
 {
-	Textures3D[name] = loadTexture3DFromFile(faces, alpha);
-	return Textures3D[name];
+	if (handle.Index >= storage.size())
+	{
+		std::cout << "ERROR::RESOURCE_MANAGER: Invalid " << kind << " handle " << handle.Index << std::endl;
+		throw std::out_of_range("ResourceManager: invalid " + std::string(kind) + " handle");
+	}
+	return storage[handle.Index];
 }
 
-Texture2D ResourceManager::GetTexture(std::string name)
+
+ShaderHandle ResourceManager::LoadShader(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, const std::string &name, const GLchar *defines)
 {
-	return Textures[name];
+	return ShaderHandle(storeResource(Shaders, shaderNames, loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile, defines), name));
 }
 
-Texture3D ResourceManager::GetTexture3D(std::string name)
+TextureHandle ResourceManager::LoadTexture(const GLchar *file, GLboolean alpha, const std::string &name)
 {
-	return Textures3D[name];
+	return TextureHandle(storeResource(Textures, textureNames, loadTextureFromFile(file, alpha), name));
+}
+
+Texture3DHandle ResourceManager::LoadTexture3D(const std::vector<std::string> &faces, GLboolean alpha, const std::string &name)
+{
+	return Texture3DHandle(storeResource(Textures3D, texture3DNames, loadTexture3DFromFile(faces, alpha), name));
+}
+
+Shader &ResourceManager::GetShader(ShaderHandle handle)
+{
+	return fetchResource(Shaders, handle, "shader");
+}
+
+Texture2D &ResourceManager::GetTexture(TextureHandle handle)
+{
+	return fetchResource(Textures, handle, "texture");
+}
+
+Texture3D &ResourceManager::GetTexture3D(Texture3DHandle handle)
+{
+	return fetchResource(Textures3D, handle, "cubemap texture");
+}
+
+ShaderHandle ResourceManager::FindShader(const std::string &name)
+{
+	return ShaderHandle(findResource(shaderNames, name, "shader"));
+}
+
+TextureHandle ResourceManager::FindTexture(const std::string &name)
+{
+	return TextureHandle(findResource(textureNames, name, "texture"));
+}
+
+Texture3DHandle ResourceManager::FindTexture3D(const std::string &name)
+{
+	return Texture3DHandle(findResource(texture3DNames, name, "cubemap texture"));
+}
+
+Shader &ResourceManager::GetShader(const std::string &name)
+{
+	return GetShader(FindShader(name));
+}
+
+Texture2D &ResourceManager::GetTexture(const std::string &name)
+{
+	return GetTexture(FindTexture(name));
+}
+
+Texture3D &ResourceManager::GetTexture3D(const std::string &name)
+{
+	return GetTexture3D(FindTexture3D(name));
 }
 
 void ResourceManager::Clear()
 {
 	// (Properly) delete all shaders	
-	for (auto iter : Shaders)
-		glDeleteProgram(iter.second.ID);
+	for (Shader &shader : Shaders)
+		releaseResource(shader);
 	// (Properly) delete all textures
-	for (auto iter : Textures)
-		glDeleteTextures(1, &iter.second.ID);
+	for (Texture2D &texture : Textures)
+		releaseResource(texture);
+	for (Texture3D &texture : Textures3D)
+		releaseResource(texture);
+	Shaders.clear();
+	Textures.clear();
+	Textures3D.clear();
+	shaderNames.clear();
+	textureNames.clear();
+	texture3DNames.clear();
+}
+
+// Inserts preprocessor defines right after the #version directive (which must stay the first line)
+static std::string injectDefines(const std::string &source, const GLchar *defines)
+{
+	if (defines == nullptr || source.empty())
+		return source;
+	std::string::size_type lineEnd = source.find('\n');
+	if (lineEnd == std::string::npos)
+		return source + "\n" + defines;
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
 }
 
-Shader ResourceManager::loadShaderFromFile(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile)
+Shader ResourceManager::loadShaderFromFile(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, const GLchar *defines)
 {
 	// 1. Retrieve the vertex/fragment source code from filePath
 	std::string vertexCode;
@@ -97,6 +205,9 @@ Shader ResourceManager::loadShaderFromFile(const GLchar *vShaderFile, const GLch
 	{
 		std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
 	}
+	vertexCode = injectDefines(vertexCode, defines);
+	fragmentCode = injectDefines(fragmentCode, defines);
+	geometryCode = injectDefines(geometryCode, defines);
 	const GLchar *vShaderCode = vertexCode.c_str();
 	const GLchar *fShaderCode = fragmentCode.c_str();
 	const GLchar *gShaderCode = geometryCode.c_str();
@@ -140,7 +251,7 @@ Texture2D ResourceManager::loadTextureFromFile(const GLchar *file, GLboolean alp
 // +Z (front) 
 // -Z (back)
 // -------------------------------------------------------
-Texture3D ResourceManager::loadTexture3DFromFile(std::vector<std::string> faces, GLboolean alpha)
+Texture3D ResourceManager::loadTexture3DFromFile(const std::vector<std::string> &faces, GLboolean alpha)
 {
 	// Create Texture object
 	Texture3D texture;
@@ -11,6 +11,7 @@
 #define RESOURCE_MANAGER_H
 
 #include <vector>
+#include <deque>
 #include <map>
 #include <string>
 #include <glad/glad.h>
@@ -18,39 +19,77 @@
 #include <shader.h>
 
 
+// Typed index into one of the ResourceManager's dense resource arrays.
+// Handles are resolved once when a resource is loaded (or looked up by
+// name) and give O(1) access afterwards; the tag type keeps shader and
+// texture handles from being mixed up.
+template <typename T>
+struct ResourceHandle
+{
+	static const GLuint INVALID = 0xFFFFFFFFu;
+	GLuint Index;
+	ResourceHandle() : Index(INVALID) { }
+	explicit ResourceHandle(GLuint index) : Index(index) { }
+	bool Valid() const { return this->Index != INVALID; }
+};
+
+typedef ResourceHandle<Shader>    ShaderHandle;
+typedef ResourceHandle<Texture2D> TextureHandle;
+typedef ResourceHandle<Texture3D> Texture3DHandle;
+
+
 // A static singleton ResourceManager class that hosts several
 // functions to load Textures and Shaders. Each loaded texture
-// and/or shader is also stored for future reference by string
-// handles. All functions and resources are static and no 
-// public constructor is defined.
+// and/or shader is stored densely and referenced through a typed
+// handle; the string names are kept only for tooling/debug lookups.
+// Looking up a name or handle that was never loaded is reported as
+// an error instead of silently creating an empty resource.
+// All functions and resources are static and no public constructor
+// is defined.
 class ResourceManager
 {
 public:
-	// Resource storage
-	static std::map<std::string, Shader>    Shaders;
-	static std::map<std::string, Texture2D> Textures;
-	static std::map<std::string, Texture3D> Textures3D;
-	// Loads (and generates) a shader program from file loading vertex, fragment (and geometry) shader's source code. If gShaderFile is not nullptr, it also loads a geometry shader
-	static Shader   LoadShader(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, std::string name);
-	// Retrieves a stored sader
-	static Shader   GetShader(std::string name);
-	// Loads (and generates) a texture from file
-	static Texture2D LoadTexture(const GLchar *file, GLboolean alpha, std::string name);
+	// Resource storage, indexed by handle. A deque never moves its elements
+	// when it grows, so references returned by the getters stay valid across
+	// later loads (until Clear).
+	static std::deque<Shader>    Shaders;
+	static std::deque<Texture2D> Textures;
+	static std::deque<Texture3D> Textures3D;
+	// Loads (and generates) a shader program from file loading vertex, fragment (and geometry) shader's source code. If gShaderFile is not nullptr, it also loads a geometry shader.
+	// Loading under an existing name replaces the resource in place, so previously resolved handles and references stay
+	// valid; the replaced GL object is deleted, so copies of the old resource taken by value no longer work.
+	// defines (e.g. "#define IMPOSTOR\n") is inserted after the #version line of every stage, so one source file can build several variants.
+	static ShaderHandle    LoadShader(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile, const std::string &name, const GLchar *defines = nullptr);
 	// Loads (and generates) a texture from file
-	static Texture3D LoadTexture3D(std::vector<std::string> faces, GLboolean alpha, std::string name);
-	// Retrieves a stored texture
-	static Texture2D GetTexture(std::string name);
-	static Texture3D GetTexture3D(std::string name);
+	static TextureHandle   LoadTexture(const GLchar *file, GLboolean alpha, const std::string &name);
+	// Loads (and generates) a cubemap texture from six face files
+	static Texture3DHandle LoadTexture3D(const std::vector<std::string> &faces, GLboolean alpha, const std::string &name);
+	// Retrieves a stored resource in O(1); use these in per-frame code
+	static Shader    &GetShader(ShaderHandle handle);
+	static Texture2D &GetTexture(TextureHandle handle);
+	static Texture3D &GetTexture3D(Texture3DHandle handle);
+	// Resolves a name to its handle (tooling only, not for per-frame code)
+	static ShaderHandle    FindShader(const std::string &name);
+	static TextureHandle   FindTexture(const std::string &name);
+	static Texture3DHandle FindTexture3D(const std::string &name);
+	// Retrieves a stored resource by name (tooling only, not for per-frame code)
+	static Shader    &GetShader(const std::string &name);
+	static Texture2D &GetTexture(const std::string &name);
+	static Texture3D &GetTexture3D(const std::string &name);
 	// Properly de-allocates all loaded resources
 	static void      Clear();
 private:
+	// Name -> index maps, only consulted when loading or by the tooling lookups
+	static std::map<std::string, GLuint> shaderNames;
+	static std::map<std::string, GLuint> textureNames;
+	static std::map<std::string, GLuint> texture3DNames;
 	// Private constructor, that is we do not want any actual resource manager objects. Its members and functions should be publicly available (static).
 	ResourceManager() { }
 	// Loads and generates a shader from file
-	static Shader    loadShaderFromFile(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile = nullptr);
+	static Shader    loadShaderFromFile(const GLchar *vShaderFile, const GLchar *fShaderFile, const GLchar *gShaderFile = nullptr, const GLchar *defines = nullptr);
 	// Loads a single texture from file
 	static Texture2D loadTextureFromFile(const GLchar *file, GLboolean alpha);
-	static Texture3D loadTexture3DFromFile(std::vector<std::string> faces, GLboolean alpha);
+	static Texture3D loadTexture3DFromFile(const std::vector<std::string> &faces, GLboolean alpha);
 };
 
 #endif
\ No newline at end of file
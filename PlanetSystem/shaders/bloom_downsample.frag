@@ -0,0 +1,70 @@
+#version 330 core
+in  vec2  TexCoords;
+out vec4  color;
+
+// previous (twice as large) level of the chain, or the scene for the first mip
+uniform sampler2D source;
+uniform vec2      texelSize;
+// first pass: keep only what is brighter than the threshold
+uniform bool      prefilter;
+uniform float     threshold;
+uniform float     knee;
+
+float luma(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Weighted average that damps single very bright texels, so a lone
+// sub-pixel highlight does not flicker as a large blob
+vec3 karisAverage(vec3 a, vec3 b, vec3 c, vec3 d)
+{
+    float wa = 1.0 / (1.0 + luma(a));
+    float wb = 1.0 / (1.0 + luma(b));
+    float wc = 1.0 / (1.0 + luma(c));
+    float wd = 1.0 / (1.0 + luma(d));
+    return (a * wa + b * wb + c * wc + d * wd) / (wa + wb + wc + wd);
+}
+
+void main()
+{
+    // 13 taps: a 4x4 box at the center and four overlapping boxes around
+    // it, all sampled bilinearly between texels (Jimenez, "Next Generation
+    // Post Processing in Call of Duty: Advanced Warfare")
+    vec3 a = texture(source, TexCoords + texelSize * vec2(-2.0,  2.0)).rgb;
+    vec3 b = texture(source, TexCoords + texelSize * vec2( 0.0,  2.0)).rgb;
+    vec3 c = texture(source, TexCoords + texelSize * vec2( 2.0,  2.0)).rgb;
+    vec3 d = texture(source, TexCoords + texelSize * vec2(-2.0,  0.0)).rgb;
+    vec3 e = texture(source, TexCoords).rgb;
+    vec3 f = texture(source, TexCoords + texelSize * vec2( 2.0,  0.0)).rgb;
+    vec3 g = texture(source, TexCoords + texelSize * vec2(-2.0, -2.0)).rgb;
+    vec3 h = texture(source, TexCoords + texelSize * vec2( 0.0, -2.0)).rgb;
+    vec3 i = texture(source, TexCoords + texelSize * vec2( 2.0, -2.0)).rgb;
+    vec3 j = texture(source, TexCoords + texelSize * vec2(-1.0,  1.0)).rgb;
+    vec3 k = texture(source, TexCoords + texelSize * vec2( 1.0,  1.0)).rgb;
+    vec3 l = texture(source, TexCoords + texelSize * vec2(-1.0, -1.0)).rgb;
+    vec3 m = texture(source, TexCoords + texelSize * vec2( 1.0, -1.0)).rgb;
+
+    vec3 result;
+    if (prefilter)
+    {
+        result = karisAverage(j, k, l, m) * 0.5
+               + karisAverage(a, b, d, e) * 0.125
+               + karisAverage(b, c, e, f) * 0.125
+               + karisAverage(d, e, g, h) * 0.125
+               + karisAverage(e, f, h, i) * 0.125;
+        // soft knee: a quadratic ramp from threshold - knee up to threshold
+        float brightness = max(result.r, max(result.g, result.b));
+        float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+        soft = soft * soft / (4.0 * knee + 0.0001);
+        result *= max(soft, brightness - threshold) / max(brightness, 0.0001);
+    }
+    else
+    {
+        result = e * 0.125
+               + (a + c + g + i) * 0.03125
+               + (b + d + f + h) * 0.0625
+               + (j + k + l + m) * 0.125;
+    }
+    color = vec4(max(result, vec3(0.0)), 1.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+in  vec2  TexCoords;
+out vec4  color;
+
+// smaller level of the chain, added onto the bound larger one
+uniform sampler2D source;
+// tent radius in uv
+uniform vec2      texelSize;
+
+void main()
+{
+    // 3x3 tent: 1 2 1 / 2 4 2 / 1 2 1, over 16
+    vec3 result = texture(source, TexCoords).rgb * 4.0;
+    result += (texture(source, TexCoords + texelSize * vec2( 0.0,  1.0)).rgb
+             + texture(source, TexCoords + texelSize * vec2(-1.0,  0.0)).rgb
+             + texture(source, TexCoords + texelSize * vec2( 1.0,  0.0)).rgb
+             + texture(source, TexCoords + texelSize * vec2( 0.0, -1.0)).rgb) * 2.0;
+    result += texture(source, TexCoords + texelSize * vec2(-1.0,  1.0)).rgb
+            + texture(source, TexCoords + texelSize * vec2( 1.0,  1.0)).rgb
+            + texture(source, TexCoords + texelSize * vec2(-1.0, -1.0)).rgb
+            + texture(source, TexCoords + texelSize * vec2( 1.0, -1.0)).rgb;
+    color = vec4(result / 16.0, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out vec3 LocalPos;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+// unit cube seen from its centre by one of the six capture cameras (see ibl.cpp);
+// the interpolated position is the direction of the cube map texel
+void main()
+{
+    LocalPos = aPos;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
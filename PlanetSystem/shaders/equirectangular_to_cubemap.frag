@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+in vec3 LocalPos;
+
+uniform sampler2D equirectangularMap;
+
+// (1 / 2pi, 1 / pi): longitude and latitude to [-0.5, 0.5]
+const vec2 invAtan = vec2(0.1591, 0.3183);
+
+vec2 sampleSphericalMap(vec3 v)
+{
+    vec2 uv = vec2(atan(v.z, v.x), asin(v.y));
+    uv *= invAtan;
+    uv += 0.5;
+    return uv;
+}
+
+void main()
+{
+    vec2 uv = sampleSphericalMap(normalize(LocalPos));
+    FragColor = vec4(texture(equirectangularMap, uv).rgb, 1.0);
+}
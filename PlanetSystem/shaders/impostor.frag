@@ -0,0 +1,38 @@
+#version 330 core
+in vec3 QuadPos;
+flat in vec4 SphereCenterRadius;
+in vec4 ImpostorColor;
+flat in vec3 InstanceMotion;
+
+layout (location = 0) out vec4 FragColor;
+// uv displacement since the previous frame (only stored with temporal anti-aliasing)
+layout (location = 1) out vec2 Motion;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 camPos;
+// unjittered transforms of this and the previous frame (see RenderView)
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
+
+void main()
+{
+    // ray-sphere intersection, using the closest-approach form that stays precise for distant spheres
+    vec3 rayDir = normalize(QuadPos - camPos);
+    vec3 oc = camPos - SphereCenterRadius.xyz;
+    float b = dot(oc, rayDir);
+    vec3 q = oc - b * rayDir;
+    float h = SphereCenterRadius.w * SphereCenterRadius.w - dot(q, q);
+    if (h < 0.0)
+        discard;
+    float t = -b - sqrt(h);
+    if (t < 0.0)
+        discard;
+    vec3 hitPos = camPos + t * rayDir;
+    vec4 clip = projection * view * vec4(hitPos, 1.0);
+    gl_FragDepth = (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+    vec4 currentClip = currentViewProjection * vec4(hitPos, 1.0);
+    vec4 previousClip = previousViewProjection * vec4(hitPos - InstanceMotion, 1.0);
+    Motion = (currentClip.xy / currentClip.w - previousClip.xy / previousClip.w) * 0.5;
+    FragColor = vec4(pow(ImpostorColor.rgb, vec3(2.2)), ImpostorColor.a);
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec4 aCenterRadius; // per instance: xyz center, w radius
+layout (location = 4) in vec4 aColor;        // per instance
+layout (location = 5) in vec4 aMotion;       // per instance: xyz displacement since the previous frame
+
+out vec3 QuadPos;
+flat out vec4 SphereCenterRadius;
+out vec4 ImpostorColor;
+flat out vec3 InstanceMotion;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 camPos;
+
+void main()
+{
+    SphereCenterRadius = aCenterRadius;
+    ImpostorColor = aColor;
+    InstanceMotion = aMotion.xyz;
+    // Build a quad perpendicular to the camera->center ray that exactly encloses the
+    // sphere's silhouette cone; the fragment shader ray traces the sphere inside it.
+    vec3 toCenter = aCenterRadius.xyz - camPos;
+    float d = length(toCenter);
+    float r = aCenterRadius.w;
+    vec3 forward = toCenter / d;
+    vec3 right = normalize(cross(forward, abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 up = cross(right, forward);
+    float planeDist = max(d - r, 0.5 * d);
+    float halfSize = planeDist * r / sqrt(max(d * d - r * r, 1e-6 * d * d));
+    QuadPos = camPos + forward * planeDist + (right * aPos.x + up * aPos.y) * halfSize;
+    gl_Position = projection * view * vec4(QuadPos, 1.0);
+}
\ No newline at end of file
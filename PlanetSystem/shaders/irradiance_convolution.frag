@@ -0,0 +1,38 @@
+#version 330 core
+out vec4 FragColor;
+in vec3 LocalPos;
+
+uniform samplerCube environmentMap;
+
+const float PI = 3.14159265359;
+// step of the hemisphere walk in radians
+const float sampleDelta = 0.025;
+
+// Irradiance around the normal LocalPos: the environment integrated over the
+// hemisphere weighted by cos(theta), walked in regular steps of azimuth and
+// elevation (sin(theta) compensates for the smaller rings near the pole)
+void main()
+{
+    vec3 N = normalize(LocalPos);
+    vec3 up = abs(N.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+    vec3 right = normalize(cross(up, N));
+    up = cross(N, right);
+
+    vec3 irradiance = vec3(0.0);
+    float nrSamples = 0.0;
+    for(float phi = 0.0; phi < 2.0 * PI; phi += sampleDelta)
+    {
+        for(float theta = 0.0; theta < 0.5 * PI; theta += sampleDelta)
+        {
+            // spherical to cartesian, tangent space to world
+            vec3 tangentSample = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+            vec3 sampleVec = tangentSample.x * right + tangentSample.y * up + tangentSample.z * N;
+            // the coarse mip keeps the sparse walk from aliasing small bright spots
+            irradiance += textureLod(environmentMap, sampleVec, 2.0).rgb * cos(theta) * sin(theta);
+            nrSamples++;
+        }
+    }
+    irradiance = PI * irradiance / nrSamples;
+
+    FragColor = vec4(irradiance, 1.0);
+}
@@ -1,10 +1,16 @@
 #version 330 core
 in vec4 ParticleColor;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
 
-out vec4 color;
+layout (location = 0) out vec4 color;
+// uv displacement since the previous frame (only stored with temporal anti-aliasing)
+layout (location = 1) out vec2 Motion;
 
 
 void main()
 {
-    color = ParticleColor;
+    // particle colors are display colors; the scene target is linear
+    color = vec4(pow(ParticleColor.rgb, vec3(2.2)), ParticleColor.a);
+    Motion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
 }
\ No newline at end of file
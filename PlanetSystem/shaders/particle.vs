@@ -1,16 +1,25 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec4 aCenterRadius; // per instance: xyz center, w radius
+layout (location = 4) in vec4 aColor;        // per instance
+layout (location = 5) in vec4 aMotion;       // per instance: xyz displacement since the previous frame
 
 out vec4 ParticleColor;
+out vec4 CurrentClip;
+out vec4 PreviousClip;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-
-uniform vec4 color;
+// unjittered transforms of this and the previous frame (see RenderView)
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
 
 void main()
 {
-    ParticleColor = color;
-    gl_Position = projection * view * model * vec4(aPos, 0.2);
+    ParticleColor = aColor;
+    vec3 worldPos = aCenterRadius.xyz + aPos * aCenterRadius.w;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+    // screen motion since the previous frame (see RenderView), without the jitter
+    CurrentClip = currentViewProjection * vec4(worldPos, 1.0);
+    PreviousClip = previousViewProjection * vec4(worldPos - aMotion.xyz, 1.0);
 }
\ No newline at end of file
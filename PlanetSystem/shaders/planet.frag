@@ -1,8 +1,24 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+// uv displacement since the previous frame (only stored with temporal anti-aliasing)
+layout (location = 1) out vec2 Motion;
+#ifdef IMPOSTOR
+// ray traced sphere on a camera facing quad (see impostor.vs)
+in vec3 QuadPos;
+flat in vec4 SphereCenterRadius;
+flat in vec3 InstanceMotion;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
+#else
 in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
+#endif
 
 // material parameters
 uniform vec3 albedo;
@@ -16,6 +32,14 @@ uniform vec3 lightColors[1];
 
 uniform vec3 camPos;
 
+// image based lighting (see ibl.h): diffuse irradiance, GGX prefiltered
+// radiance with roughness across its mips, and the split-sum BRDF table
+uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+// roughness 1 is the last mip of prefilterMap (IBL_PREFILTER_MIPS - 1)
+const float MAX_REFLECTION_LOD = 4.0;
+
 const float PI = 3.14159265359;
 // ----------------------------------------------------------------------------
 float DistributionGGX(vec3 N, vec3 H, float roughness)
@@ -58,9 +82,46 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
     return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 // ----------------------------------------------------------------------------
+// Fresnel averaged over the lobe of a rough surface: rough surfaces reflect less at grazing angles
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cosTheta, 5.0);
+}
+// ----------------------------------------------------------------------------
+#ifdef IMPOSTOR
+// Intersects the view ray with the analytic sphere and writes its true depth
+bool traceSphere(out vec3 hitPos, out vec3 N)
+{
+    vec3 rayDir = normalize(QuadPos - camPos);
+    vec3 oc = camPos - SphereCenterRadius.xyz;
+    float b = dot(oc, rayDir);
+    vec3 q = oc - b * rayDir;
+    float h = SphereCenterRadius.w * SphereCenterRadius.w - dot(q, q);
+    if (h < 0.0)
+        return false;
+    float t = -b - sqrt(h);
+    if (t < 0.0)
+        return false;
+    hitPos = camPos + t * rayDir;
+    N = (hitPos - SphereCenterRadius.xyz) / SphereCenterRadius.w;
+    vec4 clip = projection * view * vec4(hitPos, 1.0);
+    gl_FragDepth = (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+    return true;
+}
+#endif
+// ----------------------------------------------------------------------------
 void main()
 {		
+#ifdef IMPOSTOR
+    vec3 WorldPos, N;
+    if (!traceSphere(WorldPos, N))
+        discard;
+    vec4 CurrentClip = currentViewProjection * vec4(WorldPos, 1.0);
+    vec4 PreviousClip = previousViewProjection * vec4(WorldPos - InstanceMotion, 1.0);
+#else
     vec3 N = normalize(Normal);
+#endif
+    Motion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
     vec3 V = normalize(camPos - WorldPos);
 
     // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
@@ -106,16 +167,22 @@ void main()
         Lo += (kD * albedo / PI + specular) * radiance * NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
     }   
     
-    // ambient lighting (note that the next IBL tutorial will replace 
-    // this ambient lighting with environment lighting).
-    vec3 ambient = vec3(0.03) * albedo * ao;
+    // ambient lighting from the environment, split like the direct light
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 F = fresnelSchlickRoughness(NdotV, F0, roughness);
+    vec3 kD = (1.0 - F) * (1.0 - metallic);
+    vec3 diffuse = texture(irradianceMap, N).rgb * albedo;
 
-    vec3 color = ambient + Lo;
+    // specular: prefiltered radiance along the reflection, scaled and biased by the BRDF table
+    vec3 R = reflect(-V, N);
+    vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * MAX_REFLECTION_LOD).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+    vec3 specular = prefilteredColor * (F * brdf.x + brdf.y);
 
-    // HDR tonemapping
-    color = color / (color + vec3(1.0));
-    // gamma correct
-    color = pow(color, vec3(1.0/2.2)); 
+    vec3 ambient = (kD * diffuse + specular) * ao;
+
+    vec3 color = ambient + Lo;
 
+    // linear radiance; tonemapping and gamma correction happen once per pixel in post_processing.frag
     FragColor = vec4(color, 1.0);
 }
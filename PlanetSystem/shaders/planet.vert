@@ -2,20 +2,30 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
 layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec4 aCenterRadius; // per instance: xyz center, w radius
+layout (location = 5) in vec4 aMotion;       // per instance: xyz displacement since the previous frame
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+out vec4 CurrentClip;
+out vec4 PreviousClip;
 
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
+// unjittered transforms of this and the previous frame (see RenderView)
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
 
 void main()
 {
     TexCoords = aTexCoords;
-    WorldPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(model) * aNormal;   
+    WorldPos = aCenterRadius.xyz + aPos * aCenterRadius.w;
+    Normal = aNormal;   
+
+    // screen motion since the previous frame (see RenderView), without the jitter
+    CurrentClip = currentViewProjection * vec4(WorldPos, 1.0);
+    PreviousClip = previousViewProjection * vec4(WorldPos - aMotion.xyz, 1.0);
 
     gl_Position =  projection * view * vec4(WorldPos, 1.0);
 }
\ No newline at end of file
@@ -2,43 +2,33 @@
 in  vec2  TexCoords;
 out vec4  color;
   
+// resolved linear HDR scene
 uniform sampler2D scene;
-uniform vec2      offsets[9];
-uniform int       edge_kernel[9];
-uniform float     blur_kernel[9];
-
-uniform bool chaos;
-uniform bool confuse;
-uniform bool shake;
+uniform vec2      texelSize;
+// strength of the sharpening that offsets the softness of temporal anti-aliasing (0 = off)
+uniform float     sharpness;
+// upsampled bloom chain (half resolution)
+uniform sampler2D bloom;
+uniform float     bloomStrength;
+uniform float     exposure;
 
 void main()
 {
-    color = vec4(0.0f);
-    vec3 sample[9];
-    // sample from texture offsets if using convolution matrix
-    if(chaos || shake)
-        for(int i = 0; i < 9; i++)
-            sample[i] = vec3(texture(scene, TexCoords.st + offsets[i]));
-
-    // process effects
-    if(chaos)
-    {           
-        for(int i = 0; i < 9; i++)
-            color += vec4(sample[i] * edge_kernel[i], 0.0f);
-        color.a = 1.0f;
-    }
-    else if(confuse)
-    {
-        color = vec4(1.0 - texture(scene, TexCoords).rgb, 1.0);
-    }
-    else if(shake)
-    {
-        for(int i = 0; i < 9; i++)
-            color += vec4(sample[i] * blur_kernel[i], 0.0f);
-        color.a = 1.0f;
-    }
-    else
+    vec3 hdr = texture(scene, TexCoords).rgb;
+    if (sharpness > 0.0)
     {
-        color =  texture(scene, TexCoords);
+        // unsharp mask over the 4 neighbours, limited to their range so edges do not ring
+        vec3 n = texture(scene, TexCoords + vec2(0.0, texelSize.y)).rgb;
+        vec3 s = texture(scene, TexCoords - vec2(0.0, texelSize.y)).rgb;
+        vec3 e = texture(scene, TexCoords + vec2(texelSize.x, 0.0)).rgb;
+        vec3 w = texture(scene, TexCoords - vec2(texelSize.x, 0.0)).rgb;
+        vec3 sharpened = hdr + (4.0 * hdr - n - s - e - w) * sharpness * 0.25;
+        hdr = clamp(sharpened, min(hdr, min(min(n, s), min(e, w))), max(hdr, max(max(n, s), max(e, w))));
     }
-}
\ No newline at end of file
+    hdr += texture(bloom, TexCoords).rgb * bloomStrength;
+    hdr *= exposure;
+    // Reinhard tonemapping
+    vec3 mapped = hdr / (hdr + vec3(1.0));
+    // gamma correct
+    color = vec4(pow(mapped, vec3(1.0/2.2)), 1.0);
+}
@@ -0,0 +1,92 @@
+#version 330 core
+out vec4 FragColor;
+in vec3 LocalPos;
+
+uniform samplerCube environmentMap;
+uniform float roughness;
+// size of a face of environmentMap's base level
+uniform float resolution;
+
+const float PI = 3.14159265359;
+const uint SAMPLE_COUNT = 1024u;
+// ----------------------------------------------------------------------------
+float DistributionGGX(float NdotH, float roughness)
+{
+    float a = roughness*roughness;
+    float a2 = a*a;
+    float denom = (NdotH*NdotH * (a2 - 1.0) + 1.0);
+    return a2 / (PI * denom * denom);
+}
+// ----------------------------------------------------------------------------
+// Van der Corput radical inverse, bit reversed
+float RadicalInverse_VdC(uint bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10; // / 0x100000000
+}
+// ----------------------------------------------------------------------------
+vec2 Hammersley(uint i, uint N)
+{
+    return vec2(float(i)/float(N), RadicalInverse_VdC(i));
+}
+// ----------------------------------------------------------------------------
+// Half vector around N distributed like the GGX lobe of the given roughness
+vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
+{
+    float a = roughness*roughness;
+
+    float phi = 2.0 * PI * Xi.x;
+    float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a*a - 1.0) * Xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
+
+    vec3 H = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+
+    return normalize(tangent * H.x + bitangent * H.y + N * H.z);
+}
+// ----------------------------------------------------------------------------
+// Radiance reflected towards N by a GGX lobe, assuming N = V = R as the
+// split sum does. Each sample reads the environment mip whose texels cover
+// about the solid angle the sample stands for, so unlikely directions do not
+// alias into bright speckles (filtered importance sampling).
+void main()
+{
+    vec3 N = normalize(LocalPos);
+    vec3 R = N;
+    vec3 V = R;
+
+    // solid angle of one base level texel
+    float saTexel = 4.0 * PI / (6.0 * resolution * resolution);
+
+    vec3 prefilteredColor = vec3(0.0);
+    float totalWeight = 0.0;
+    for(uint i = 0u; i < SAMPLE_COUNT; ++i)
+    {
+        vec2 Xi = Hammersley(i, SAMPLE_COUNT);
+        vec3 H = ImportanceSampleGGX(Xi, N, roughness);
+        vec3 L = normalize(2.0 * dot(V, H) * H - V);
+
+        float NdotL = max(dot(N, L), 0.0);
+        if(NdotL > 0.0)
+        {
+            // with N = V the pdf of L is D(h) / 4
+            float NdotH = max(dot(N, H), 0.0);
+            float pdf = DistributionGGX(NdotH, roughness) / 4.0 + 0.0001;
+            float saSample = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
+            float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel);
+
+            prefilteredColor += textureLod(environmentMap, L, mipLevel).rgb * NdotL;
+            totalWeight += NdotL;
+        }
+    }
+    prefilteredColor = prefilteredColor / totalWeight;
+
+    FragColor = vec4(prefilteredColor, 1.0);
+}
@@ -1,11 +1,18 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+// uv displacement since the previous frame (only stored with temporal anti-aliasing)
+layout (location = 1) out vec2 Motion;
 
 in vec3 TexCoords;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
 
 uniform samplerCube skybox;
 
 void main()
 {    
-    FragColor = texture(skybox, TexCoords);
+    // the cube map holds display (sRGB) colors; the scene target is linear
+    vec4 texel = texture(skybox, TexCoords);
+    FragColor = vec4(pow(texel.rgb, vec3(2.2)), texel.a);
+    Motion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
 }
\ No newline at end of file
@@ -2,13 +2,21 @@
 layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
+out vec4 CurrentClip;
+out vec4 PreviousClip;
 
 uniform mat4 projection;
 uniform mat4 view;
+// unjittered transforms of this and the previous frame (see RenderView); the
+// sky is infinitely far, so only their rotation moves it (w = 0)
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
 
 void main()
 {
     TexCoords = aPos;
     vec4 pos = projection * view * vec4(aPos, 1.0);
     gl_Position = pos.xyww;
+    CurrentClip = currentViewProjection * vec4(aPos, 0.0);
+    PreviousClip = previousViewProjection * vec4(aPos, 0.0);
 }  
\ No newline at end of file
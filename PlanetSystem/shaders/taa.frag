@@ -0,0 +1,88 @@
+#version 330 core
+in  vec2  TexCoords;
+out vec4  color;
+
+// this frame, rendered with a subpixel jitter
+uniform sampler2D scene;
+// last frame's output of this pass
+uniform sampler2D history;
+// uv displacement of every pixel since the previous frame
+uniform sampler2D motion;
+uniform vec2      texelSize;
+// weight of the history in the blend
+uniform float     feedback;
+uniform bool      historyValid;
+
+// Blending works on range compressed colors, so one very bright sample does
+// not dominate its neighbours (Karis, "High Quality Temporal Supersampling")
+vec3 compress(vec3 c)
+{
+    return c / (1.0 + max(c.r, max(c.g, c.b)));
+}
+
+vec3 expand(vec3 c)
+{
+    return c / max(1.0 - max(c.r, max(c.g, c.b)), 0.0001);
+}
+
+vec3 toYCoCg(vec3 c)
+{
+    return vec3(dot(c, vec3(0.25, 0.5, 0.25)), dot(c, vec3(0.5, 0.0, -0.5)), dot(c, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 fromYCoCg(vec3 c)
+{
+    return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+// Catmull-Rom filtered sample from 5 bilinear taps; keeps the history from
+// blurring a little more every time it is reprojected
+vec3 sampleCatmullRom(sampler2D tex, vec2 uv)
+{
+    vec2 texSize = 1.0 / texelSize;
+    vec2 samplePos = uv * texSize;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+    vec2 texPos0 = (texPos1 - 1.0) * texelSize;
+    vec2 texPos3 = (texPos1 + 2.0) * texelSize;
+    vec2 texPos12 = (texPos1 + w2 / w12) * texelSize;
+    vec3 result = texture(tex, vec2(texPos12.x, texPos0.y)).rgb * w12.x * w0.y
+                + texture(tex, vec2(texPos0.x, texPos12.y)).rgb * w0.x * w12.y
+                + texture(tex, texPos12).rgb * w12.x * w12.y
+                + texture(tex, vec2(texPos3.x, texPos12.y)).rgb * w3.x * w12.y
+                + texture(tex, vec2(texPos12.x, texPos3.y)).rgb * w12.x * w3.y;
+    float total = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+    return max(result / total, vec3(0.0));
+}
+
+void main()
+{
+    vec3 current = toYCoCg(compress(texture(scene, TexCoords).rgb));
+    vec2 previousUV = TexCoords - texture(motion, TexCoords).xy;
+    if (!historyValid || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0))))
+    {
+        color = vec4(expand(fromYCoCg(current)), 1.0);
+        return;
+    }
+    // the 3x3 neighbourhood bounds what this pixel can plausibly be; history
+    // outside it is stale (disocclusion, lighting change) and is pulled in
+    vec3 low = current, high = current;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            if (x == 0 && y == 0)
+                continue;
+            vec3 neighbour = toYCoCg(compress(texture(scene, TexCoords + vec2(x, y) * texelSize).rgb));
+            low = min(low, neighbour);
+            high = max(high, neighbour);
+        }
+    }
+    vec3 previous = clamp(toYCoCg(compress(sampleCatmullRom(history, previousUV))), low, high);
+    color = vec4(expand(fromYCoCg(mix(current, previous, feedback))), 1.0);
+}
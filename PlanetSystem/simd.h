@@ -0,0 +1,12 @@
+#pragma once
+#ifndef SIMD_H
+#define SIMD_H
+// Compile-time detection of the SIMD instruction sets used by the batch
+// kernels (culling, gravity, Kepler drifts). Every kernel keeps a scalar fallback, so a
+// target without SSE still builds and produces the same results.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PLANETSYSTEM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#endif
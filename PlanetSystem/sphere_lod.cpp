@@ -0,0 +1,163 @@
+#include <sphere_lod.h>
+#include <cmath>
+
+// Segment counts of the mesh levels; the last level is the impostor quad
+static const unsigned int LEVEL_SEGMENTS[SphereLOD::IMPOSTOR_LEVEL] = { 64, 32, 16, 8 };
+// Minimum projected radius in pixels for each mesh level
+static const GLfloat LEVEL_MIN_PIXELS[SphereLOD::IMPOSTOR_LEVEL] = { 64.0f, 24.0f, 8.0f, 3.0f };
+
+SphereLOD::SphereLOD()
+	: ImpostorsOnly(GL_FALSE)
+{
+	for (GLuint i = 0; i < LEVELS; ++i)
+	{
+		this->vao[i] = 0;
+		this->instanceVBO[i] = 0;
+		this->indexCount[i] = 0;
+	}
+}
+
+void SphereLOD::Init()
+{
+	const float PI = 3.14159265359f;
+	for (GLuint level = 0; level < IMPOSTOR_LEVEL; ++level)
+	{
+		const unsigned int X_SEGMENTS = LEVEL_SEGMENTS[level];
+		const unsigned int Y_SEGMENTS = LEVEL_SEGMENTS[level];
+		// interleaved position, uv, normal
+		std::vector<float> data;
+		std::vector<unsigned int> indices;
+		for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+		{
+			for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+			{
+				float xSegment = (float)x / (float)X_SEGMENTS;
+				float ySegment = (float)y / (float)Y_SEGMENTS;
+				float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+				float yPos = std::cos(ySegment * PI);
+				float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+				float vertex[8] = { xPos, yPos, zPos, xSegment, ySegment, xPos, yPos, zPos };
+				data.insert(data.end(), vertex, vertex + 8);
+			}
+		}
+		bool oddRow = false;
+		for (int y = 0; y < (int)Y_SEGMENTS; ++y)
+		{
+			if (!oddRow) // even rows: y == 0, y == 2; and so on
+			{
+				for (int x = 0; x <= (int)X_SEGMENTS; ++x)
+				{
+					indices.push_back(y       * (X_SEGMENTS + 1) + x);
+					indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+				}
+			}
+			else
+			{
+				for (int x = X_SEGMENTS; x >= 0; --x)
+				{
+					indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+					indices.push_back(y       * (X_SEGMENTS + 1) + x);
+				}
+			}
+			oddRow = !oddRow;
+		}
+		this->setupLevel(level, data, indices);
+	}
+	// Impostor: a unit quad in the xy plane, oriented and sized around the sphere in the vertex shader
+	float quad[] = {
+		// pos               // uv        // normal
+		-1.0f, -1.0f, 0.0f,  0.0f, 0.0f,  0.0f, 0.0f, 1.0f,
+		 1.0f, -1.0f, 0.0f,  1.0f, 0.0f,  0.0f, 0.0f, 1.0f,
+		-1.0f,  1.0f, 0.0f,  0.0f, 1.0f,  0.0f, 0.0f, 1.0f,
+		 1.0f,  1.0f, 0.0f,  1.0f, 1.0f,  0.0f, 0.0f, 1.0f
+	};
+	unsigned int quadIndices[] = { 0, 1, 2, 3 };
+	this->setupLevel(IMPOSTOR_LEVEL, std::vector<float>(quad, quad + 32), std::vector<unsigned int>(quadIndices, quadIndices + 4));
+}
+
+void SphereLOD::setupLevel(GLuint level, const std::vector<float> &data, const std::vector<unsigned int> &indices)
+{
+	GLuint vbo, ebo;
+	glGenVertexArrays(1, &this->vao[level]);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
+	glGenBuffers(1, &this->instanceVBO[level]);
+	this->indexCount[level] = indices.size();
+
+	glBindVertexArray(this->vao[level]);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	GLsizei stride = (3 + 2 + 3) * sizeof(float);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(float)));
+	// per-instance center/radius, color and motion
+	glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO[level]);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)0);
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)sizeof(glm::vec4));
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)(2 * sizeof(glm::vec4)));
+	glVertexAttribDivisor(5, 1);
+	glBindVertexArray(0);
+}
+
+GLuint SphereLOD::SelectLevel(GLfloat pixelRadius)
+{
+	for (GLuint level = 0; level < IMPOSTOR_LEVEL; ++level)
+	{
+		if (pixelRadius >= LEVEL_MIN_PIXELS[level])
+			return level;
+	}
+	return IMPOSTOR_LEVEL;
+}
+
+void SphereLOD::Begin()
+{
+	for (GLuint i = 0; i < LEVELS; ++i)
+		this->buckets[i].clear();
+}
+
+void SphereLOD::Add(const RenderView &view, const SphereInstance &instance)
+{
+	GLuint level = this->ImpostorsOnly ? IMPOSTOR_LEVEL : SelectLevel(view.ProjectedRadius(glm::vec3(instance.CenterRadius), instance.CenterRadius.w));
+	this->buckets[level].push_back(instance);
+}
+
+void SphereLOD::Draw(const RenderView &view, Shader &meshShader, Shader &impostorShader)
+{
+	for (GLuint level = 0; level < LEVELS; ++level)
+	{
+		const std::vector<SphereInstance> &bucket = this->buckets[level];
+		if (bucket.empty())
+			continue;
+		if (level == IMPOSTOR_LEVEL)
+		{
+			impostorShader.Use();
+			impostorShader.SetMatrix4("view", view.View);
+			impostorShader.SetMatrix4("projection", view.Projection);
+			impostorShader.SetVector3f("camPos", view.CameraPosition);
+		}
+		else
+			meshShader.Use();
+		Shader &shader = level == IMPOSTOR_LEVEL ? impostorShader : meshShader;
+		shader.SetMatrix4("currentViewProjection", view.ViewProjection);
+		shader.SetMatrix4("previousViewProjection", view.PreviousViewProjection);
+		// orphan the previous frame's storage so the upload does not stall on in-flight draws
+		glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO[level]);
+		glBufferData(GL_ARRAY_BUFFER, bucket.size() * sizeof(SphereInstance), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bucket.size() * sizeof(SphereInstance), &bucket[0]);
+		glBindVertexArray(this->vao[level]);
+		glDrawElementsInstanced(GL_TRIANGLE_STRIP, this->indexCount[level], GL_UNSIGNED_INT, 0, bucket.size());
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef SPHERE_LOD_H
+#define SPHERE_LOD_H
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <shader.h>
+#include <render_view.h>
+
+// Per-instance data of an instanced sphere draw (vertex attributes 3 to 5)
+struct SphereInstance {
+	glm::vec4 CenterRadius; // xyz world position, w radius
+	glm::vec4 Color;
+	glm::vec4 Motion; // xyz world displacement since the previous frame, for motion vectors
+	SphereInstance() {}
+	SphereInstance(const glm::vec3 &center, GLfloat radius, const glm::vec4 &color, const glm::vec3 &motion = glm::vec3(0.0f))
+		: CenterRadius(center, radius), Color(color), Motion(motion, 0.0f) {}
+};
+
+// A chain of UV sphere meshes at decreasing tessellation (64, 32, 16 and 8
+// segments) followed by a camera facing impostor quad on which the sphere
+// is ray traced per fragment. Every instance is assigned a level from its
+// projected radius in pixels, and each level is drawn with a single
+// instanced call.
+class SphereLOD
+{
+public:
+	static const GLuint LEVELS = 5;
+	static const GLuint IMPOSTOR_LEVEL = LEVELS - 1;
+	// Draws every instance as a ray traced impostor (4 vertices per body) regardless of size
+	GLboolean ImpostorsOnly;
+	SphereLOD();
+	// Builds the meshes; must be called with a current GL context
+	void Init();
+	// Chooses a level from the projected radius in pixels
+	static GLuint SelectLevel(GLfloat pixelRadius);
+	// Empties the per-level instance buckets
+	void Begin();
+	// Adds an instance to the bucket of the level chosen for it
+	void Add(const RenderView &view, const SphereInstance &instance);
+	// Uploads the buckets and issues one instanced draw per non-empty level;
+	// mesh levels use meshShader, the impostor level uses impostorShader;
+	// both get the view's motion vector matrices
+	void Draw(const RenderView &view, Shader &meshShader, Shader &impostorShader);
+	// Number of instances in a level's bucket since the last Begin
+	GLuint LevelCount(GLuint level) const { return this->buckets[level].size(); }
+private:
+	GLuint vao[LEVELS];
+	GLuint instanceVBO[LEVELS];
+	GLuint indexCount[LEVELS];
+	std::vector<SphereInstance> buckets[LEVELS];
+	// Uploads vertices/indices of one level and wires its instance buffer
+	void setupLevel(GLuint level, const std::vector<float> &data, const std::vector<unsigned int> &indices);
+};
+
+#endif
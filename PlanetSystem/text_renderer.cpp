@@ -19,8 +19,8 @@
 TextRenderer::TextRenderer(GLuint width, GLuint height)
 {
 	// Load and configure shader
-	this->TextShader = ResourceManager::LoadShader("shaders/text_rendering.vs", "shaders/text_rendering.frag", nullptr, "text");
-	this->TextShader.SetMatrix4("projection", glm::ortho(0.0f, static_cast<GLfloat>(width), static_cast<GLfloat>(height), 0.0f), GL_TRUE);
+	this->TextShader = ResourceManager::GetShader(ResourceManager::LoadShader("shaders/text_rendering.vs", "shaders/text_rendering.frag", nullptr, "text"));
+	this->Resize(width, height);
 	this->TextShader.SetInteger("text", 0);
 	// Configure VAO/VBO for texture quads
 	glGenVertexArrays(1, &this->VAO);
@@ -34,6 +34,11 @@ TextRenderer::TextRenderer(GLuint width, GLuint height)
 	glBindVertexArray(0);
 }
 
+void TextRenderer::Resize(GLuint width, GLuint height)
+{
+	this->TextShader.SetMatrix4("projection", glm::ortho(0.0f, static_cast<GLfloat>(width), static_cast<GLfloat>(height), 0.0f), GL_TRUE);
+}
+
 void TextRenderer::Load(std::string font, GLuint fontSize)
 {
 	// First clear the previously loaded Characters
@@ -40,6 +40,8 @@ public:
 	Shader TextShader;
 	// Constructor
 	TextRenderer(GLuint width, GLuint height);
+	// Maps text coordinates to a new screen size
+	void Resize(GLuint width, GLuint height);
 	// Pre-compiles a list of characters from the given font
 	void Load(std::string font, GLuint fontSize);
 	// Renders a string of text using the precompiled list of characters
@@ -0,0 +1,572 @@
+#include <trajectory.h>
+#include <compression.h>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+static const size_t COLUMN_COUNTS = 0;
+static const size_t COLUMN_IDS = 1;
+static const size_t COLUMN_COMPONENTS = 2;
+static const size_t COLUMN_COUNT = 8;
+// Largest quantised magnitude; keeps the extrapolation inside 64 bits
+static const double QUANTISED_LIMIT = 4.0e18;
+// An LZ block cannot expand its input by more than this (a 255 length byte
+// producing 255 bytes of match)
+static const uint64_t MAX_EXPANSION = 256;
+
+static inline void appendBytes(std::vector<char> &out, const void *data, size_t bytes)
+{
+	const char *begin = static_cast<const char *>(data);
+	out.insert(out.end(), begin, begin + bytes);
+}
+
+static inline void putVarint(std::vector<char> &out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+static inline bool getVarint(const char *data, size_t end, size_t &position, uint64_t &value)
+{
+	value = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7)
+	{
+		if (position >= end)
+			return false;
+		const unsigned char byte = (unsigned char)data[position++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+static inline uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline int64_t quantise(double value, double quantum)
+{
+	double steps = value / quantum;
+	// also maps NaN to the lower limit
+	if (!(steps > -QUANTISED_LIMIT))
+		steps = -QUANTISED_LIMIT;
+	else if (steps > QUANTISED_LIMIT)
+		steps = QUANTISED_LIMIT;
+	return (int64_t)std::llround(steps);
+}
+
+// Value of a body predicted from the two previous frames of the chunk; the
+// arithmetic wraps, which is fine as long as writer and reader agree
+static inline uint64_t predict(bool inPrevious, bool inBefore, int64_t previous, int64_t before)
+{
+	if (inBefore)
+		return 2 * (uint64_t)previous - (uint64_t)before;
+	return inPrevious ? (uint64_t)previous : 0;
+}
+
+TrajectoryWriter::TrajectoryWriter()
+	:open(false), droppedFrames(0), stopping(false), failed(false), framesPerChunk(32)
+{
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	this->Close();
+}
+
+bool TrajectoryWriter::Open(const std::string &path, double positionQuantum, double velocityQuantum, GLuint framesPerChunk)
+{
+	this->Close();
+	if (!(positionQuantum > 0.0) || !(velocityQuantum > 0.0))
+	{
+		std::cout << "ERROR::TRAJECTORY: Quanta must be positive" << std::endl;
+		return false;
+	}
+	this->file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!this->file)
+	{
+		std::cout << "ERROR::TRAJECTORY: Failed to open " << path << std::endl;
+		return false;
+	}
+	this->header.Magic = TRAJECTORY_MAGIC;
+	this->header.Version = TRAJECTORY_VERSION;
+	this->header.PositionQuantum = positionQuantum;
+	this->header.VelocityQuantum = velocityQuantum;
+	this->file.write(reinterpret_cast<const char *>(&this->header), sizeof(this->header));
+
+	this->path = path;
+	this->framesPerChunk = framesPerChunk > 0 ? framesPerChunk : 1;
+	this->failed = false;
+	this->droppedFrames = 0;
+	this->stopping = false;
+	this->index.clear();
+	std::memset(&this->chunk, 0, sizeof(this->chunk));
+	this->frameTimes.clear();
+	for (size_t c = 0; c < COLUMN_COUNT; ++c)
+		this->columns[c].clear();
+	this->open = true;
+	this->worker = std::thread(&TrajectoryWriter::run, this);
+	return true;
+}
+
+void TrajectoryWriter::Close()
+{
+	if (!this->open)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wake.notify_one();
+	this->worker.join();
+	this->open = false;
+	this->pending.clear();
+	this->spare.clear();
+}
+
+void TrajectoryWriter::Record(double time, const BodyStore &bodies)
+{
+	if (!this->open)
+		return;
+	TrajectoryFrame frame;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (this->pending.size() >= MAX_PENDING)
+		{
+			this->droppedFrames++;
+			return;
+		}
+		if (!this->spare.empty())
+		{
+			frame = std::move(this->spare.back());
+			this->spare.pop_back();
+		}
+	}
+	frame.Time = time;
+	frame.Id.assign(bodies.Id.begin(), bodies.Id.end());
+	frame.X.assign(bodies.X.begin(), bodies.X.end());
+	frame.Y.assign(bodies.Y.begin(), bodies.Y.end());
+	frame.Z.assign(bodies.Z.begin(), bodies.Z.end());
+	frame.VX.assign(bodies.VX.begin(), bodies.VX.end());
+	frame.VY.assign(bodies.VY.begin(), bodies.VY.end());
+	frame.VZ.assign(bodies.VZ.begin(), bodies.VZ.end());
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->pending.push_back(std::move(frame));
+	}
+	this->wake.notify_one();
+}
+
+void TrajectoryWriter::run()
+{
+	std::vector<TrajectoryFrame> batch;
+	for (;;)
+	{
+		bool stop;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			for (size_t f = 0; f < batch.size(); ++f)
+				this->spare.push_back(std::move(batch[f]));
+			batch.clear();
+			this->wake.wait(lock, [this]() { return this->stopping || !this->pending.empty(); });
+			while (!this->pending.empty())
+			{
+				batch.push_back(std::move(this->pending.front()));
+				this->pending.pop_front();
+			}
+			stop = this->stopping;
+		}
+		for (size_t f = 0; f < batch.size(); ++f)
+		{
+			this->encodeFrame(batch[f]);
+			if (this->chunk.FrameCount >= this->framesPerChunk)
+				this->writeChunk();
+		}
+		if (stop)
+		{
+			if (this->chunk.FrameCount > 0)
+				this->writeChunk();
+			this->writeIndex();
+			return;
+		}
+	}
+}
+
+void TrajectoryWriter::encodeFrame(const TrajectoryFrame &frame)
+{
+	const size_t n = frame.Size();
+	this->sortKeys.resize(n);
+	for (size_t i = 0; i < n; ++i)
+		this->sortKeys[i] = ((uint64_t)frame.Id[i] << 32) | i;
+	std::sort(this->sortKeys.begin(), this->sortKeys.end());
+
+	const GLuint f = this->chunk.FrameCount;
+	if (f == 0)
+		this->chunk.FirstTime = frame.Time;
+	this->chunk.LastTime = frame.Time;
+	this->frameTimes.push_back(frame.Time);
+	putVarint(this->columns[COLUMN_COUNTS], n);
+
+	const double *components[6] = { frame.X.data(), frame.Y.data(), frame.Z.data(), frame.VX.data(), frame.VY.data(), frame.VZ.data() };
+	const std::vector<unsigned int> &previousIds = this->frameIds[1], &beforeIds = this->frameIds[2];
+	const size_t previousCount = f >= 1 ? previousIds.size() : 0;
+	const size_t beforeCount = f >= 2 ? beforeIds.size() : 0;
+	this->frameIds[0].resize(n);
+	for (int c = 0; c < 6; ++c)
+		this->frameValues[0][c].resize(n);
+	size_t previous = 0, before = 0;
+	for (size_t k = 0; k < n; ++k)
+	{
+		const unsigned int id = (unsigned int)(this->sortKeys[k] >> 32);
+		const size_t slot = (size_t)(this->sortKeys[k] & 0xFFFFFFFFu);
+		putVarint(this->columns[COLUMN_IDS], k == 0 ? id : id - this->frameIds[0][k - 1]);
+		this->frameIds[0][k] = id;
+		// both id lists are ascending, so the same body is found by merging
+		while (previous < previousCount && previousIds[previous] < id)
+			previous++;
+		while (before < beforeCount && beforeIds[before] < id)
+			before++;
+		const bool inPrevious = previous < previousCount && previousIds[previous] == id;
+		const bool inBefore = inPrevious && before < beforeCount && beforeIds[before] == id;
+		for (int c = 0; c < 6; ++c)
+		{
+			const int64_t value = quantise(components[c][slot], c < 3 ? this->header.PositionQuantum : this->header.VelocityQuantum);
+			this->frameValues[0][c][k] = value;
+			const uint64_t predicted = predict(inPrevious, inBefore,
+				inPrevious ? this->frameValues[1][c][previous] : 0, inBefore ? this->frameValues[2][c][before] : 0);
+			putVarint(this->columns[COLUMN_COMPONENTS + c], zigzag((int64_t)((uint64_t)value - predicted)));
+		}
+	}
+	std::swap(this->frameIds[2], this->frameIds[1]);
+	std::swap(this->frameIds[1], this->frameIds[0]);
+	for (int c = 0; c < 6; ++c)
+	{
+		std::swap(this->frameValues[2][c], this->frameValues[1][c]);
+		std::swap(this->frameValues[1][c], this->frameValues[0][c]);
+	}
+	this->chunk.FrameCount++;
+}
+
+void TrajectoryWriter::writeChunk()
+{
+	this->raw.clear();
+	appendBytes(this->raw, this->frameTimes.data(), this->frameTimes.size() * sizeof(double));
+	for (size_t c = 0; c < COLUMN_COUNT; ++c)
+	{
+		const uint64_t bytes = this->columns[c].size();
+		appendBytes(this->raw, &bytes, sizeof(bytes));
+	}
+	for (size_t c = 0; c < COLUMN_COUNT; ++c)
+		this->raw.insert(this->raw.end(), this->columns[c].begin(), this->columns[c].end());
+	CompressLZ(this->raw.data(), this->raw.size(), this->compressed);
+
+	this->chunk.Magic = TRAJECTORY_CHUNK_MAGIC;
+	this->chunk.RawBytes = this->raw.size();
+	this->chunk.CompressedBytes = this->compressed.size();
+	TrajectoryIndexEntry entry;
+	entry.Chunk = this->chunk;
+	entry.Offset = (uint64_t)this->file.tellp();
+	this->file.write(reinterpret_cast<const char *>(&this->chunk), sizeof(this->chunk));
+	this->file.write(this->compressed.data(), this->compressed.size());
+	if (!this->file.good() && !this->failed)
+	{
+		std::cout << "ERROR::TRAJECTORY: Failed to write " << this->path << std::endl;
+		this->failed = true;
+	}
+	if (!this->failed)
+		this->index.push_back(entry);
+
+	this->chunk.FirstFrame += this->chunk.FrameCount;
+	this->chunk.FrameCount = 0;
+	this->frameTimes.clear();
+	for (size_t c = 0; c < COLUMN_COUNT; ++c)
+		this->columns[c].clear();
+}
+
+void TrajectoryWriter::writeIndex()
+{
+	TrajectoryFooter footer;
+	footer.IndexOffset = (uint64_t)this->file.tellp();
+	footer.ChunkCount = this->index.size();
+	footer.Magic = TRAJECTORY_INDEX_MAGIC;
+	footer.Reserved = 0;
+	if (!this->index.empty())
+		this->file.write(reinterpret_cast<const char *>(this->index.data()), this->index.size() * sizeof(TrajectoryIndexEntry));
+	this->file.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+	this->file.close();
+	if (this->file.fail() && !this->failed)
+		std::cout << "ERROR::TRAJECTORY: Failed to write " << this->path << std::endl;
+}
+
+TrajectoryReader::TrajectoryReader()
+	:frameCount(0), cachedChunk(BodyStore::INVALID_INDEX)
+{
+}
+
+bool TrajectoryReader::Open(const std::string &path)
+{
+	this->Close();
+	if (!this->file.Open(path))
+	{
+		std::cout << "ERROR::TRAJECTORY: Failed to open " << path << std::endl;
+		return false;
+	}
+	if (this->file.Size() < sizeof(this->header))
+	{
+		std::cout << "ERROR::TRAJECTORY: " << path << " is truncated" << std::endl;
+		this->Close();
+		return false;
+	}
+	std::memcpy(&this->header, this->file.Data(), sizeof(this->header));
+	if (this->header.Magic != TRAJECTORY_MAGIC || this->header.Version == 0 || this->header.Version > TRAJECTORY_VERSION
+		|| !(this->header.PositionQuantum > 0.0) || !(this->header.VelocityQuantum > 0.0))
+	{
+		std::cout << "ERROR::TRAJECTORY: " << path << " is not a trajectory of a supported version" << std::endl;
+		this->Close();
+		return false;
+	}
+	// the index is missing when the writer did not get to close the file
+	if (!this->readIndex())
+		this->scanChunks();
+	this->frameCount = this->index.empty() ? 0 : (size_t)(this->index.back().Chunk.FirstFrame + this->index.back().Chunk.FrameCount);
+	return true;
+}
+
+void TrajectoryReader::Close()
+{
+	this->file.Close();
+	this->index.clear();
+	this->frameCount = 0;
+	this->cachedChunk = BodyStore::INVALID_INDEX;
+}
+
+bool TrajectoryReader::readIndex()
+{
+	const size_t size = this->file.Size();
+	TrajectoryFooter footer;
+	if (size < sizeof(this->header) + sizeof(footer))
+		return false;
+	std::memcpy(&footer, this->file.Data() + size - sizeof(footer), sizeof(footer));
+	if (footer.Magic != TRAJECTORY_INDEX_MAGIC || footer.IndexOffset < sizeof(this->header) || footer.IndexOffset > size - sizeof(footer))
+		return false;
+	const uint64_t bytes = size - sizeof(footer) - footer.IndexOffset;
+	if (bytes % sizeof(TrajectoryIndexEntry) != 0 || bytes / sizeof(TrajectoryIndexEntry) != footer.ChunkCount)
+		return false;
+	// the chunk checks below subtract a chunk header from the index offset
+	if (footer.ChunkCount > 0 && footer.IndexOffset < sizeof(this->header) + sizeof(TrajectoryChunkHeader))
+		return false;
+	this->index.resize((size_t)footer.ChunkCount);
+	if (!this->index.empty())
+		std::memcpy(this->index.data(), this->file.Data() + footer.IndexOffset, (size_t)bytes);
+	uint64_t frames = 0;
+	for (size_t c = 0; c < this->index.size(); ++c)
+	{
+		const TrajectoryIndexEntry &entry = this->index[c];
+		if (entry.Chunk.Magic != TRAJECTORY_CHUNK_MAGIC || entry.Chunk.FrameCount == 0 || entry.Chunk.FirstFrame != frames
+			|| entry.Offset < sizeof(this->header) || entry.Offset > footer.IndexOffset - sizeof(TrajectoryChunkHeader)
+			|| entry.Chunk.CompressedBytes > footer.IndexOffset - sizeof(TrajectoryChunkHeader) - entry.Offset)
+		{
+			this->index.clear();
+			return false;
+		}
+		frames += entry.Chunk.FrameCount;
+	}
+	return true;
+}
+
+void TrajectoryReader::scanChunks()
+{
+	const size_t size = this->file.Size();
+	size_t offset = sizeof(this->header);
+	uint64_t frames = 0;
+	this->index.clear();
+	while (size - offset >= sizeof(TrajectoryChunkHeader))
+	{
+		TrajectoryIndexEntry entry;
+		std::memcpy(&entry.Chunk, this->file.Data() + offset, sizeof(entry.Chunk));
+		if (entry.Chunk.Magic != TRAJECTORY_CHUNK_MAGIC || entry.Chunk.FrameCount == 0 || entry.Chunk.FirstFrame != frames
+			|| entry.Chunk.CompressedBytes > size - offset - sizeof(entry.Chunk))
+			break;
+		entry.Offset = offset;
+		this->index.push_back(entry);
+		offset += sizeof(entry.Chunk) + (size_t)entry.Chunk.CompressedBytes;
+		frames += entry.Chunk.FrameCount;
+	}
+}
+
+bool TrajectoryReader::ReadFrame(size_t frame, TrajectoryFrame &out)
+{
+	if (frame >= this->frameCount)
+		return false;
+	const size_t chunk = this->ChunkOfFrame(frame);
+	if (!this->loadChunk(chunk))
+		return false;
+	out = this->cachedFrames[frame - this->ChunkFirstFrame(chunk)];
+	return true;
+}
+
+size_t TrajectoryReader::ChunkOfFrame(size_t frame) const
+{
+	size_t low = 0, high = this->index.size();
+	while (high - low > 1)
+	{
+		const size_t middle = (low + high) / 2;
+		if (this->index[middle].Chunk.FirstFrame <= frame)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t TrajectoryReader::ChunkAt(double time) const
+{
+	size_t low = 0, high = this->index.size();
+	while (high - low > 1)
+	{
+		const size_t middle = (low + high) / 2;
+		if (this->index[middle].Chunk.FirstTime <= time)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t TrajectoryReader::FindFrame(double time)
+{
+	if (this->index.empty())
+		return 0;
+	const size_t chunk = this->ChunkAt(time);
+	const size_t first = (size_t)this->index[chunk].Chunk.FirstFrame;
+	if (!this->loadChunk(chunk))
+		return first;
+	size_t frame = 0;
+	while (frame + 1 < this->cachedFrames.size() && this->cachedFrames[frame + 1].Time <= time)
+		frame++;
+	return first + frame;
+}
+
+bool TrajectoryReader::loadChunk(size_t chunk)
+{
+	if (chunk == this->cachedChunk)
+		return true;
+	this->cachedChunk = BodyStore::INVALID_INDEX;
+	if (!this->DecodeChunk(chunk, this->cachedFrames))
+		return false;
+	this->cachedChunk = chunk;
+	return true;
+}
+
+void TrajectoryReader::PrefetchChunk(size_t chunk) const
+{
+	if (chunk < this->index.size())
+		this->file.Prefetch((size_t)this->index[chunk].Offset, sizeof(TrajectoryChunkHeader) + (size_t)this->index[chunk].Chunk.CompressedBytes);
+}
+
+bool TrajectoryReader::DecodeChunk(size_t chunk, std::vector<TrajectoryFrame> &frames)
+{
+	if (chunk >= this->index.size())
+		return false;
+	const TrajectoryChunkHeader &header = this->index[chunk].Chunk;
+	const char *payload = this->file.Data() + this->index[chunk].Offset + sizeof(TrajectoryChunkHeader);
+	const size_t frameCount = header.FrameCount;
+	const size_t tableBytes = frameCount * sizeof(double) + COLUMN_COUNT * sizeof(uint64_t);
+	if (header.RawBytes < tableBytes || header.RawBytes > header.CompressedBytes * MAX_EXPANSION + 16)
+		return false;
+	this->raw.resize((size_t)header.RawBytes);
+	if (!DecompressLZ(payload, (size_t)header.CompressedBytes, this->raw.data(), this->raw.size()))
+		return false;
+
+	const char *data = this->raw.data();
+	size_t position[COLUMN_COUNT], end[COLUMN_COUNT];
+	size_t offset = tableBytes;
+	for (size_t c = 0; c < COLUMN_COUNT; ++c)
+	{
+		uint64_t bytes;
+		std::memcpy(&bytes, data + frameCount * sizeof(double) + c * sizeof(uint64_t), sizeof(bytes));
+		if (bytes > this->raw.size() - offset)
+			return false;
+		position[c] = offset;
+		offset += (size_t)bytes;
+		end[c] = offset;
+	}
+	if (offset != this->raw.size())
+		return false;
+
+	const double quanta[6] = {
+		this->header.PositionQuantum, this->header.PositionQuantum, this->header.PositionQuantum,
+		this->header.VelocityQuantum, this->header.VelocityQuantum, this->header.VelocityQuantum
+	};
+	std::vector<int64_t> values[3][6];
+	frames.resize(frameCount);
+	for (size_t f = 0; f < frameCount; ++f)
+	{
+		TrajectoryFrame &frame = frames[f];
+		std::memcpy(&frame.Time, data + f * sizeof(double), sizeof(double));
+		uint64_t count;
+		// every body takes at least one byte of the id column
+		if (!getVarint(data, end[COLUMN_COUNTS], position[COLUMN_COUNTS], count) || count > end[COLUMN_IDS] - position[COLUMN_IDS])
+			return false;
+		const size_t n = (size_t)count;
+		frame.Resize(n);
+		double *components[6] = { frame.X.data(), frame.Y.data(), frame.Z.data(), frame.VX.data(), frame.VY.data(), frame.VZ.data() };
+		const std::vector<unsigned int> *previousIds = f >= 1 ? &frames[f - 1].Id : nullptr;
+		const std::vector<unsigned int> *beforeIds = f >= 2 ? &frames[f - 2].Id : nullptr;
+		const size_t previousCount = previousIds != nullptr ? previousIds->size() : 0;
+		const size_t beforeCount = beforeIds != nullptr ? beforeIds->size() : 0;
+		for (int c = 0; c < 6; ++c)
+			values[0][c].resize(n);
+		size_t previous = 0, before = 0;
+		for (size_t k = 0; k < n; ++k)
+		{
+			uint64_t gap;
+			if (!getVarint(data, end[COLUMN_IDS], position[COLUMN_IDS], gap) || (k > 0 && gap == 0))
+				return false;
+			const uint64_t id = k == 0 ? gap : frame.Id[k - 1] + gap;
+			if (id > 0xFFFFFFFFu)
+				return false;
+			frame.Id[k] = (unsigned int)id;
+			while (previous < previousCount && (*previousIds)[previous] < id)
+				previous++;
+			while (before < beforeCount && (*beforeIds)[before] < id)
+				before++;
+			const bool inPrevious = previous < previousCount && (*previousIds)[previous] == id;
+			const bool inBefore = inPrevious && before < beforeCount && (*beforeIds)[before] == id;
+			for (int c = 0; c < 6; ++c)
+			{
+				uint64_t residual;
+				if (!getVarint(data, end[COLUMN_COMPONENTS + c], position[COLUMN_COMPONENTS + c], residual))
+					return false;
+				const uint64_t predicted = predict(inPrevious, inBefore,
+					inPrevious ? values[1][c][previous] : 0, inBefore ? values[2][c][before] : 0);
+				const int64_t value = (int64_t)(predicted + (uint64_t)unzigzag(residual));
+				values[0][c][k] = value;
+				components[c][k] = (double)value * quanta[c];
+			}
+		}
+		for (int c = 0; c < 6; ++c)
+		{
+			std::swap(values[2][c], values[1][c]);
+			std::swap(values[1][c], values[0][c]);
+		}
+	}
+	for (size_t c = 0; c < COLUMN_COUNT; ++c)
+	{
+		if (position[c] != end[c])
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,177 @@
+#pragma once
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <glad/glad.h>
+#include <body_store.h>
+#include <mapped_file.h>
+
+// Compressed trajectory file: a TrajectoryHeader, then chunks of consecutive
+// frames (a TrajectoryChunkHeader and its LZ compressed payload), then an
+// index of the chunks and a TrajectoryFooter pointing at it. A file whose
+// writer never closed it has no index; readers rebuild it by walking the
+// chunk headers.
+//
+// Inside a chunk every quantity is a column: frame times, body counts, body
+// ids (ascending, as gaps) and the six position and velocity components.
+// Components are quantised to fixed steps and stored as the zigzag varint
+// residual of a linear extrapolation from the same body in the two previous
+// frames of the chunk, which leaves mostly one or two byte residuals for the
+// compressor. Chunks decode independently of each other.
+const uint32_t TRAJECTORY_MAGIC = 0x52545350; // "PSTR"
+const uint32_t TRAJECTORY_CHUNK_MAGIC = 0x4B435450; // "PTCK"
+const uint32_t TRAJECTORY_INDEX_MAGIC = 0x58445450; // "PTDX"
+const uint32_t TRAJECTORY_VERSION = 1;
+
+struct TrajectoryHeader {
+	uint32_t Magic, Version;
+	double PositionQuantum, VelocityQuantum;
+};
+
+struct TrajectoryChunkHeader {
+	uint32_t Magic, FrameCount;
+	// Number of frames in the chunks before this one
+	uint64_t FirstFrame;
+	double FirstTime, LastTime;
+	uint64_t RawBytes, CompressedBytes;
+};
+
+struct TrajectoryIndexEntry {
+	TrajectoryChunkHeader Chunk;
+	// File offset of the chunk header
+	uint64_t Offset;
+};
+
+struct TrajectoryFooter {
+	uint64_t IndexOffset, ChunkCount;
+	uint32_t Magic, Reserved;
+};
+
+// Positions and velocities of the bodies at one instant, sorted by id
+struct TrajectoryFrame {
+	double Time;
+	std::vector<unsigned int> Id;
+	std::vector<double> X, Y, Z, VX, VY, VZ;
+	TrajectoryFrame() :Time(0.0) {}
+	size_t Size() const { return this->Id.size(); }
+	void Resize(size_t n)
+	{
+		this->Id.resize(n);
+		this->X.resize(n); this->Y.resize(n); this->Z.resize(n);
+		this->VX.resize(n); this->VY.resize(n); this->VZ.resize(n);
+	}
+};
+
+// Records frames from the simulation thread and encodes, compresses and
+// writes them on a background thread. Record only copies the bodies into a
+// recycled frame; when the writer thread falls more than MAX_PENDING frames
+// behind, new frames are dropped (and counted) rather than waited for.
+class TrajectoryWriter
+{
+public:
+	// Frames queued for the writer thread before Record starts dropping
+	static const size_t MAX_PENDING = 64;
+
+	TrajectoryWriter();
+	// Closes the file
+	~TrajectoryWriter();
+	// Starts a new file. Positions and velocities are rounded to multiples of
+	// the quanta; framesPerChunk frames are compressed (and, on random access,
+	// decoded) together.
+	bool Open(const std::string &path, double positionQuantum = 1e-6, double velocityQuantum = 1e-6, GLuint framesPerChunk = 32);
+	// Writes the remaining frames and the index and closes the file
+	void Close();
+	bool IsOpen() const { return this->open; }
+	// Queues the state of the bodies at the given simulation time
+	void Record(double time, const BodyStore &bodies);
+	// Frames dropped because the writer thread was behind
+	unsigned long long DroppedFrames() const { return this->droppedFrames; }
+private:
+	bool open;
+	unsigned long long droppedFrames;
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	// Guarded by mutex: frames waiting for the writer thread, frames it has
+	// finished with (kept for their capacity) and the stop request
+	std::deque<TrajectoryFrame> pending;
+	std::vector<TrajectoryFrame> spare;
+	bool stopping;
+
+	// Owned by the writer thread while open
+	std::ofstream file;
+	bool failed;
+	TrajectoryHeader header;
+	GLuint framesPerChunk;
+	std::vector<TrajectoryIndexEntry> index;
+	std::string path;
+	TrajectoryChunkHeader chunk;
+	// Columns of the chunk being filled: frame times, then counts, ids and
+	// the six components as varints
+	std::vector<double> frameTimes;
+	std::vector<char> columns[8];
+	// Ids and quantised components in id order of the frame being encoded
+	// ([0]) and of the previous two frames of the chunk
+	std::vector<unsigned int> frameIds[3];
+	std::vector<int64_t> frameValues[3][6];
+	// (id << 32 | index) of every body of the frame being encoded
+	std::vector<uint64_t> sortKeys;
+	std::vector<char> raw, compressed;
+
+	void run();
+	void encodeFrame(const TrajectoryFrame &frame);
+	void writeChunk();
+	void writeIndex();
+};
+
+// Random access to a trajectory file through a memory mapping. The frames of
+// the last chunk used by ReadFrame / FindFrame are kept decoded, so
+// sequential reads decompress every chunk once. A reader is not thread safe;
+// threads streaming the same file each open their own.
+class TrajectoryReader
+{
+public:
+	TrajectoryReader();
+	bool Open(const std::string &path);
+	void Close();
+	size_t FrameCount() const { return this->frameCount; }
+	double StartTime() const { return this->index.empty() ? 0.0 : this->index.front().Chunk.FirstTime; }
+	double EndTime() const { return this->index.empty() ? 0.0 : this->index.back().Chunk.LastTime; }
+	// Copies frame `frame` (below FrameCount()); false if its chunk is corrupt
+	bool ReadFrame(size_t frame, TrajectoryFrame &out);
+	// Index of the last frame at or before time (0 before the first frame)
+	size_t FindFrame(double time);
+
+	// Chunk level access for streaming readers
+	size_t ChunkCount() const { return this->index.size(); }
+	// Last chunk starting at or before the frame / time
+	size_t ChunkOfFrame(size_t frame) const;
+	size_t ChunkAt(double time) const;
+	size_t ChunkFirstFrame(size_t chunk) const { return (size_t)this->index[chunk].Chunk.FirstFrame; }
+	// Decodes every frame of a chunk into frames; false if the chunk is corrupt
+	bool DecodeChunk(size_t chunk, std::vector<TrajectoryFrame> &frames);
+	// Starts paging the chunk in from disk in the background
+	void PrefetchChunk(size_t chunk) const;
+private:
+	MappedFile file;
+	TrajectoryHeader header;
+	std::vector<TrajectoryIndexEntry> index;
+	size_t frameCount;
+	// Decoded frames of chunk cachedChunk
+	size_t cachedChunk;
+	std::vector<TrajectoryFrame> cachedFrames;
+	std::vector<char> raw;
+
+	bool readIndex();
+	void scanChunks();
+	bool loadChunk(size_t chunk);
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include <trajectory_playback.h>
+#include <iostream>
+
+TrajectoryPlayback::TrajectoryPlayback()
+	:open(false), time(0.0), speed(1.0), requestedChunk(BodyStore::INVALID_INDEX), decodingChunk(BodyStore::INVALID_INDEX), aheadReady(false), stopping(false)
+{
+}
+
+TrajectoryPlayback::~TrajectoryPlayback()
+{
+	this->Close();
+}
+
+bool TrajectoryPlayback::Open(const std::string &path)
+{
+	this->Close();
+	if (!this->reader.Open(path) || !this->aheadReader.Open(path))
+	{
+		this->reader.Close();
+		return false;
+	}
+	if (this->reader.FrameCount() == 0)
+	{
+		std::cout << "ERROR::TRAJECTORY: " << path << " contains no frames" << std::endl;
+		this->reader.Close();
+		this->aheadReader.Close();
+		return false;
+	}
+	this->time = this->reader.StartTime();
+	this->requestedChunk = BodyStore::INVALID_INDEX;
+	this->decodingChunk = BodyStore::INVALID_INDEX;
+	this->aheadReady = false;
+	this->stopping = false;
+	this->open = true;
+	this->worker = std::thread(&TrajectoryPlayback::run, this);
+	return true;
+}
+
+void TrajectoryPlayback::Close()
+{
+	if (!this->open)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wake.notify_one();
+	this->worker.join();
+	this->open = false;
+	this->cache.clear();
+	this->ahead.Frames.clear();
+	this->reader.Close();
+	this->aheadReader.Close();
+}
+
+void TrajectoryPlayback::Seek(double time)
+{
+	if (time < this->StartTime())
+		time = this->StartTime();
+	if (time > this->EndTime())
+		time = this->EndTime();
+	this->time = time;
+}
+
+void TrajectoryPlayback::Advance(double realDt)
+{
+	this->Seek(this->time + realDt * this->speed);
+}
+
+const std::vector<TrajectoryFrame> *TrajectoryPlayback::chunkFrames(size_t chunk)
+{
+	for (std::list<DecodedChunk>::iterator entry = this->cache.begin(); entry != this->cache.end(); ++entry)
+	{
+		if (entry->Chunk == chunk)
+		{
+			this->cache.splice(this->cache.end(), this->cache, entry);
+			return &this->cache.back().Frames;
+		}
+	}
+	// recycle the least recently used entry's buffers
+	if (this->cache.size() >= CACHED_CHUNKS)
+		this->cache.splice(this->cache.end(), this->cache, this->cache.begin());
+	else
+		this->cache.push_back(DecodedChunk());
+	DecodedChunk &entry = this->cache.back();
+	entry.Chunk = BodyStore::INVALID_INDEX;
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->decoded.wait(lock, [this, chunk]() { return this->requestedChunk != chunk && this->decodingChunk != chunk; });
+		if (this->aheadReady && this->ahead.Chunk == chunk)
+		{
+			entry.Frames.swap(this->ahead.Frames);
+			entry.Chunk = chunk;
+			this->aheadReady = false;
+		}
+	}
+	if (entry.Chunk != chunk)
+	{
+		if (!this->reader.DecodeChunk(chunk, entry.Frames))
+		{
+			std::cout << "ERROR::TRAJECTORY: Chunk " << chunk << " is corrupt" << std::endl;
+			this->cache.pop_back();
+			return nullptr;
+		}
+		entry.Chunk = chunk;
+	}
+	return &entry.Frames;
+}
+
+void TrajectoryPlayback::requestAhead(size_t chunk)
+{
+	if (chunk >= this->reader.ChunkCount())
+		return;
+	for (std::list<DecodedChunk>::const_iterator entry = this->cache.begin(); entry != this->cache.end(); ++entry)
+	{
+		if (entry->Chunk == chunk)
+			return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (this->decodingChunk == chunk || (this->aheadReady && this->ahead.Chunk == chunk))
+			return;
+		this->requestedChunk = chunk;
+	}
+	this->wake.notify_one();
+}
+
+void TrajectoryPlayback::run()
+{
+	DecodedChunk result;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [this]() { return this->stopping || this->requestedChunk != BodyStore::INVALID_INDEX; });
+			if (this->stopping)
+				return;
+			result.Chunk = this->requestedChunk;
+			this->decodingChunk = this->requestedChunk;
+			this->requestedChunk = BodyStore::INVALID_INDEX;
+		}
+		const bool valid = this->aheadReader.DecodeChunk(result.Chunk, result.Frames);
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->decodingChunk = BodyStore::INVALID_INDEX;
+			if (valid)
+			{
+				// the previous result's buffers are reused for the next decode
+				std::swap(this->ahead, result);
+				this->aheadReady = true;
+			}
+		}
+		this->decoded.notify_all();
+	}
+}
+
+bool TrajectoryPlayback::Interpolate(const BodyStore &reference, BodyStore &bodies)
+{
+	if (!this->open)
+		return false;
+	const size_t chunk = this->reader.ChunkAt(this->time);
+	const std::vector<TrajectoryFrame> *frames = this->chunkFrames(chunk);
+	if (frames == nullptr || frames->empty())
+		return false;
+	// last frame at or before the playback time, and the one after it
+	size_t low = 0, high = frames->size();
+	while (high - low > 1)
+	{
+		const size_t middle = (low + high) / 2;
+		if ((*frames)[middle].Time <= this->time)
+			low = middle;
+		else
+			high = middle;
+	}
+	const TrajectoryFrame &a = (*frames)[low];
+	const TrajectoryFrame *b = &a;
+	if (low + 1 < frames->size())
+		b = &(*frames)[low + 1];
+	else if (chunk + 1 < this->reader.ChunkCount())
+	{
+		const std::vector<TrajectoryFrame> *next = this->chunkFrames(chunk + 1);
+		if (next != nullptr && !next->empty())
+			b = &next->front();
+	}
+	if (chunk + 1 < this->reader.ChunkCount() && this->speed >= 0.0)
+	{
+		this->requestAhead(chunk + 1);
+		this->reader.PrefetchChunk(chunk + 2);
+	}
+	else if (chunk > 0 && this->speed < 0.0)
+	{
+		this->requestAhead(chunk - 1);
+		if (chunk > 1)
+			this->reader.PrefetchChunk(chunk - 2);
+	}
+
+	// Hermite basis over the frame interval h with s in [0, 1]
+	const double h = b->Time - a.Time;
+	const double elapsed = this->time - a.Time;
+	const double s = h > 0.0 ? elapsed / h : 0.0;
+	const double s2 = s * s, s3 = s2 * s;
+	const double h00 = 2.0 * s3 - 3.0 * s2 + 1.0, h10 = s3 - 2.0 * s2 + s;
+	const double h01 = -2.0 * s3 + 3.0 * s2, h11 = s3 - s2;
+	// derivatives with respect to time
+	const double d00 = h > 0.0 ? (6.0 * s2 - 6.0 * s) / h : 0.0, d10 = 3.0 * s2 - 4.0 * s + 1.0;
+	const double d01 = -d00, d11 = 3.0 * s2 - 2.0 * s;
+
+	double meanRadius = 0.0;
+	for (size_t i = 0; i < reference.Size(); ++i)
+		meanRadius += reference.Radius[i];
+	meanRadius = reference.Size() > 0 ? meanRadius / reference.Size() : 1.0;
+
+	const size_t n = a.Size();
+	bodies.Resize(n);
+	unsigned int idLimit = 0;
+	size_t j = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const unsigned int id = a.Id[i];
+		// both frames are sorted by id
+		while (j < b->Size() && b->Id[j] < id)
+			j++;
+		if (j < b->Size() && b->Id[j] == id && h > 0.0)
+		{
+			bodies.X[i] = h00 * a.X[i] + h10 * h * a.VX[i] + h01 * b->X[j] + h11 * h * b->VX[j];
+			bodies.Y[i] = h00 * a.Y[i] + h10 * h * a.VY[i] + h01 * b->Y[j] + h11 * h * b->VY[j];
+			bodies.Z[i] = h00 * a.Z[i] + h10 * h * a.VZ[i] + h01 * b->Z[j] + h11 * h * b->VZ[j];
+			bodies.VX[i] = d00 * a.X[i] + d10 * a.VX[i] + d01 * b->X[j] + d11 * b->VX[j];
+			bodies.VY[i] = d00 * a.Y[i] + d10 * a.VY[i] + d01 * b->Y[j] + d11 * b->VY[j];
+			bodies.VZ[i] = d00 * a.Z[i] + d10 * a.VZ[i] + d01 * b->Z[j] + d11 * b->VZ[j];
+		}
+		else
+		{
+			// gone by the next frame (or the last frame): drift on
+			bodies.X[i] = a.X[i] + elapsed * a.VX[i];
+			bodies.Y[i] = a.Y[i] + elapsed * a.VY[i];
+			bodies.Z[i] = a.Z[i] + elapsed * a.VZ[i];
+			bodies.VX[i] = a.VX[i];
+			bodies.VY[i] = a.VY[i];
+			bodies.VZ[i] = a.VZ[i];
+		}
+		bodies.AX[i] = bodies.AY[i] = bodies.AZ[i] = 0.0;
+		bodies.JX[i] = bodies.JY[i] = bodies.JZ[i] = 0.0;
+		const size_t source = reference.IndexOf(id);
+		bodies.Mass[i] = source != BodyStore::INVALID_INDEX ? reference.Mass[source] : 0.0;
+		bodies.Radius[i] = source != BodyStore::INVALID_INDEX ? reference.Radius[source] : meanRadius;
+		bodies.Color[i] = source != BodyStore::INVALID_INDEX ? reference.Color[source] : glm::vec4(1.0f);
+		bodies.Id[i] = id;
+		idLimit = id + 1 > idLimit ? id + 1 : idLimit;
+	}
+	bodies.RebuildIndex(idLimit);
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef TRAJECTORY_PLAYBACK_H
+#define TRAJECTORY_PLAYBACK_H
+#include <list>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <body_store.h>
+#include <trajectory.h>
+
+// Replays a recorded trajectory instead of simulating it. The playback time
+// moves at a configurable speed (negative plays backwards) or is set
+// directly for scrubbing; the state shown is the cubic Hermite interpolation
+// of the positions and velocities of the two recorded frames around it, so
+// motion stays smooth however sparse the recording.
+//
+// Chunks are decoded by a read-ahead thread with its own reader: whenever
+// the playback enters a chunk, the next one in the playing direction is
+// decoded in the background and the one after it is paged in from disk.
+// The main thread only decodes after a seek.
+class TrajectoryPlayback
+{
+public:
+	// Decoded chunks kept around the playback position (at least 2)
+	static const size_t CACHED_CHUNKS = 4;
+
+	TrajectoryPlayback();
+	~TrajectoryPlayback();
+	bool Open(const std::string &path);
+	void Close();
+	bool IsOpen() const { return this->open; }
+	double StartTime() const { return this->reader.StartTime(); }
+	double EndTime() const { return this->reader.EndTime(); }
+	double Time() const { return this->time; }
+	// Simulated time per second of real time
+	void SetSpeed(double speed) { this->speed = speed; }
+	double Speed() const { return this->speed; }
+	// Moves the playback to the given time, clamped to the recording
+	void Seek(double time);
+	// Advances the playback by realDt seconds at the current speed, stopping at either end
+	void Advance(double realDt);
+	// Writes the interpolated state at Time() into bodies (ids as recorded).
+	// Masses, radii and colours come from the body with the same id in
+	// reference; bodies it no longer has get its mean radius.
+	bool Interpolate(const BodyStore &reference, BodyStore &bodies);
+private:
+	struct DecodedChunk {
+		size_t Chunk;
+		std::vector<TrajectoryFrame> Frames;
+	};
+	bool open;
+	double time, speed;
+	// Used by the main thread
+	TrajectoryReader reader;
+	// Most recently used last; a list so the frames stay put while in use
+	std::list<DecodedChunk> cache;
+
+	// Read-ahead thread and its reader
+	std::thread worker;
+	TrajectoryReader aheadReader;
+	std::mutex mutex;
+	std::condition_variable wake, decoded;
+	// Guarded by mutex: the chunk to decode next, the one being decoded
+	// (both INVALID_INDEX when idle) and the last one decoded
+	size_t requestedChunk, decodingChunk;
+	DecodedChunk ahead;
+	bool aheadReady;
+	bool stopping;
+
+	// Frames of a chunk from the cache, the read-ahead thread or decoded in place
+	const std::vector<TrajectoryFrame> *chunkFrames(size_t chunk);
+	void requestAhead(size_t chunk);
+	void run();
+};
+
+#endif